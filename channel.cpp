@@ -0,0 +1,559 @@
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+
+#include <lib/tp.1.5.h>
+#include <lib/session.h>
+
+#include <zmq.h>
+#include <zmq_utils.h>
+
+#include "channel.h"
+#include "logger.h"
+
+namespace replicator {
+
+// Reader thread sends SerializableBinlogEventBatch to the writer thread,
+// all other messages are single SerializableBinlogEvent
+
+template<typename T>
+static void send_zmq_event(void *socket, const T &ev)
+{
+	std::ostringstream oss;
+	boost::archive::binary_oarchive oa(oss);
+	oa << ev;
+	zmq_send(socket, oss.str().c_str(), oss.str().length()+1, 0);
+}
+
+template<typename T>
+static bool poll_zmq_event(void *socket, unsigned timeout, boost::function<bool (const T &)> f)
+{
+	zmq_pollitem_t items [] = {
+		{ socket, 0, ZMQ_POLLIN, 0 },
+	};
+
+	int polled = zmq_poll(items, 1, timeout);
+	if (polled < 0) {
+		// error polling
+		return false;
+	}
+
+	bool done = false;
+
+	if (polled > 0 && (items[0].revents & ZMQ_POLLIN)) {
+		while (polled-- > 0) {
+			// restart binlog
+			zmq_msg_t msg;
+			zmq_msg_init(&msg);
+
+			if (zmq_msg_recv(&msg, socket, 0) < 0) {
+				zmq_msg_close(&msg);
+				return false;
+			}
+
+			std::string buf;
+			buf.append((char *)zmq_msg_data(&msg), zmq_msg_size(&msg));
+			zmq_msg_close(&msg);
+
+			T ev;
+			std::istringstream iss(buf);
+			boost::archive::binary_iarchive ia(iss);
+			ia >> ev;
+			done = done || f(ev);
+			if (done) break;
+		}
+	}
+
+	return done;
+}
+
+static unsigned percent(unsigned long long part, unsigned long long total)
+{
+	return total ? unsigned(part * 100 / total) : 0;
+}
+
+Channel::Channel(const std::string &name, DBReader *dbreader, TPWriter *tpwriter, unsigned watchdog_timeout,
+	const std::vector<unsigned> &cpus, Graphite *graphite) :
+	name(name), dbreader(dbreader), tpwriter(tpwriter), watchdog_timeout(watchdog_timeout), cpus(cpus), graphite(graphite),
+	term(false), zmq_context(NULL), reader_thread(NULL), tp_socket(NULL), tp_thread(NULL), wd_socket(NULL), wd_thread(NULL),
+	batches_sent(0), batches_done(0), seconds_behind_master(0), max_seconds_behind_master(0),
+#ifdef ZMQ_ENABLE_RB
+	zalloc_count(0), max_zalloc_count(0),
+#endif
+	last_stats_time(0), last_event_timestamp(0)
+{
+}
+
+Channel::~Channel()
+{
+	Join();
+
+	// sighandler protection
+	DBReader *dbreader_ = dbreader;
+	dbreader = NULL;
+	delete dbreader_;
+
+	delete tpwriter;
+}
+
+bool Channel::Start(void *zmq_context_)
+{
+	zmq_context = zmq_context_;
+	reader_thread = zmq_threadstart(ReaderMain, this);
+	return reader_thread != NULL;
+}
+
+void Channel::Stop()
+{
+	term = true;
+	if (dbreader) {
+		dbreader->Stop();
+	}
+}
+
+void Channel::Join()
+{
+	if (reader_thread != NULL) {
+		zmq_threadclose(reader_thread);
+		reader_thread = NULL;
+	}
+}
+
+void Channel::ReaderMain(void *arg)
+{
+	static_cast<Channel *>(arg)->RunReader();
+}
+
+void Channel::WriterMain(void *arg)
+{
+	Channel *channel = static_cast<Channel *>(arg);
+	void *socket = zmq_socket(channel->zmq_context, ZMQ_PAIR);
+
+	if (!socket) {
+		kill(getpid(), SIGTERM);
+		return;
+	}
+
+	// set high water mark
+	int opti = 10000;
+	zmq_setsockopt(socket, ZMQ_RCVHWM, &opti, sizeof(opti));
+
+	if (zmq_connect(socket, channel->Endpoint("tp").c_str())) {
+		kill(getpid(), SIGTERM);
+		zmq_close(socket);
+		return;
+	}
+
+	channel->RunWriter(socket);
+
+	zmq_close(socket);
+}
+
+void Channel::WatchdogMain(void *arg)
+{
+	static_cast<Channel *>(arg)->RunWatchdog();
+}
+
+std::string Channel::Endpoint(const char *kind) const
+{
+	return std::string("inproc://") + kind + (name.empty() ? "" : "." + name);
+}
+
+std::string Channel::Metric(const char *stat) const
+{
+	return name.empty() ? std::string(stat) : name + "." + stat;
+}
+
+std::ostream &Channel::Log(std::ostream &out) const
+{
+	if (!name.empty()) {
+		out << "[" << name << "] ";
+	}
+	return out;
+}
+
+void Channel::SetAffinity()
+{
+	if (cpus.empty()) {
+		return;
+	}
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t i = 0; i < cpus.size(); ++i) {
+		CPU_SET(cpus[i], &set);
+	}
+
+	const int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (rc) {
+		Log(std::cerr) << "Can't set CPU affinity: " << strerror(rc) << std::endl;
+	}
+}
+
+bool Channel::StartZmq()
+{
+	int opti;
+	int rc;
+
+	// tarantool
+	//
+	tp_socket = zmq_socket(zmq_context, ZMQ_PAIR);
+	if (tp_socket == NULL) {
+		return false;
+	}
+
+	// set high water mark
+	opti = 10000;
+	zmq_setsockopt(tp_socket, ZMQ_SNDHWM, &opti, sizeof(opti));
+	rc = zmq_bind(tp_socket, Endpoint("tp").c_str());
+	if (rc) {
+		return false;
+	}
+
+	// spawn tp thread
+	tp_thread = zmq_threadstart(WriterMain, this);
+	if (tp_thread == NULL) {
+		return false;
+	}
+
+	// watchdog
+	//
+	wd_socket = zmq_socket(zmq_context, ZMQ_PAIR);
+	if (wd_socket == NULL) {
+		return false;
+	}
+	rc = zmq_bind(wd_socket, Endpoint("wd").c_str());
+	if (rc) {
+		return false;
+	}
+	wd_thread = zmq_threadstart(WatchdogMain, this);
+
+	return wd_thread != NULL;
+}
+
+void Channel::CloseZmq()
+{
+	if (tp_thread != NULL) {
+		zmq_threadclose(tp_thread);
+		tp_thread = NULL;
+	}
+	if (wd_thread != NULL) {
+		zmq_threadclose(wd_thread);
+		wd_thread = NULL;
+	}
+
+	if (tp_socket != NULL) {
+		zmq_close(tp_socket);
+		tp_socket = NULL;
+	}
+	if (wd_socket != NULL) {
+		zmq_close(wd_socket);
+		wd_socket = NULL;
+	}
+}
+
+// ===============
+
+bool Channel::WriteBatchCallback(const SerializableBinlogEventBatch &batch)
+{
+	batches_done++;
+	return tpwriter->BinlogBatchCallback(batch);
+}
+
+void Channel::RunWriter(void *socket)
+{
+	SerializableBinlogEvent ev_connect;
+	SerializableBinlogEvent ev_disconnect;
+
+	SerializableBinlogEvent ev_position;
+
+	ev_connect.event = "CONNECT";
+	ev_disconnect.event = "DISCONNECT";
+
+	bool connected = true;
+
+	while (!term && connected) {
+		if (!tpwriter->Connect()) {
+			continue;
+		}
+
+		// send initial binlog position to the reader thread
+
+		try {
+			if (!tpwriter->ReadBinlogPos(ev_connect.binlog_name, ev_connect.binlog_pos)) {
+				tpwriter->Disconnect();
+				continue;
+			}
+
+			send_zmq_event(socket, ev_connect);
+
+			while(true) {
+				if (term || !connected) {
+					break;
+				}
+
+				connected = poll_zmq_event<SerializableBinlogEventBatch>(socket, 100,
+					boost::bind(&Channel::WriteBatchCallback, this, _1)) == false;
+				if (connected && position_slot.Take(batches_done, ev_position)) {
+					connected = tpwriter->BinlogEventCallback(ev_position) == false;
+				}
+				if (connected) {
+					connected = tpwriter->Sync();
+				}
+
+				while (!term && connected) {
+					int r = tpwriter->ReadReply();
+					if (r == 0) {
+						break;
+					}
+					if (r < 0) {
+						connected = false;
+						break;
+					}
+					int code = tpwriter->GetReplyCode();
+					if (code) {
+						Log(std::cerr) << "Tarantool error: " << tpwriter->GetReplyErrorMessage() << " (code: " << code << ")" << std::endl;
+						connected = !tpwriter->DisconnectOnError();
+					}
+				}
+			}
+		}
+		catch (std::range_error& ex) {
+			connected = false;
+			Log(std::cout) << ex.what() << std::endl;
+			// loop exit
+		}
+		catch (std::exception& ex) {
+			Log(std::cout) << ex.what() << std::endl;
+			tpwriter->Disconnect();
+			send_zmq_event(socket, ev_disconnect);
+			// reconnect
+		}
+	}
+
+	tpwriter->Disconnect();
+	send_zmq_event(socket, ev_disconnect);
+}
+
+// ====================
+
+void Channel::PingWatchdog()
+{
+	SerializableBinlogEvent ev;
+	ev.event = "PING";
+	send_zmq_event(wd_socket, ev);
+}
+
+void Channel::UpdateStats()
+{
+	time_t now;
+
+	if (!dbreader) {
+		return;
+	}
+
+	PingWatchdog();
+
+	now = ::time(NULL);
+
+	seconds_behind_master = dbreader->GetSecondsBehindMaster();
+	if (seconds_behind_master > max_seconds_behind_master) max_seconds_behind_master = seconds_behind_master;
+
+#ifdef ZMQ_ENABLE_RB
+	zalloc_count = zmq_get_alloc_count();
+	if (zalloc_count > max_zalloc_count) max_zalloc_count = zalloc_count;
+#endif
+
+	// each channel keeps its own interval, the connection is shared
+	if (graphite) {
+		if (now > last_stats_time + graphite->GetInterval()) {
+			last_stats_time = now;
+
+			graphite->SendStat(Metric("seconds_behind_master"), seconds_behind_master);
+			graphite->SendStat(Metric("max_seconds_behind_master"), max_seconds_behind_master);
+			max_seconds_behind_master = seconds_behind_master;
+
+			slave::Slave::row_counters_t counters;
+			dbreader->GetRowCounters(counters);
+			for (slave::Slave::row_counters_t::const_iterator i = counters.begin(); i != counters.end(); ++i) {
+				graphite->SendStat(Metric("rows_decoded.") + i->first, i->second.first);
+				graphite->SendStat(Metric("rows_skipped.") + i->first, i->second.second);
+			}
+
+			// binlog reading pipeline: busy shares of both stages since the last report
+			slave::PipelineStats pipeline;
+			dbreader->GetPipelineStats(pipeline);
+			graphite->SendStat(Metric("binlog_queue_depth"), pipeline.queue_depth);
+			graphite->SendStat(Metric("binlog_queue_max_depth"), pipeline.queue_max_depth);
+			graphite->SendStat(Metric("binlog_reader_blocked_pct"),
+				percent(pipeline.read_full_us - last_pipeline.read_full_us,
+					pipeline.read_us + pipeline.read_full_us - last_pipeline.read_us - last_pipeline.read_full_us));
+			graphite->SendStat(Metric("binlog_decoder_busy_pct"),
+				percent(pipeline.decode_us - last_pipeline.decode_us,
+					pipeline.decode_us + pipeline.decode_idle_us - last_pipeline.decode_us - last_pipeline.decode_idle_us));
+			// DDL: the stream stands still while table structures are read again
+			graphite->SendStat(Metric("schema_refreshes"), pipeline.schema_refreshes - last_pipeline.schema_refreshes);
+			graphite->SendStat(Metric("schema_refresh_ms"), (pipeline.schema_refresh_us - last_pipeline.schema_refresh_us) / 1000);
+			graphite->SendStat(Metric("schema_refresh_max_ms"), pipeline.schema_refresh_max_us / 1000);
+			last_pipeline = pipeline;
+
+			unsigned long positions_published, positions_taken;
+			position_slot.GetCounters(positions_published, positions_taken);
+			graphite->SendStat(Metric("messages_sent"), batches_sent);
+			graphite->SendStat(Metric("positions_published"), positions_published);
+			graphite->SendStat(Metric("positions_taken"), positions_taken);
+
+#ifdef ZMQ_ENABLE_RB
+			graphite->SendStat(Metric("zmq_allocs_total"), zalloc_count);
+			graphite->SendStat(Metric("zmq_allocs_total_max"), max_zalloc_count);
+			max_zalloc_count = zalloc_count;
+#endif
+		}
+	}
+}
+
+// ====================
+// watchdog
+
+bool Channel::WatchdogEventCallback(const SerializableBinlogEvent &ev)
+{
+	last_event_timestamp = ::time(NULL);
+	return false;
+}
+
+void Channel::RunWatchdog()
+{
+	void *socket = zmq_socket(zmq_context, ZMQ_PAIR);
+
+	if (!socket || zmq_connect(socket, Endpoint("wd").c_str())) {
+		kill(getpid(), SIGTERM);
+		return;
+	}
+
+	last_event_timestamp = ::time(NULL);
+
+	while (!term) {
+		poll_zmq_event<SerializableBinlogEvent>(socket, 1000, boost::bind(&Channel::WatchdogEventCallback, this, _1));
+
+		if (last_event_timestamp + watchdog_timeout < ::time(NULL)) {
+			Log(std::cerr) << "Ping timeout detected by watchdog: committing suicide now. Restarting." << std::endl;
+			if (logfile) {
+				logfile->Flush();
+			}
+			kill(getpid(), SIGKILL);
+			break;
+		}
+	}
+
+	zmq_close(socket);
+}
+
+// ====================
+
+bool Channel::ReadPositionCallback(const SerializableBinlogEvent &ev, std::string &binlog_name, unsigned long &binlog_pos,
+	bool &disconnect, bool &read)
+{
+	read = true;
+	disconnect = ev.event == "DISCONNECT";
+	binlog_name = ev.binlog_name;
+	binlog_pos = ev.binlog_pos;
+	return false;
+}
+
+bool Channel::ReadPosition(unsigned timeout, std::string &binlog_name, unsigned long &binlog_pos, bool &disconnect)
+{
+	bool read = false;
+	poll_zmq_event<SerializableBinlogEvent>(tp_socket, timeout, boost::bind(&Channel::ReadPositionCallback, this, _1,
+		boost::ref(binlog_name), boost::ref(binlog_pos), boost::ref(disconnect), boost::ref(read)));
+	return read;
+}
+
+bool Channel::ReadBatchCallback(const SerializableBinlogEventBatch &ev, std::string &binlog_name, unsigned long &binlog_pos,
+	bool &disconnect)
+{
+	if (term) {
+		return true;
+	}
+
+	UpdateStats();
+
+	if (ReadPosition(0, binlog_name, binlog_pos, disconnect)) {
+		return true;
+	}
+
+	// position-only update: the last one wins until the writer takes it
+	if (ev.size() == 1 && ev[0].event == "IGNORE") {
+		position_slot.Publish(ev[0], batches_sent);
+		return false;
+	}
+
+	send_zmq_event(tp_socket, ev);
+	batches_sent++;
+	return false;
+}
+
+void Channel::RunReader()
+{
+	SetAffinity();
+
+	if (!StartZmq()) {
+		Log(std::cerr) << "Can't start ZMQ: " << zmq_strerror(zmq_errno()) << std::endl;
+		term = true;
+		CloseZmq();
+		kill(getpid(), SIGTERM);
+		return;
+	}
+
+	PingWatchdog();
+
+	std::string binlog_name;
+	unsigned long binlog_pos;
+	bool disconnected = true;
+
+	// read initial binlog pos from Tarantool
+	while (!term) {
+		ReadPosition(100, binlog_name, binlog_pos, disconnected);
+		if (disconnected) {
+			PingWatchdog();
+			::sleep(1);
+			continue;
+		}
+
+		if (term) {
+			break;
+		}
+
+		try {
+			BinlogBatchCallback cb = boost::bind(&Channel::ReadBatchCallback, this, _1,
+				boost::ref(binlog_name), boost::ref(binlog_pos), boost::ref(disconnected));
+
+			if (binlog_name == "") {
+				Log(std::cout) << "Tarantool reported null binlog position. Dumping tables..." << std::endl;
+				dbreader->DumpTables(binlog_name, binlog_pos, cb);
+			}
+
+			Log(std::cout) << "Reading binlogs (" << binlog_name << ", " << binlog_pos << ")..." << std::endl;
+
+			dbreader->ReadBinlog(binlog_name, binlog_pos, cb);
+		} catch (std::exception& ex) {
+			Log(std::cerr) << "Error in reading binlogs: " << ex.what() << std::endl;
+			Log(std::cerr) << "Terminating" << std::endl;
+
+			// all channels stop, the process is restarted as a whole
+			term = true;
+			kill(getpid(), SIGTERM);
+		}
+	}
+
+	CloseZmq();
+}
+
+} // replicator
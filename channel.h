@@ -0,0 +1,106 @@
+#ifndef REPLICATOR_CHANNEL_H
+#define REPLICATOR_CHANNEL_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "dbreader.h"
+#include "tpwriter.h"
+#include "positionslot.h"
+#include "remotemon.h"
+
+namespace replicator {
+
+// One MySQL to Tarantool pipeline: the binlog reader, the Tarantool writer
+// and the watchdog, each on a thread of its own, talking over inproc ZMQ
+// sockets named after the channel. Channels of a process share the ZMQ
+// context, the log and the Graphite connection, nothing else.
+//
+// The reader thread runs on the CPUs given, the threads it starts (the
+// writer, the watchdog, libslave's packet reader) inherit that.
+class Channel
+{
+public:
+	// Takes dbreader and tpwriter over
+	Channel(const std::string &name, DBReader *dbreader, TPWriter *tpwriter, unsigned watchdog_timeout,
+		const std::vector<unsigned> &cpus, Graphite *graphite);
+	~Channel();
+
+	bool Start(void *zmq_context);
+	// Only sets flags, so it is safe to call from a signal handler
+	void Stop();
+	// Waits for the threads to stop
+	void Join();
+
+	const std::string &GetName() const { return name; }
+
+private:
+	Channel(const Channel &);
+	Channel &operator=(const Channel &); // not copyable
+
+	static void ReaderMain(void *arg);
+	static void WriterMain(void *arg);
+	static void WatchdogMain(void *arg);
+
+	void RunReader();
+	void RunWriter(void *socket);
+	void RunWatchdog();
+
+	bool StartZmq();
+	void CloseZmq();
+	void SetAffinity();
+
+	bool WriteBatchCallback(const SerializableBinlogEventBatch &batch);
+	bool WatchdogEventCallback(const SerializableBinlogEvent &ev);
+	bool ReadPositionCallback(const SerializableBinlogEvent &ev, std::string &binlog_name, unsigned long &binlog_pos,
+		bool &disconnect, bool &read);
+	bool ReadPosition(unsigned timeout, std::string &binlog_name, unsigned long &binlog_pos, bool &disconnect);
+	bool ReadBatchCallback(const SerializableBinlogEventBatch &ev, std::string &binlog_name, unsigned long &binlog_pos,
+		bool &disconnect);
+
+	void PingWatchdog();
+	void UpdateStats();
+	std::string Endpoint(const char *kind) const;
+	std::string Metric(const char *stat) const;
+	std::ostream &Log(std::ostream &out) const;
+
+	const std::string name;
+	DBReader *dbreader;
+	TPWriter *tpwriter;
+	const unsigned watchdog_timeout;
+	const std::vector<unsigned> cpus;
+	Graphite *graphite;
+
+	std::atomic<bool> term;
+
+	void *zmq_context;
+	void *reader_thread;
+	// reader ends of the writer and the watchdog sockets
+	void *tp_socket;
+	void *tp_thread;
+	void *wd_socket;
+	void *wd_thread;
+
+	// Position-only updates bypass the message queue, see PositionSlot
+	PositionSlot position_slot;
+	unsigned long batches_sent;	// reader thread
+	unsigned long batches_done;	// writer thread
+
+	// reader thread
+	unsigned seconds_behind_master;
+	unsigned max_seconds_behind_master;
+#ifdef ZMQ_ENABLE_RB
+	unsigned zalloc_count;
+	unsigned max_zalloc_count;
+#endif
+	slave::PipelineStats last_pipeline;
+	::time_t last_stats_time;
+
+	// watchdog thread
+	::time_t last_event_timestamp;
+};
+
+} // replicator
+
+#endif // REPLICATOR_CHANNEL_H
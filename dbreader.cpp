@@ -1,3 +1,4 @@
+#include <sys/time.h>
 #include <sstream>
 #include <boost/bind.hpp>
 #include <boost/ref.hpp>
@@ -5,23 +6,56 @@
 #include <boost/function.hpp>
 #include <boost/algorithm/string/join.hpp>
 
+#include <types.h>
+
 #include "dbreader.h"
 #include "serializable.h"
 
 namespace replicator {
 
-static SerializableRow SlaveRowToSerializableRow(const slave::Row &row)
+// DBReader::EpochColumns kinds
+enum { EPOCH_NONE, EPOCH_DATE, EPOCH_DATETIME };
+
+static unsigned char EpochKind(const slave::Field *field)
+{
+	if (dynamic_cast<const slave::Field_date *>(field)) {
+		return EPOCH_DATE;
+	}
+	if (dynamic_cast<const slave::Field_datetime *>(field)) {
+		return EPOCH_DATETIME;
+	}
+	return EPOCH_NONE;
+}
+
+// Epoch seconds go as signed 64 bit numbers: DATE and DATETIME reach from
+// year 1000 to 9999, far out of the 32 bits of TIMESTAMP
+static void ToEpochSeconds(const slave::FieldValue &v, unsigned char kind, SerializableValue &sv)
 {
-	SerializableRow srow;
-	srow.reserve(row.size());
-	for (slave::Row::const_iterator i = row.begin(); i != row.end(); ++i) {
-		srow.push_back((*i).second);
+	const time_t t = kind == EPOCH_DATE ? slave::types::date2time(v.u) : slave::types::datetime2time(v.ull);
+
+	slave::FieldValue epoch;
+	epoch.setLongLong(t);
+	sv = epoch;
+}
+
+// 'epoch' marks the slots converted to seconds since the epoch
+static void SlaveRowToSerializableRow(const slave::Row &row, SerializableRow &srow, const std::vector<unsigned char> *epoch = NULL)
+{
+	srow.resize(row.size());
+	for (unsigned i = 0; i < row.size(); ++i) {
+		if (epoch && (*epoch)[i] != EPOCH_NONE && !row[i].isNull()) {
+			ToEpochSeconds(row[i], (*epoch)[i], srow[i]);
+		} else {
+			srow[i] = row[i];
+		}
 	}
-	return srow;
 }
 
-DBReader::DBReader(const std::string &host, const std::string &user, const std::string &password, unsigned int port, unsigned connect_retry) :
-masterinfo(host, port, user, password, connect_retry), state(), slave(masterinfo, state), stopped(false), last_event_when(0)
+DBReader::DBReader(const std::string &host, const std::string &user, const std::string &password, unsigned int port, unsigned connect_retry,
+	unsigned position_lag_bytes, unsigned position_lag_ms, bool checksum_verify) :
+masterinfo(host, port, user, password, connect_retry, position_lag_ms, checksum_verify), state(), slave(masterinfo, state),
+stopped(false), last_event_when(0), position_lag_bytes(position_lag_bytes), position_lag_ms(position_lag_ms),
+sent_binlog_pos(0), sent_ms(0), pending_binlog_pos(0), position_pending(false)
 {
 
 }
@@ -31,17 +65,33 @@ DBReader::~DBReader()
 	slave.close_connection();
 }
 
-void DBReader::AddTable(const std::string &db, const std::string &table, const std::vector<std::string> &columns)
+void DBReader::AddTable(const std::string &db, const std::string &table, const std::vector<std::string> &columns, bool epoch_seconds)
+{
+	tables.push_back(DBTable(db, table, columns, epoch_seconds));
+	if (epoch_seconds) {
+		epoch_tables[std::make_pair(db, table)] = EpochColumns();
+	}
+}
+
+void DBReader::AddFilter(const std::string &db, const std::string &tbl, const FilterExpr &expr)
 {
-	tables.push_back(DBTable(db, table, columns));
+	filters[std::make_pair(db, tbl)].Compile(expr);
 }
 
-void DBReader::AddFilterPredicate(const std::string &db, const std::string &tbl, const SimplePredicate &pred)
+void DBReader::AddDecimalFormat(const std::string &db, const std::string &tbl, const std::string &column, slave::Field_decimal::Format format)
 {
-	sfilter.AddPredicate(db, tbl, pred);
+	decimal_formats[std::make_pair(db, tbl)][column] = format;
 }
 
-void DBReader::DumpTables(std::string &binlog_name, BinlogPos &binlog_pos, BinlogEventCallback cb)
+static void SetDecimalFormats(slave::Slave &slave, const std::pair<std::string, std::string> &table,
+	const std::map<std::string, slave::Field_decimal::Format> &formats)
+{
+	for (auto f = formats.begin(); f != formats.end(); ++f) {
+		slave.setDecimalFormat(table.first, table.second, f->first, f->second);
+	}
+}
+
+void DBReader::DumpTables(std::string &binlog_name, BinlogPos &binlog_pos, BinlogBatchCallback cb)
 {
 	slave::callback dummycallback = boost::bind(&DBReader::DummyEventCallback, boost::ref(*this), _1);
 
@@ -50,10 +100,16 @@ void DBReader::DumpTables(std::string &binlog_name, BinlogPos &binlog_pos, Binlo
 	for (TableList::const_iterator i = tables.begin(); i != tables.end(); ++i) {
 		tempslave.setCallback(i->name.first, i->name.second, dummycallback);
 	}
+	for (DecimalFormatMap::const_iterator d = decimal_formats.begin(); d != decimal_formats.end(); ++d) {
+		SetDecimalFormats(tempslave, d->first, d->second);
+	}
 	
 	tempslave.init();
 	tempslave.createDatabaseStructure();
 
+	// the binlog is read from the position of the dump: its table structures are the right ones
+	slave.setSchema(tempslave.getSchema());
+
 	last_event_when = ::time(NULL);
 	
 	slave::Slave::binlog_pos_t bp = tempslave.getLastBinlog();
@@ -67,9 +123,14 @@ void DBReader::DumpTables(std::string &binlog_name, BinlogPos &binlog_pos, Binlo
 		masterinfo.password.c_str(), "", masterinfo.port);
 
 	conn.query("SET NAMES utf8");
+	// TIMESTAMP values come as UTC text, so that they agree with the binlog
+	conn.query("SET time_zone = '+00:00'");
+
+	row_batch.clear();
+
+	slave::RelayLogInfo rli = tempslave.getRli();
 
 	for (TableList::const_iterator t = tables.begin(); t != tables.end(); ++t) {
-		slave::RelayLogInfo rli = tempslave.getRli();
 		if (stopped) {
 			break;
 		}
@@ -78,12 +139,18 @@ void DBReader::DumpTables(std::string &binlog_name, BinlogPos &binlog_pos, Binlo
 		const boost::shared_ptr<slave::Table> rtable = rli.getTable(t->name);
 
 		std::map<std::string, std::pair<unsigned, slave::PtrField>> filtered_fields;
+		dump_epoch.clear();
 		for (std::vector<slave::PtrField>::const_iterator f = rtable->fields.begin(); f != rtable->fields.end(); ++f)  {
 			slave::PtrField field = *f;
 			const auto j = find(t->filter.begin(), t->filter.end(), field->getFieldName());
 			if (j != t->filter.end()) {
 				unsigned index = std::distance(t->filter.begin(), j);
 				filtered_fields[field->getFieldName()] = std::pair<unsigned, slave::PtrField>(index, field);
+
+				if (t->epoch_seconds) {
+					dump_epoch.resize(t->filter.size(), EPOCH_NONE);
+					dump_epoch[index] = EpochKind(field.get());
+				}
 			}
 		}
 
@@ -91,31 +158,44 @@ void DBReader::DumpTables(std::string &binlog_name, BinlogPos &binlog_pos, Binlo
 		conn.query(std::string("SELECT ") + boost::algorithm::join(t->filter, ",")  + " FROM " + t->name.second);
 		conn.use(boost::bind(&DBReader::DumpTablesCallback, boost::ref(*this), boost::ref(rli), boost::cref(t->name.first), boost::cref(t->name.second), 
 			boost::ref(conn), boost::ref(filtered_fields), _1, cb));
+
+		if (!stopped) {
+			FlushBatch(cb);
+		}
 	}
 
 	// send binlog position update event
 	if (!stopped) {
-		SerializableBinlogEvent ev;
-		ev.binlog_name = binlog_name;
-		ev.binlog_pos = binlog_pos;
-		ev.seconds_behind_master = GetSecondsBehindMaster();
-		ev.unix_timestamp = long(time(NULL));
-		ev.event = "IGNORE";
-		stopped = cb(ev);
+		SendPosition(binlog_name, binlog_pos, cb);
 	}
 
 	tempslave.close_connection();
 }
 
-void DBReader::ReadBinlog(const std::string &binlog_name, BinlogPos binlog_pos, BinlogEventCallback cb)
+void DBReader::ReadBinlog(const std::string &binlog_name, BinlogPos binlog_pos, BinlogBatchCallback cb)
 {
 	stopped = false;
 
-	slave::callback callback = boost::bind(&DBReader::EventCallback, boost::ref(*this), _1, cb);
+	binlog_cb = cb;
+	sent_binlog_name = binlog_name;
+	sent_binlog_pos = binlog_pos;
+	sent_ms = Milliseconds();
+	position_pending = false;
+
+	slave::batch_callback callback = boost::bind(&DBReader::EventCallback, boost::ref(*this), _1, cb);
 
 	state.setMasterLogNamePos(binlog_name, binlog_pos);
 	for (TableList::const_iterator t = tables.begin(); t != tables.end(); ++t) {
-		slave.setCallback(t->name.first, t->name.second, callback, t->filter);
+		slave.setBatchCallback(t->name.first, t->name.second, callback, t->filter);
+
+		// rows not passing the filter are dropped by libslave before they are fully decoded
+		FilterMap::const_iterator f = filters.find(t->name);
+		if (f != filters.end() && !f->second.Empty()) {
+			slave.setRowFilter(t->name.first, t->name.second, f->second.Columns(), boost::bind(&RowFilter::Pass, &f->second, _1));
+		}
+	}
+	for (DecimalFormatMap::const_iterator d = decimal_formats.begin(); d != decimal_formats.end(); ++d) {
+		SetDecimalFormats(slave, d->first, d->second);
 	}
 	slave.setXidCallback(boost::bind(&DBReader::XidEventCallback, boost::ref(*this), _1, cb));
 	slave.init();
@@ -130,86 +210,182 @@ void DBReader::Stop()
 	slave.close_connection();
 }
 
-void DBReader::EventCallback(const slave::RecordSet& event, BinlogEventCallback cb)
+void DBReader::EventCallback(const slave::RecordSetBatch& events, BinlogBatchCallback cb)
 {
-	last_event_when = event.when;
-	
-	SerializableBinlogEvent ev;
-	ev.binlog_name = state.getMasterLogName();
-	ev.binlog_pos = state.getMasterLogPos();
-	ev.seconds_behind_master = GetSecondsBehindMaster();
-	ev.unix_timestamp = long(time(NULL));
-	ev.event = "IGNORE";
+	if (events.empty()) {
+		return;
+	}
+
+	// all rows come from the same binlog event
+	last_event_when = events[events.size() - 1].when;
+
+	state.copyMasterLogName(master_log_name);
+	const unsigned long binlog_pos = state.getMasterLogPos();
+	const unsigned long seconds_behind_master = GetSecondsBehindMaster();
+	const long unix_timestamp = long(time(NULL));
+
+	row_batch.clear();
+
+	const std::vector<unsigned char> *epoch = epoch_tables.empty() ? NULL : EpochKinds(events[0]);
 
-	if (sfilter.PassEvent(event.db_name, event.tbl_name, event.m_row)) {
+	for (unsigned i = 0; i < events.size(); ++i) {
+		const slave::RecordSet &event = events[i];
+
+		// rows filtered out never get here, see ReadBinlog()
+		SerializableBinlogEvent &ev = row_batch.add();
+		ev.binlog_name = master_log_name;
+		ev.binlog_pos = binlog_pos;
+		ev.seconds_behind_master = seconds_behind_master;
+		ev.unix_timestamp = unix_timestamp;
 		ev.database = event.db_name;
 		ev.table = event.tbl_name;
 		switch (event.type_event) {
 			case slave::RecordSet::Update: ev.event = "UPDATE"; break;
 			case slave::RecordSet::Delete: ev.event = "DELETE"; break;
 			case slave::RecordSet::Write:  ev.event = "INSERT"; break;
-			default: break;
+			default: ev.event = "IGNORE"; break;
+		}
+		SlaveRowToSerializableRow(event.m_row, ev.row, epoch);
+		ev.present = event.m_present;
+
+		// a partial after image may lack the key, the writer takes it from the before image
+		if (event.partial() && event.type_event == slave::RecordSet::Update) {
+			SlaveRowToSerializableRow(event.m_old_row, ev.old_row, epoch);
+			ev.old_present = event.m_old_present;
+		} else {
+			ev.old_row.clear();
+			ev.old_present.clear();
 		}
-		ev.row = SlaveRowToSerializableRow(event.m_row);
 	}
-	else {
-		// TEST: do not pass filtered events to ZMQ/TPWriter, this will not update binlog position
-		return;
+
+	FlushBatch(cb);
+
+	// rows carry the position, nothing older needs to be sent
+	sent_binlog_name = master_log_name;
+	sent_binlog_pos = binlog_pos;
+	sent_ms = Milliseconds();
+	position_pending = false;
+}
+
+const std::vector<unsigned char> *DBReader::EpochKinds(const slave::RecordSet &event)
+{
+	EpochMap::iterator e = epoch_tables.find(std::make_pair(event.db_name, event.tbl_name));
+	if (e == epoch_tables.end() || !event.fields) {
+		return NULL;
 	}
 
-	stopped = cb(ev);
+	EpochColumns &columns = e->second;
+	if (columns.fields != event.fields) {
+		columns.fields = event.fields;
+		columns.kinds.resize(event.fields->size());
+		for (unsigned i = 0; i < columns.kinds.size(); ++i) {
+			columns.kinds[i] = EpochKind((*event.fields)[i].get());
+		}
+	}
+	return &columns.kinds;
 }
 
-void DBReader::XidEventCallback(unsigned int server_id, BinlogEventCallback cb)
+void DBReader::XidEventCallback(unsigned int server_id, BinlogBatchCallback cb)
 {
 	last_event_when = ::time(NULL);
-	
-	// send binlog position update event
-	SerializableBinlogEvent ev;
-	ev.binlog_name = state.getMasterLogName();
-	ev.binlog_pos = state.getMasterLogPos();
+
+	// position update is sent later if it's not far enough from the last one,
+	// so that filtered out transactions don't flood the pipeline
+	state.copyMasterLogName(pending_binlog_name);
+	pending_binlog_pos = state.getMasterLogPos();
+	position_pending = true;
+
+	FlushPosition();
+}
+
+void DBReader::SendPosition(const std::string &binlog_name, BinlogPos binlog_pos, BinlogBatchCallback cb)
+{
+	pos_batch.clear();
+
+	SerializableBinlogEvent &ev = pos_batch.add();
+	ev.binlog_name = binlog_name;
+	ev.binlog_pos = binlog_pos;
 	ev.seconds_behind_master = GetSecondsBehindMaster();
 	ev.unix_timestamp = long(time(NULL));
 	ev.event = "IGNORE";
-	stopped = cb(ev);
+	stopped = cb(pos_batch);
+
+	sent_binlog_name = binlog_name;
+	sent_binlog_pos = binlog_pos;
+	sent_ms = Milliseconds();
+	position_pending = false;
+}
+
+void DBReader::FlushPosition()
+{
+	if (!position_pending || stopped) {
+		return;
+	}
+
+	if (pending_binlog_name == sent_binlog_name &&
+		pending_binlog_pos < sent_binlog_pos + position_lag_bytes &&
+		Milliseconds() < sent_ms + position_lag_ms) {
+		return;
+	}
+
+	SendPosition(pending_binlog_name, pending_binlog_pos, binlog_cb);
+}
+
+void DBReader::FlushBatch(BinlogBatchCallback cb)
+{
+	if (!row_batch.empty()) {
+		stopped = cb(row_batch);
+		row_batch.clear();
+	}
 }
 
 bool DBReader::ReadBinlogCallback()
 {
+	// called before reading every event and on master heartbeats
+	FlushPosition();
 	return stopped != 0;
 }
 
 void DBReader::DumpTablesCallback(slave::RelayLogInfo &rli, const std::string &db_name, const std::string &tbl_name, 
-	nanomysql::Connection &conn, std::map<std::string, std::pair<unsigned, slave::PtrField>> &filter, const nanomysql::fields_t &f, BinlogEventCallback cb)
+	nanomysql::Connection &conn, std::map<std::string, std::pair<unsigned, slave::PtrField>> &filter, const nanomysql::fields_t &f, BinlogBatchCallback cb)
 {
-	SerializableBinlogEvent ev;
-	ev.binlog_name = "";
-	ev.binlog_pos = 0;
-	ev.database = db_name;
-	ev.table = tbl_name;
-	ev.event = "INSERT";
-	ev.seconds_behind_master = GetSecondsBehindMaster();
-	ev.unix_timestamp = long(time(NULL));
-	ev.row.resize(f.size());
+	if (stopped) {
+		conn.close();
+		return;
+	}
 
-	for (auto i = filter.begin(); i != filter.end(); ++i)  {
-		if (stopped) {
-			break;
-		}
+	dump_row.resize(f.size());
 
+	for (auto i = filter.begin(); i != filter.end(); ++i)  {
 		unsigned index = i->second.first;
 		slave::PtrField field = i->second.second;
 
 		std::map<std::string, nanomysql::field>::const_iterator z = f.find(field->getFieldName());
 		field->unpacka(z->second.data);
 
-		ev.row[index] = field->getFieldData();
+		dump_row[index].assign(field->getFieldData());
 	}
 
-	if (!stopped && sfilter.PassEvent(db_name, tbl_name, ev.row)) {
-		if (!stopped && cb(ev)) {
-			stopped = true;
-		}
+	FilterMap::const_iterator flt = filters.find(std::make_pair(db_name, tbl_name));
+	if (flt != filters.end() && !flt->second.Pass(dump_row)) {
+		return;
+	}
+
+	SerializableBinlogEvent &ev = row_batch.add();
+	ev.binlog_name = "";
+	ev.binlog_pos = 0;
+	ev.database = db_name;
+	ev.table = tbl_name;
+	ev.event = "INSERT";
+	ev.seconds_behind_master = GetSecondsBehindMaster();
+	ev.unix_timestamp = long(time(NULL));
+	SlaveRowToSerializableRow(dump_row, ev.row, dump_epoch.empty() ? NULL : &dump_epoch);
+	ev.present.clear();
+	ev.old_row.clear();
+	ev.old_present.clear();
+
+	if (!stopped && row_batch.size() >= DUMP_BATCH_SIZE) {
+		FlushBatch(cb);
 	}
 
 	if (stopped) {
@@ -217,6 +393,23 @@ void DBReader::DumpTablesCallback(slave::RelayLogInfo &rli, const std::string &d
 	}
 }
 
+void DBReader::GetRowCounters(slave::Slave::row_counters_t &counters) const
+{
+	slave.getRowCounters(counters);
+}
+
+void DBReader::GetPipelineStats(slave::PipelineStats &stats)
+{
+	slave.getPipelineStats(stats);
+}
+
+uint64_t DBReader::Milliseconds()
+{
+	struct timeval tp;
+	::gettimeofday(&tp, NULL);
+	return uint64_t(tp.tv_sec) * 1000 + tp.tv_usec / 1000;
+}
+
 unsigned DBReader::GetSecondsBehindMaster() const
 {
 	::time_t now = ::time(NULL);
@@ -1,9 +1,11 @@
 #ifndef REPLICATOR_DBREADER_H
 #define REPLICATOR_DBREADER_H
 
+#include <stdint.h>
 #include <vector>
 #include <string>
 #include <utility>
+#include <map>
 
 #include <boost/function.hpp>
 
@@ -12,12 +14,13 @@
 #include <nanomysql.h>
 
 #include "serializable.h"
-#include "simplefilter.h"
+#include "filter.h"
 
 namespace replicator {
 
 typedef unsigned long BinlogPos;
 typedef boost::function<bool (const SerializableBinlogEvent &ev)> BinlogEventCallback;
+typedef boost::function<bool (const SerializableBinlogEventBatch &batch)> BinlogBatchCallback;
 
 struct DBTable
 {
@@ -25,47 +28,100 @@ struct DBTable
 		{
 		};
 
-	DBTable(const std::string db_name, const std::string tbl_name, std::vector<std::string> filter) : 
-		name(db_name, tbl_name), filter(filter)
+	DBTable(const std::string db_name, const std::string tbl_name, std::vector<std::string> filter, bool epoch_seconds = false) : 
+		name(db_name, tbl_name), filter(filter), epoch_seconds(epoch_seconds)
 		{
 		};
 
 	std::pair<std::string, std::string> name;
 	std::vector<std::string> filter;
+	// DATE and DATETIME columns are sent as seconds since the epoch
+	bool epoch_seconds;
 };
 
 class DBReader
 {
 public:
-	DBReader (const std::string &host, const std::string &user, const std::string &password, unsigned int port = 3306, unsigned int connect_retry = 60);
+	// Binlog position updates are coalesced: the position sent down the pipeline
+	// lags the reader by at most position_lag_bytes or position_lag_ms.
+	// Without checksum_verify binlog event checksums are stripped, not checked.
+	DBReader (const std::string &host, const std::string &user, const std::string &password, unsigned int port = 3306, unsigned int connect_retry = 60,
+		unsigned position_lag_bytes = 0, unsigned position_lag_ms = 1000, bool checksum_verify = true);
 	~DBReader();
 
-	void AddTable(const std::string &db, const std::string &table, const std::vector<std::string> &columns);
-	void AddFilterPredicate(const std::string &db, const std::string &tbl, const SimplePredicate &pred);
-	void DumpTables(std::string &binlog_name, BinlogPos &binlog_pos, BinlogEventCallback f);
-	void ReadBinlog(const std::string &binlog_name, BinlogPos binlog_pos, BinlogEventCallback cb);
+	void AddTable(const std::string &db, const std::string &table, const std::vector<std::string> &columns, bool epoch_seconds = false);
+	void AddFilter(const std::string &db, const std::string &tbl, const FilterExpr &expr);
+	void AddDecimalFormat(const std::string &db, const std::string &tbl, const std::string &column, slave::Field_decimal::Format format);
+	void DumpTables(std::string &binlog_name, BinlogPos &binlog_pos, BinlogBatchCallback f);
+	void ReadBinlog(const std::string &binlog_name, BinlogPos binlog_pos, BinlogBatchCallback cb);
 	void Stop();
 
-	void EventCallback(const slave::RecordSet& event, BinlogEventCallback f);
+	void EventCallback(const slave::RecordSetBatch& events, BinlogBatchCallback f);
 	void DummyEventCallback(const slave::RecordSet& event) {};
 	bool ReadBinlogCallback();
-	void XidEventCallback(unsigned int server_id, BinlogEventCallback cb);
+	void XidEventCallback(unsigned int server_id, BinlogBatchCallback cb);
 	void DumpTablesCallback(slave::RelayLogInfo &rli, const std::string &db_name, const std::string &tbl_name, 
-		nanomysql::Connection &conn, std::map<std::string, std::pair<unsigned, slave::PtrField>> &filter, const nanomysql::fields_t &f, BinlogEventCallback cb);
+		nanomysql::Connection &conn, std::map<std::string, std::pair<unsigned, slave::PtrField>> &filter, const nanomysql::fields_t &f, BinlogBatchCallback cb);
 
 	unsigned GetSecondsBehindMaster() const;
+	void GetRowCounters(slave::Slave::row_counters_t &counters) const;
+	void GetPipelineStats(slave::PipelineStats &stats);
 
 private:
 	typedef std::vector<DBTable> TableList;
+	typedef std::map<std::pair<std::string, std::string>, RowFilter> FilterMap;
+	typedef std::map<std::pair<std::string, std::string>, std::map<std::string, slave::Field_decimal::Format>> DecimalFormatMap;
+
+	// Slots of the DATE and DATETIME columns of an epoch_seconds table, found
+	// again when the table gets a new structure
+	struct EpochColumns
+	{
+		EpochColumns() : fields(NULL) {}
+
+		const std::vector<slave::PtrField> *fields;
+		std::vector<unsigned char> kinds;
+	};
+	typedef std::map<std::pair<std::string, std::string>, EpochColumns> EpochMap;
+
+	// rows of a table dump are sent in batches of this size
+	static const unsigned DUMP_BATCH_SIZE = 256;
+
+	void SendPosition(const std::string &binlog_name, BinlogPos binlog_pos, BinlogBatchCallback cb);
+	void FlushPosition();
+	void FlushBatch(BinlogBatchCallback cb);
+
+	const std::vector<unsigned char> *EpochKinds(const slave::RecordSet &event);
+
+	static uint64_t Milliseconds();
 
 	slave::MasterInfo masterinfo;
 	slave::DefaultExtState state;
 	slave::Slave slave;
 	TableList tables;
-	SimpleFilter sfilter;
+	FilterMap filters;
+	DecimalFormatMap decimal_formats;
+	EpochMap epoch_tables;
 	bool stopped;
 
 	::time_t last_event_when;
+
+	// Reused between events so that their buffers keep capacity
+	SerializableBinlogEventBatch row_batch;
+	SerializableBinlogEventBatch pos_batch;
+	std::string master_log_name;
+	slave::RowBuffer dump_row;
+	std::vector<unsigned char> dump_epoch;
+
+	// Last position sent down the pipeline and the newer one not sent yet
+	unsigned position_lag_bytes;
+	unsigned position_lag_ms;
+	std::string sent_binlog_name;
+	BinlogPos sent_binlog_pos;
+	uint64_t sent_ms;
+	std::string pending_binlog_name;
+	BinlogPos pending_binlog_pos;
+	bool position_pending;
+	BinlogBatchCallback binlog_cb;
 };
 
  } // replicator
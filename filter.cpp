@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "filter.h"
+
+namespace replicator {
+
+// Integer view of a column value, strings are parsed like atoi() did
+static inline bool IntValue(const slave::FieldValue &v, int64_t &ival)
+{
+	switch (v.type) {
+		case slave::FieldValue::Int:       ival = v.i; return true;
+		case slave::FieldValue::UInt:      ival = v.u; return true;
+		case slave::FieldValue::ULongLong: ival = int64_t(v.ull); return true;
+		case slave::FieldValue::LongLong:  ival = v.ll; return true;
+		case slave::FieldValue::String:    ival = ::strtoll(v.s.c_str(), NULL, 10); return true;
+		default: return false;
+	}
+}
+
+void IntSet::Build(const std::vector<int64_t> &values)
+{
+	base = 0;
+	nbits = 0;
+	bits.clear();
+	hash.clear();
+
+	if (values.empty()) {
+		return;
+	}
+
+	const int64_t lo = *std::min_element(values.begin(), values.end());
+	const int64_t hi = *std::max_element(values.begin(), values.end());
+	const uint64_t span = uint64_t(hi) - uint64_t(lo) + 1;
+
+	// a bitmap is used while it's not bigger than the hash set would be
+	if (span != 0 && span / 64 <= values.size()) {
+		base = lo;
+		nbits = span;
+		bits.assign((span + 63) / 64, 0);
+		for (std::vector<int64_t>::const_iterator i = values.begin(); i != values.end(); ++i) {
+			const uint64_t off = uint64_t(*i) - uint64_t(base);
+			bits[off >> 6] |= uint64_t(1) << (off & 63);
+		}
+		return;
+	}
+
+	hash.rehash(values.size() * 2);
+	hash.insert(values.begin(), values.end());
+}
+
+// Integers: 64-bit finalizer of MurmurHash3, floating point values: the same
+// over the bits of the double, strings: FNV-1a
+uint64_t RowFilter::Hash(const slave::FieldValue &v)
+{
+	if (v.type == slave::FieldValue::String) {
+		uint64_t h = 14695981039346656037ULL;
+		for (std::string::const_iterator i = v.s.begin(); i != v.s.end(); ++i) {
+			h = (h ^ (unsigned char)*i) * 1099511628211ULL;
+		}
+		return h;
+	}
+
+	uint64_t h = 0;
+	if (v.type == slave::FieldValue::Float || v.type == slave::FieldValue::Double) {
+		// a float hashes as the same double, -0.0 as 0.0
+		double d = v.type == slave::FieldValue::Float ? v.f : v.d;
+		if (d == 0) {
+			d = 0;
+		}
+		::memcpy(&h, &d, sizeof(h));
+	} else {
+		int64_t ival = 0;
+		IntValue(v, ival);
+		h = uint64_t(ival);
+	}
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+void RowFilter::UseColumn(unsigned column)
+{
+	if (std::find(columns.begin(), columns.end(), column) == columns.end()) {
+		columns.push_back(column);
+	}
+}
+
+void RowFilter::Compile(const FilterExpr &expr)
+{
+	code.clear();
+	sets.clear();
+	ranges.clear();
+	mods.clear();
+	strings.clear();
+	columns.clear();
+
+	// default constructed expression: no filter
+	if (expr.op == FilterExpr::And && expr.args.empty()) {
+		return;
+	}
+
+	Emit(expr);
+}
+
+// The program keeps the value of the last evaluated subexpression in a single
+// flag; And/Or jump to their end as soon as the result is known.
+void RowFilter::Emit(const FilterExpr &expr)
+{
+	switch (expr.op) {
+		case FilterExpr::And:
+		case FilterExpr::Or: {
+			if (expr.args.empty()) {
+				throw std::runtime_error("filter: empty 'and'/'or' list");
+			}
+			std::vector<size_t> jumps;
+			for (size_t i = 0; i < expr.args.size(); ++i) {
+				Emit(expr.args[i]);
+				if (i + 1 < expr.args.size()) {
+					jumps.push_back(code.size());
+					code.push_back(Instr(expr.op == FilterExpr::And ? JumpIfFalse : JumpIfTrue, 0, 0));
+				}
+			}
+			for (size_t i = 0; i < jumps.size(); ++i) {
+				code[jumps[i]].arg = code.size();
+			}
+			break;
+		}
+		case FilterExpr::Not:
+			if (expr.args.size() != 1) {
+				throw std::runtime_error("filter: 'not' takes exactly one expression");
+			}
+			Emit(expr.args[0]);
+			code.push_back(Instr(Negate, 0, 0));
+			break;
+		case FilterExpr::In:
+			sets.push_back(IntSet());
+			sets.back().Build(expr.values);
+			code.push_back(Instr(InSet, expr.column, sets.size() - 1));
+			UseColumn(expr.column);
+			break;
+		case FilterExpr::Range:
+			ranges.push_back(std::make_pair(expr.lo, expr.hi));
+			code.push_back(Instr(InRange, expr.column, ranges.size() - 1));
+			UseColumn(expr.column);
+			break;
+		case FilterExpr::HashMod:
+			if (expr.mod == 0) {
+				throw std::runtime_error("filter: 'hash_mod' modulus must not be zero");
+			}
+			mods.push_back(std::make_pair(expr.mod, expr.rem));
+			code.push_back(Instr(HashModEq, expr.column, mods.size() - 1));
+			UseColumn(expr.column);
+			break;
+		case FilterExpr::StrEq:
+		case FilterExpr::StrPrefix:
+			strings.push_back(expr.str);
+			code.push_back(Instr(expr.op == FilterExpr::StrEq ? StrEqual : StrStartsWith, expr.column, strings.size() - 1));
+			UseColumn(expr.column);
+			break;
+	}
+}
+
+bool RowFilter::Pass(const slave::RowBuffer &row) const
+{
+	bool r = true;
+
+	for (size_t pc = 0, n = code.size(); pc < n; ) {
+		const Instr &in = code[pc++];
+		int64_t ival;
+
+		switch (in.code) {
+			case JumpIfFalse:
+				if (!r) pc = in.arg;
+				break;
+			case JumpIfTrue:
+				if (r) pc = in.arg;
+				break;
+			case Negate:
+				r = !r;
+				break;
+			case InSet:
+				r = IntValue(row[in.column], ival) && sets[in.arg].Contains(ival);
+				break;
+			case InRange:
+				r = IntValue(row[in.column], ival) && ival >= ranges[in.arg].first && ival <= ranges[in.arg].second;
+				break;
+			case HashModEq:
+				r = !row[in.column].isNull() && Hash(row[in.column]) % mods[in.arg].first == mods[in.arg].second;
+				break;
+			case StrEqual:
+				r = row[in.column].type == slave::FieldValue::String && row[in.column].s == strings[in.arg];
+				break;
+			case StrStartsWith: {
+				const slave::FieldValue &v = row[in.column];
+				const std::string &p = strings[in.arg];
+				r = v.type == slave::FieldValue::String && v.s.size() >= p.size() && ::memcmp(v.s.data(), p.data(), p.size()) == 0;
+				break;
+			}
+		}
+	}
+
+	return r;
+}
+
+} // replicator
@@ -0,0 +1,109 @@
+#ifndef REPLICATOR_FILTER_H
+#define REPLICATOR_FILTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+#include <fieldvalue.h>
+
+namespace replicator {
+
+// Filter expression as written in the "filter" setting of a mapping.
+// Columns are indexes in the mapping "columns" list.
+struct FilterExpr
+{
+	enum Op {
+		And,		// all of args
+		Or,			// any of args
+		Not,		// args[0] is false
+		In,			// column value is one of values
+		Range,		// lo <= column value <= hi
+		HashMod,	// hash(column value) % mod == rem
+		StrEq,		// column value equals str
+		StrPrefix	// column value starts with str
+	};
+
+	FilterExpr(Op op = And) : op(op), column(0), lo(0), hi(0), mod(1), rem(0) {}
+
+	Op op;
+	unsigned column;
+	std::vector<int64_t> values;
+	int64_t lo, hi;
+	uint64_t mod, rem;
+	std::string str;
+	std::vector<FilterExpr> args;
+};
+
+// Set of integers for In: a bitmap when the values are dense, a hash set otherwise
+class IntSet
+{
+public:
+	IntSet() : base(0), nbits(0) {}
+
+	void Build(const std::vector<int64_t> &values);
+
+	bool Contains(int64_t v) const
+	{
+		if (nbits) {
+			const uint64_t off = uint64_t(v) - uint64_t(base);
+			return off < nbits && ((bits[off >> 6] >> (off & 63)) & 1);
+		}
+		return hash.find(v) != hash.end();
+	}
+
+	bool IsBitmap() const { return nbits != 0; }
+
+private:
+	int64_t base;
+	uint64_t nbits;
+	std::vector<uint64_t> bits;
+	std::unordered_set<int64_t> hash;
+};
+
+// FilterExpr compiled into a flat program evaluated on decoded rows.
+// An empty filter passes everything.
+class RowFilter
+{
+public:
+	RowFilter() {}
+	explicit RowFilter(const FilterExpr &expr) { Compile(expr); }
+
+	void Compile(const FilterExpr &expr);
+
+	bool Pass(const slave::RowBuffer &row) const;
+
+	bool Empty() const { return code.empty(); }
+
+	// Columns the filter reads
+	const std::vector<unsigned> & Columns() const { return columns; }
+
+	static uint64_t Hash(const slave::FieldValue &v);
+
+private:
+	enum Code { JumpIfFalse, JumpIfTrue, Negate, InSet, InRange, HashModEq, StrEqual, StrStartsWith };
+
+	struct Instr
+	{
+		Instr(Code code, unsigned column, unsigned arg) : code(code), column(column), arg(arg) {}
+
+		Code code;
+		unsigned column;
+		unsigned arg;	// jump target or index of the operand
+	};
+
+	void Emit(const FilterExpr &expr);
+	void UseColumn(unsigned column);
+
+	std::vector<Instr> code;
+	std::vector<IntSet> sets;
+	std::vector<std::pair<int64_t, int64_t> > ranges;
+	std::vector<std::pair<uint64_t, uint64_t> > mods;
+	std::vector<std::string> strings;
+	std::vector<unsigned> columns;
+};
+
+} // replicator
+
+#endif // REPLICATOR_FILTER_H
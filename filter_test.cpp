@@ -0,0 +1,220 @@
+// Checks which rows the mapping row filter passes: in, range, hash_mod, eq
+// and prefix, and/or/not, NULL values, and expressions Compile() rejects.
+// The expressions are built the way parse_filter() in main.cpp builds them.
+
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "filter.h"
+
+using namespace replicator;
+
+static bool report(bool ok, const std::string &what)
+{
+	printf("%s%s\n", ok ? "OK   " : "FAIL ", what.c_str());
+	return ok;
+}
+
+static FilterExpr in(unsigned column, const std::vector<int64_t> &values)
+{
+	FilterExpr e(FilterExpr::In);
+	e.column = column;
+	e.values = values;
+	return e;
+}
+
+static FilterExpr range(unsigned column, int64_t lo, int64_t hi)
+{
+	FilterExpr e(FilterExpr::Range);
+	e.column = column;
+	e.lo = lo;
+	e.hi = hi;
+	return e;
+}
+
+static FilterExpr hash_mod(unsigned column, uint64_t mod, uint64_t rem)
+{
+	FilterExpr e(FilterExpr::HashMod);
+	e.column = column;
+	e.mod = mod;
+	e.rem = rem;
+	return e;
+}
+
+static FilterExpr str(FilterExpr::Op op, unsigned column, const std::string &s)
+{
+	FilterExpr e(op);
+	e.column = column;
+	e.str = s;
+	return e;
+}
+
+static FilterExpr node(FilterExpr::Op op, const FilterExpr &a, const FilterExpr &b = FilterExpr())
+{
+	FilterExpr e(op);
+	e.args.push_back(a);
+	if (op != FilterExpr::Not) {
+		e.args.push_back(b);
+	}
+	return e;
+}
+
+// rows: (id int unsigned, name varchar, price double)
+static slave::RowBuffer row(uint32_t id, const char *name, double price)
+{
+	slave::RowBuffer r(3);
+	r[0].setUInt(id);
+	if (name) {
+		r[1].setString(name, ::strlen(name));
+	}
+	r[2].setDouble(price);
+	return r;
+}
+
+// Ids in 0..20 of the rows the filter passes, as "1 5 7"
+static std::string passed(const RowFilter &filter)
+{
+	std::string s;
+	for (uint32_t id = 0; id < 20; ++id) {
+		const std::string name = (id % 3 ? "item-" : "test-") + std::to_string(id);
+		if (filter.Pass(row(id, name.c_str(), id * 1.5))) {
+			s += (s.empty() ? "" : " ") + std::to_string(id);
+		}
+	}
+	return s;
+}
+
+static bool check_leaves()
+{
+	bool ok = true;
+
+	ok = report(passed(RowFilter()) == "0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19", "empty filter passes all") && ok;
+	ok = report(passed(RowFilter(in(0, {3, 5, 7}))) == "3 5 7", "in, dense values (bitmap)") && ok;
+	ok = report(passed(RowFilter(in(0, {1, 1000000000000LL, 19}))) == "1 19", "in, sparse values (hash set)") && ok;
+	ok = report(passed(RowFilter(in(0, {4}))) == "4", "eq number") && ok;
+	ok = report(passed(RowFilter(range(0, 5, 8))) == "5 6 7 8", "range takes both ends") && ok;
+	ok = report(passed(RowFilter(str(FilterExpr::StrEq, 1, "item-4"))) == "4", "eq string") && ok;
+	ok = report(passed(RowFilter(str(FilterExpr::StrPrefix, 1, "test-"))) == "0 3 6 9 12 15 18", "prefix") && ok;
+	ok = report(passed(RowFilter(str(FilterExpr::StrEq, 0, "4"))) == "", "eq string on a number column") && ok;
+
+	// a string column holding a number is read like atoi() did
+	{
+		slave::RowBuffer r = row(0, "42", 0);
+		ok = report(RowFilter(in(1, {42})).Pass(r) && !RowFilter(in(1, {4})).Pass(r), "in on a string column") && ok;
+	}
+
+	return ok;
+}
+
+static bool check_hash_mod()
+{
+	bool ok = true;
+
+	// every row is in exactly one bucket, the one Hash() gives
+	std::vector<unsigned> ids(4, 0), prices(4, 0);
+	bool one_bucket = true;
+	for (uint32_t id = 0; id < 1000; ++id) {
+		const slave::RowBuffer r = row(id, "x", id * 1.5 + 0.25);
+		unsigned id_hits = 0, price_hits = 0;
+		for (unsigned rem = 0; rem < 4; ++rem) {
+			if (RowFilter(hash_mod(0, 4, rem)).Pass(r)) {
+				++ids[rem];
+				++id_hits;
+				one_bucket = one_bucket && RowFilter::Hash(r[0]) % 4 == rem;
+			}
+			if (RowFilter(hash_mod(2, 4, rem)).Pass(r)) {
+				++prices[rem];
+				++price_hits;
+			}
+		}
+		one_bucket = one_bucket && id_hits == 1 && price_hits == 1;
+	}
+	ok = report(one_bucket, "hash_mod puts each row in one bucket") && ok;
+
+	bool spread = true;
+	for (unsigned rem = 0; rem < 4; ++rem) {
+		spread = spread && ids[rem] > 150 && prices[rem] > 150;
+	}
+	ok = report(spread, "hash_mod spreads integer and double values") && ok;
+
+	// the same number in a float and a double column, 0.0 and -0.0
+	{
+		slave::FieldValue f, d, zero, negzero;
+		f.setFloat(2.5f);
+		d.setDouble(2.5);
+		zero.setDouble(0.0);
+		negzero.setDouble(-0.0);
+		ok = report(RowFilter::Hash(f) == RowFilter::Hash(d) && RowFilter::Hash(zero) == RowFilter::Hash(negzero) &&
+			RowFilter::Hash(d) != RowFilter::Hash(zero), "float and double hash alike") && ok;
+	}
+
+	return ok;
+}
+
+static bool check_logic()
+{
+	bool ok = true;
+
+	const FilterExpr low = range(0, 0, 9);
+	const FilterExpr test = str(FilterExpr::StrPrefix, 1, "test-");
+
+	ok = report(passed(RowFilter(node(FilterExpr::And, low, test))) == "0 3 6 9", "and") && ok;
+	ok = report(passed(RowFilter(node(FilterExpr::Or, in(0, {1, 2}), test))) == "0 1 2 3 6 9 12 15 18", "or") && ok;
+	ok = report(passed(RowFilter(node(FilterExpr::Not, low))) == "10 11 12 13 14 15 16 17 18 19", "not") && ok;
+	ok = report(passed(RowFilter(node(FilterExpr::Or, node(FilterExpr::And, low, node(FilterExpr::Not, test)),
+		in(0, {18, 19})))) == "1 2 4 5 7 8 18 19", "nested and/or/not") && ok;
+
+	return ok;
+}
+
+// NULL is in no set, range or bucket and equals no string; 'not' turns that around
+static bool check_null()
+{
+	slave::RowBuffer r = row(5, NULL, 0);
+	r[0].setNull();
+
+	bool ok = !RowFilter(in(0, {0})).Pass(r) && !RowFilter(range(0, 0, 10)).Pass(r);
+	for (unsigned rem = 0; rem < 4; ++rem) {
+		ok = ok && !RowFilter(hash_mod(0, 4, rem)).Pass(r);
+	}
+	ok = ok && !RowFilter(str(FilterExpr::StrEq, 1, "")).Pass(r) && !RowFilter(str(FilterExpr::StrPrefix, 1, "")).Pass(r);
+	ok = ok && RowFilter(node(FilterExpr::Not, in(0, {0}))).Pass(r);
+
+	return report(ok, "NULL values");
+}
+
+static bool rejected(const FilterExpr &expr)
+{
+	try {
+		RowFilter filter(expr);
+	} catch (const std::runtime_error &) {
+		return true;
+	}
+	return false;
+}
+
+static bool check_rejected()
+{
+	FilterExpr empty_or(FilterExpr::Or);
+	FilterExpr two_not(FilterExpr::Not);
+	two_not.args.push_back(in(0, {1}));
+	two_not.args.push_back(in(0, {2}));
+
+	return report(rejected(empty_or) && rejected(two_not) && rejected(hash_mod(0, 0, 0)),
+		"empty or, not of two, hash_mod by zero are rejected");
+}
+
+int main()
+{
+	bool ok = true;
+	ok = check_leaves() && ok;
+	ok = check_hash_mod() && ok;
+	ok = check_logic() && ok;
+	ok = check_null() && ok;
+	ok = check_rejected() && ok;
+
+	return ok ? 0 : 1;
+}
@@ -3,101 +3,252 @@
 
 #include "SlaveStats.h"
 
-#include <boost/thread/mutex.hpp>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
 
 namespace slave
 {
-class DefaultExtState: public ExtStateIface, protected State {
-    boost::mutex m_mutex;
 
+// Lock-free state: the per event and per row calls are a few uncontended
+// atomic operations. The binlog position (log name, positions and event
+// times) is written under a seqlock, readers retry until they get a
+// snapshot no writer was inside of. Row counters of the first MAX_TABLES
+// tables are indexed by getTableCountId(), others go through a mutex.
+class DefaultExtState: public ExtStateIface {
 public:
+    static const unsigned int MAX_TABLES = 1024;
+    // Longer log names are cut, MySQL's own limit is FN_REFLEN (512)
+    static const unsigned int LOG_NAME_MAX = 512;
+
+    DefaultExtState() :
+        m_connect_time(0), m_last_filtered_update(0), m_connect_count(0), m_state_processing(false),
+        m_seq(0), m_log_name_len(0), m_master_log_pos(0), m_intransaction_pos(0), m_last_event_time(0), m_last_update(0)
+    {
+        for (unsigned int i = 0; i < MAX_TABLES; ++i) {
+            m_table_rows[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
     virtual State getState()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        return *this;
+        State s;
+        s.connect_time = m_connect_time.load(std::memory_order_relaxed);
+        s.last_filtered_update = m_last_filtered_update.load(std::memory_order_relaxed);
+        s.connect_count = m_connect_count.load(std::memory_order_relaxed);
+        s.state_processing = m_state_processing.load(std::memory_order_relaxed);
+
+        Position p;
+        readPosition(&s.master_log_name, p);
+        s.master_log_pos = p.master_log_pos;
+        s.intransaction_pos = p.intransaction_pos;
+        s.last_event_time = p.last_event_time;
+        s.last_update = p.last_update;
+        return s;
     }
     virtual void setConnecting()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        connect_time = ::time(NULL);
-        ++connect_count;
+        m_connect_time.store(::time(NULL), std::memory_order_relaxed);
+        m_connect_count.fetch_add(1, std::memory_order_relaxed);
     }
     virtual time_t getConnectTime()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        return connect_time;
+        return m_connect_time.load(std::memory_order_relaxed);
     }
     virtual void setLastFilteredUpdateTime()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        last_filtered_update = ::time(NULL);
+        m_last_filtered_update.store(::time(NULL), std::memory_order_relaxed);
     }
     virtual time_t getLastFilteredUpdateTime()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        return last_filtered_update;
+        return m_last_filtered_update.load(std::memory_order_relaxed);
     }
     virtual void setLastEventTimePos(time_t t, unsigned long pos)
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        last_event_time = t; intransaction_pos = pos; last_update = ::time(NULL);
+        const unsigned long seq = beginWrite();
+        m_last_event_time.store(t, std::memory_order_relaxed);
+        m_intransaction_pos.store(pos, std::memory_order_relaxed);
+        m_last_update.store(::time(NULL), std::memory_order_relaxed);
+        endWrite(seq);
     }
     virtual time_t getLastUpdateTime()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        return last_update;
+        Position p;
+        readPosition(NULL, p);
+        return p.last_update;
     }
     virtual time_t getLastEventTime()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        return last_event_time;
+        Position p;
+        readPosition(NULL, p);
+        return p.last_event_time;
     }
     virtual unsigned long getIntransactionPos()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        return intransaction_pos;
+        Position p;
+        readPosition(NULL, p);
+        return p.intransaction_pos;
     }
     virtual void setMasterLogNamePos(const std::string& log_name, unsigned long pos)
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        master_log_name = log_name; master_log_pos = pos;
-        intransaction_pos = pos;
+        const unsigned int len = log_name.size() < LOG_NAME_MAX ? unsigned(log_name.size()) : unsigned(LOG_NAME_MAX);
+
+        const unsigned long seq = beginWrite();
+        for (unsigned int i = 0; i < len; ++i) {
+            m_log_name[i].store(log_name[i], std::memory_order_relaxed);
+        }
+        m_log_name_len.store(len, std::memory_order_relaxed);
+        m_master_log_pos.store(pos, std::memory_order_relaxed);
+        m_intransaction_pos.store(pos, std::memory_order_relaxed);
+        endWrite(seq);
     }
     virtual unsigned long getMasterLogPos()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        return master_log_pos;
+        Position p;
+        readPosition(NULL, p);
+        return p.master_log_pos;
     }
     virtual std::string getMasterLogName()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        return master_log_name;
+        std::string name;
+        copyMasterLogName(name);
+        return name;
+    }
+    virtual void copyMasterLogName(std::string& name)
+    {
+        Position p;
+        readPosition(&name, p);
     }
     virtual void saveMasterInfo() {}
     virtual bool loadMasterInfo(std::string& logname, unsigned long& pos)
     {
-        boost::mutex::scoped_lock lock(m_mutex);
         logname.clear();
         pos = 0;
         return false;
     }
     virtual unsigned int getConnectCount()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        return connect_count;
+        return m_connect_count.load(std::memory_order_relaxed);
     }
     virtual void setStateProcessing(bool _state)
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        state_processing = _state;
+        m_state_processing.store(_state, std::memory_order_relaxed);
     }
     virtual bool getStateProcessing()
     {
-        boost::mutex::scoped_lock lock(m_mutex);
-        return state_processing;
+        return m_state_processing.load(std::memory_order_relaxed);
+    }
+    virtual void initTableCount(const std::string& t)
+    {
+        getTableCountId(t);
+    }
+    virtual void incTableCount(const std::string& t)
+    {
+        addTableCount(getTableCountId(t), t, 1);
+    }
+    virtual unsigned int getTableCountId(const std::string& t)
+    {
+        std::lock_guard<std::mutex> lock(m_tables_mutex);
+        std::map<std::string, unsigned int>::const_iterator i = m_table_ids.find(t);
+        if (i != m_table_ids.end()) {
+            return i->second;
+        }
+        const unsigned int id = m_table_ids.size() < MAX_TABLES ? unsigned(m_table_ids.size()) : unsigned(NO_TABLE_COUNT_ID);
+        if (id != NO_TABLE_COUNT_ID) {
+            m_table_ids[t] = id;
+        }
+        return id;
+    }
+    virtual void addTableCount(unsigned int id, const std::string& t, unsigned int n)
+    {
+        if (id < MAX_TABLES) {
+            m_table_rows[id].fetch_add(n, std::memory_order_relaxed);
+        } else {
+            std::lock_guard<std::mutex> lock(m_tables_mutex);
+            m_table_rows_more[t] += n;
+        }
+    }
+
+    // Rows passed to callbacks, by table
+    void getTableCounts(std::map<std::string, unsigned long>& counts)
+    {
+        std::lock_guard<std::mutex> lock(m_tables_mutex);
+        counts = m_table_rows_more;
+        for (std::map<std::string, unsigned int>::const_iterator i = m_table_ids.begin(); i != m_table_ids.end(); ++i) {
+            counts[i->first] = m_table_rows[i->second].load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Position
+    {
+        unsigned long master_log_pos;
+        unsigned long intransaction_pos;
+        time_t last_event_time;
+        time_t last_update;
+    };
+
+    std::atomic<time_t> m_connect_time;
+    std::atomic<time_t> m_last_filtered_update;
+    std::atomic<unsigned int> m_connect_count;
+    std::atomic<bool> m_state_processing;
+
+    // Odd while a writer is inside; writers take turns with a CAS on it
+    std::atomic<unsigned long> m_seq;
+    std::atomic<char> m_log_name[LOG_NAME_MAX];
+    std::atomic<unsigned int> m_log_name_len;
+    std::atomic<unsigned long> m_master_log_pos;
+    std::atomic<unsigned long> m_intransaction_pos;
+    std::atomic<time_t> m_last_event_time;
+    std::atomic<time_t> m_last_update;
+
+    std::atomic<unsigned long> m_table_rows[MAX_TABLES];
+    std::mutex m_tables_mutex;
+    std::map<std::string, unsigned int> m_table_ids;
+    std::map<std::string, unsigned long> m_table_rows_more;
+
+    unsigned long beginWrite()
+    {
+        unsigned long seq = m_seq.load(std::memory_order_relaxed);
+        while ((seq & 1) || !m_seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            seq = m_seq.load(std::memory_order_relaxed);
+        }
+        // the odd sequence is seen before any of the stores that follow
+        std::atomic_thread_fence(std::memory_order_release);
+        return seq + 1;
+    }
+
+    void endWrite(unsigned long seq)
+    {
+        m_seq.store(seq + 1, std::memory_order_release);
+    }
+
+    // The log name goes to 'name' unless it is NULL
+    void readPosition(std::string* name, Position& p)
+    {
+        unsigned long seq;
+        do {
+            seq = m_seq.load(std::memory_order_acquire);
+            if (seq & 1) {
+                continue;
+            }
+
+            if (name) {
+                const unsigned int len = m_log_name_len.load(std::memory_order_relaxed);
+                name->resize(len < LOG_NAME_MAX ? len : unsigned(LOG_NAME_MAX));
+                for (unsigned int i = 0; i < name->size(); ++i) {
+                    (*name)[i] = m_log_name[i].load(std::memory_order_relaxed);
+                }
+            }
+            p.master_log_pos = m_master_log_pos.load(std::memory_order_relaxed);
+            p.intransaction_pos = m_intransaction_pos.load(std::memory_order_relaxed);
+            p.last_event_time = m_last_event_time.load(std::memory_order_relaxed);
+            p.last_update = m_last_update.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || m_seq.load(std::memory_order_relaxed) != seq);
     }
-    virtual void initTableCount(const std::string& t) {}
-    virtual void incTableCount(const std::string& t) {}
 };
 
 }// slave
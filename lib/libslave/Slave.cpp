@@ -13,6 +13,9 @@
 */
 
 
+#include <stdio.h>
+#include <strings.h>
+#include <sstream>
 
 #include "Slave.h"
 #include "SlaveStats.h"
@@ -21,9 +24,10 @@
 
 #include "nanomysql.h"
 
+#include <boost/algorithm/string/join.hpp>
+
 #include <mysql/my_global.h>
 #include <mysql/m_ctype.h>
-#include <mysql/sql_common.h>
 
 #define packet_end_data 1
 
@@ -31,41 +35,6 @@
 #define ER_MASTER_FATAL_ERROR_READING_BINLOG 1236
 #define BIN_LOG_HEADER_SIZE 4
 
-namespace
-{
-
-class RethrowableException : public std::runtime_error
-{
-public:
-    RethrowableException(const std::string& msg):std::runtime_error(msg){};
-};
-
-}
-
-namespace
-{
-unsigned char *net_store_length_fast(unsigned char *pkg, unsigned int length)
-{
-    unsigned char *packet=(unsigned char*) pkg;
-    if (length < 251)
-    {
-        *packet=(unsigned char) length;
-        return packet+1;
-    }
-    *packet++=252;
-    int2store(packet,(unsigned int) length);
-    return packet+2;
-}
-
-unsigned char *net_store_data(unsigned char *to, const unsigned char *from, unsigned int length)
-{
-    to = net_store_length_fast(to,length);
-    ::memcpy(to,from,length);
-    return to+length;
-}
-}// anonymous-namespace
-
-
 using namespace slave;
 
 
@@ -86,72 +55,273 @@ void Slave::init()
 
 void Slave::close_connection()
 {
-    ::shutdown(mysql.net.fd, SHUT_RDWR);
-    ::close(mysql.net.fd);
+    m_client.cancel();
 }
 
 
-void Slave::createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli) const
+void Slave::createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli)
 {
     LOG_TRACE(log, "enter: createDatabaseStructure");
 
-    nanomysql::Connection conn(m_master_info.host.c_str(), m_master_info.user.c_str(),
-                               m_master_info.password.c_str(), "", m_master_info.port);
-    const collate_map_t collate_map = readCollateMap(conn);
+    const unsigned long long start = now_us();
 
+    // Tables described by the Slave setSchema() took them from are not read again
+    table_order_t missing;
+    for (table_order_t::const_iterator it = tabs.begin(); it != tabs.end(); ++ it) {
+        Schema::tables_t::const_iterator t = m_schema.tables.find(*it);
+        if (!m_schema_shared || t == m_schema.tables.end() || t->second.empty()) {
+            missing.push_back(*it);
+        }
+    }
+    m_schema_shared = false;
+
+    if (!missing.empty() || m_schema.collations.empty()) {
+        m_meta.run(boost::bind(&Slave::readSchema, this, boost::cref(missing), _1));
+    }
 
     for (table_order_t::const_iterator it = tabs.begin(); it != tabs.end(); ++ it) {
 
-        LOG_INFO( log, "Creating database structure for: " << it->first << ", Creating table for: " << it->second );
-        createTable(rli, it->first, it->second, collate_map, conn);
+        LOG_DEBUG( log, "Creating database structure for: " << it->first << ", Creating table for: " << it->second );
+        rli.setTable(it->second, it->first, buildTable(it->first, it->second, m_schema.tables[*it]));
     }
 
+    // LOG_INFO is compiled out; LOG_WARNING goes to std::cout, the replicator's info level
+    LOG_WARNING(log, "Created database structure of " << tabs.size() << " tables (" << missing.size()
+             << " read from the master) in " << (now_us() - start) / 1000 << " ms");
+
     LOG_TRACE(log, "exit: createDatabaseStructure");
 }
 
 
+void Slave::configureTable(const std::pair<std::string, std::string>& key, Table& table)
+{
+    table.m_callback = m_callbacks[key];
+    table.m_batch_callback = m_batch_callbacks[key];
+    row_filters_t::const_iterator f = m_row_filters.find(key);
+    if (f != m_row_filters.end()) {
+        table.set_row_filter(f->second.first, f->second.second);
+    }
+    table.set_callback_filter(m_callback_filters[key]);
+    table.count_id = ext_state.getTableCountId(table.full_name);
+
+    decimal_formats_t::const_iterator d = m_decimal_formats.find(key);
+    if (d != m_decimal_formats.end()) {
+        for (std::vector<PtrField>::const_iterator i = table.fields.begin(); i != table.fields.end(); ++i) {
+            Field_decimal* field = dynamic_cast<Field_decimal*>(i->get());
+            std::map<std::string, Field_decimal::Format>::const_iterator f;
+            if (field && (f = d->second.find(field->getFieldName())) != d->second.end()) {
+                field->set_format(f->second);
+            }
+        }
+    }
+
+    // After the decimal formats: defaults are read in them
+    const std::vector<ColumnDesc>& columns = m_schema.tables[key];
+    for (unsigned i = 0; i < columns.size(); ++i) {
+        table.set_default(i, columns[i].column_default);
+    }
+}
+
+
+void Slave::markTables(const std::vector<DdlTable>& tables)
+{
+    // In statement order: RENAME TABLE t TO t_old, t_new TO t forgets t and marks it again
+    for (std::vector<DdlTable>::const_iterator t = tables.begin(); t != tables.end(); ++t) {
+
+        const std::pair<std::string, std::string> key(t->db, t->table);
+
+        if (m_callbacks.find(key) == m_callbacks.end()) {
+            continue;
+        }
+
+        if (t->gone) {
+            LOG_INFO(log, "Table " << t->db << "." << t->table << " is gone");
+            m_rli.m_table_map.erase(key);
+            m_stale_tables.erase(key);
+        } else {
+            LOG_INFO(log, "Table " << t->db << "." << t->table << " changed, its structure is read at its next table map");
+            m_stale_tables.insert(key);
+        }
+    }
+}
+
+
+void Slave::mapTable(const Table_map_event_info& tmi, RelayLogInfo& rli)
+{
+    const std::pair<std::string, std::string> key(tmi.m_dbnam, tmi.m_tblnam);
+
+    if (m_callbacks.find(key) == m_callbacks.end()) {
+        rli.setTableVersion(tmi.m_table_id, PtrTable());
+        return;
+    }
+
+    PtrTable table = rli.getTable(key);
+
+    if (!table || m_stale_tables.count(key) || !table->decoder.matches(tmi.m_column_types, tmi.m_column_meta)) {
+
+        // The binlog stream stands still meanwhile
+        const unsigned long long start = now_us();
+
+        PtrTable fresh;
+        try {
+            const table_order_t tabs(1, key);
+            m_meta.run(boost::bind(&Slave::readSchema, this, boost::cref(tabs), _1));
+            fresh = buildTable(key.first, key.second, m_schema.tables[key]);
+            configureTable(key, *fresh);
+        } catch (const std::runtime_error& e) {
+            LOG_ERROR(log, "Could not read structure of " << key.first << "." << key.second << ": " << e.what());
+        }
+
+        const unsigned long long stall_us = now_us() - start;
+        m_packets.add_schema_refresh(stall_us);
+
+        if (fresh && fresh->decoder.matches(tmi.m_column_types, tmi.m_column_meta)) {
+
+            LOG_INFO(log, "Structure of " << fresh->full_name << " read in " << stall_us / 1000 << " ms");
+            if (table) {
+                fresh->rows_decoded = table->rows_decoded;
+                fresh->rows_skipped = table->rows_skipped;
+            }
+            rli.setTable(key.second, key.first, fresh);
+            m_stale_tables.erase(key);
+            table = fresh;
+
+        } else if (table && table->decoder.matches(tmi.m_column_types, tmi.m_column_meta)) {
+
+            // We are behind the master, and the table has changed there again since
+            LOG_WARNING(log, "Structure of " << table->full_name << " on the master does not match table map "
+                        << tmi.m_table_id << ", the previous one is kept");
+
+        } else {
+            // Skipping the rows would lose them, the reader is restarted instead
+            std::ostringstream msg;
+            msg << "Structure of " << key.first << "." << key.second << " does not match table map " << tmi.m_table_id;
+            LOG_ERROR(log, msg.str());
+            throw Table_map_error(msg.str());
+        }
+    }
+
+    rli.setTableVersion(tmi.m_table_id, table);
+}
+
+
+
+namespace
+{
+std::string quote(const std::string& s)
+{
+    std::string out("'");
+    for (std::string::const_iterator c = s.begin(); c != s.end(); ++c) {
+        if (*c == '\'' || *c == '\\')
+            out += '\\';
+        out += *c;
+    }
+    return out + "'";
+}
+
+const nanomysql::field& column_field(const nanomysql::fields_t& row, const char* name)
+{
+    nanomysql::fields_t::const_iterator z = row.find(name);
+
+    if (z == row.end())
+        throw std::runtime_error(std::string("Slave::readSchema(): information_schema query did not return '") + name + "'");
+
+    return z->second;
+}
+
+const std::string& column(const nanomysql::fields_t& row, const char* name)
+{
+    return column_field(row, name).data;
+}
+
+// What a column an insert does not set gets on the master. A NOT NULL column
+// without DEFAULT has to be set. Expression defaults (CURRENT_TIMESTAMP,
+// DEFAULT (expr) of MySQL 8.0) are evaluated by the master, they are not
+// known here.
+ColumnDefault column_default(const nanomysql::fields_t& row)
+{
+    const nanomysql::field& def = column_field(row, "def");
+
+    if (def.is_null)
+        return ColumnDefault(column(row, "nullable") == "YES" ? ColumnDefault::Null : ColumnDefault::None);
+
+    if (column(row, "extra").find("DEFAULT_GENERATED") != std::string::npos ||
+        ::strncasecmp(def.data.c_str(), "CURRENT_TIMESTAMP", 17) == 0)
+        return ColumnDefault();
+
+    return ColumnDefault(ColumnDefault::Value, def.data);
+}
+}// anonymous-namespace
 
-void Slave::createTable(RelayLogInfo& rli,
-                        const std::string& db_name, const std::string& tbl_name,
-                        const collate_map_t& collate_map, nanomysql::Connection& conn) const
+
+void Slave::readSchema(const table_order_t& tabs, nanomysql::Connection& conn)
 {
-    LOG_TRACE(log, "enter: createTable " << db_name << " " << tbl_name);
+    LOG_TRACE(log, "enter: readSchema " << tabs.size() << " tables");
+
+    // One query for all the tables instead of a SHOW FULL COLUMNS for each
+    std::set<std::string> dbs, names;
+    std::set<std::pair<std::string, std::string> > wanted;
+
+    for (table_order_t::const_iterator it = tabs.begin(); it != tabs.end(); ++it) {
+        dbs.insert(quote(it->first));
+        names.insert(quote(it->second));
+        wanted.insert(*it);
+        m_schema.tables[*it].clear();
+    }
+
+    // Read once: collations do not change under a running server
+    if (m_schema.collations.empty())
+        m_schema.collations = readCollateMap(conn);
+
+    if (wanted.empty())
+        return;
 
     nanomysql::Connection::result_t res;
 
-    conn.query("SHOW FULL COLUMNS FROM " + tbl_name + " IN " + db_name);
+    conn.query("SELECT TABLE_SCHEMA AS db, TABLE_NAME AS tbl, COLUMN_NAME AS name, COLUMN_TYPE AS type,"
+               " COLLATION_NAME AS collation, COLUMN_KEY AS col_key, COLUMN_DEFAULT AS def,"
+               " IS_NULLABLE AS nullable, EXTRA AS extra FROM information_schema.COLUMNS"
+               " WHERE TABLE_SCHEMA IN (" + boost::algorithm::join(dbs, ",") + ")"
+               " AND TABLE_NAME IN (" + boost::algorithm::join(names, ",") + ")"
+               " ORDER BY TABLE_SCHEMA, TABLE_NAME, ORDINAL_POSITION");
     conn.store(res);
 
-    boost::shared_ptr<Table> table(new Table(db_name, tbl_name));
+    for (nanomysql::Connection::result_t::const_iterator i = res.begin(); i != res.end(); ++i) {
 
+        const std::pair<std::string, std::string> key(column(*i, "db"), column(*i, "tbl"));
 
-    LOG_DEBUG(log, "Created new Table object: database:" << db_name << " table: " << tbl_name );
+        // The IN lists give every db with every table name
+        if (wanted.count(key) == 0)
+            continue;
 
-    for (nanomysql::Connection::result_t::const_iterator i = res.begin(); i != res.end(); ++i) {
+        m_schema.tables[key].push_back(ColumnDesc(column(*i, "name"), column(*i, "type"),
+                                                  column(*i, "collation"), column(*i, "col_key") == "PRI",
+                                                  column_default(*i)));
+    }
 
-        //row.at(0) - field name
-        //row.at(1) - field type
-        //row.at(2) - collation
-        //row.at(3) - can be null
+    for (table_order_t::const_iterator it = tabs.begin(); it != tabs.end(); ++it) {
+        if (m_schema.tables[*it].empty())
+            throw std::runtime_error("Slave::readSchema(): table " + it->first + "." + it->second + " does not exist");
+    }
 
-        std::map<std::string,nanomysql::field>::const_iterator z = i->find("Field");
+    LOG_TRACE(log, "exit: readSchema");
+}
 
-        if (z == i->end())
-            throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Field'");
 
-        std::string name = z->second.data;
+PtrTable Slave::buildTable(const std::string& db_name, const std::string& tbl_name,
+                           const std::vector<ColumnDesc>& columns) const
+{
+    LOG_TRACE(log, "enter: buildTable " << db_name << " " << tbl_name);
 
-        z = i->find("Type");
+    boost::shared_ptr<Table> table(new Table(db_name, tbl_name));
 
-        if (z == i->end())
-            throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Type'");
 
-        std::string type = z->second.data;
+    LOG_DEBUG(log, "Created new Table object: database:" << db_name << " table: " << tbl_name );
 
-        z = i->find("Null");
+    for (std::vector<ColumnDesc>::const_iterator i = columns.begin(); i != columns.end(); ++i) {
 
-        if (z == i->end())
-            throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Null'");
+        const std::string& name = i->name;
+        const std::string& type = i->type;
 
         std::string extract_field;
 
@@ -172,18 +342,15 @@ void Slave::createTable(RelayLogInfo& rli,
         }
 
         if (extract_field.empty())
-            throw std::runtime_error("Slave::create_table(): Regexp error, type not found");
+            throw std::runtime_error("Slave::buildTable(): Regexp error, type not found");
 
         collate_info ci;
         if ("varchar" == extract_field || "char" == extract_field)
         {
-            z = i->find("Collation");
-            if (z == i->end())
-                throw std::runtime_error("Slave::create_table(): DESCRIBE query did not return 'Collation' for field '" + name + "'");
-            const std::string collate = z->second.data;
-            collate_map_t::const_iterator it = collate_map.find(collate);
-            if (collate_map.end() == it)
-                throw std::runtime_error("Slave::create_table(): cannot find collate '" + collate + "' from field "
+            const std::string& collate = i->collation;
+            collate_map_t::const_iterator it = m_schema.collations.find(collate);
+            if (m_schema.collations.end() == it)
+                throw std::runtime_error("Slave::buildTable(): cannot find collate '" + collate + "' from field "
                                          + name + " type " + type + " in collate info map");
             ci = it->second;
             LOG_DEBUG(log, "Created column: name-type: " << name << " - " << type
@@ -274,39 +441,36 @@ void Slave::createTable(RelayLogInfo& rli,
             field = PtrField(new Field_bit(name, type));
 
         else {
-            LOG_ERROR(log, "createTable: class name don't exist: " << extract_field );
+            LOG_ERROR(log, "buildTable: class name don't exist: " << extract_field );
             throw std::runtime_error("class name does not exist: " + extract_field);
         }
 
         table->fields.push_back(field);
 
-        z = i->find("Key");
-        if (z != i->end() && z->second.data == "PRI") {
+        if (i->primary) {
             table->pk_field = name;
         }
     }
 
-
-    rli.setTable(tbl_name, db_name, table);
-
+    return table;
 }
 
 namespace
 {
-struct raii_mysql_connector
+struct raii_binlog_connector
 {
-    MYSQL* mysql;
+    BinlogClient& client;
     MasterInfo& m_master_info;
     ExtStateIface &ext_state;
 
-    raii_mysql_connector(MYSQL* m, MasterInfo& mmi, ExtStateIface &state) : mysql(m), m_master_info(mmi), ext_state(state) {
+    raii_binlog_connector(BinlogClient& c, MasterInfo& mmi, ExtStateIface &state) : client(c), m_master_info(mmi), ext_state(state) {
 
         connect(false);
     }
 
-    ~raii_mysql_connector() {
+    ~raii_binlog_connector() {
 
-        mysql_close(mysql);
+        client.close();
     }
 
     void connect(bool reconnect) {
@@ -316,38 +480,18 @@ struct raii_mysql_connector
         ext_state.setConnecting();
 
         if (reconnect) {
-            mysql_close(mysql);
+            client.close();
         }
 
         bool was_error = reconnect;
 
-        while (true) {
-            if (!(mysql_init(mysql))) {
-                throw std::runtime_error("Slave::reconnect() : mysql_init() : could not initialize mysql structure");
-            }
-
-            unsigned int timeout = 10;
-
-            mysql_options(mysql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout); //(const char*) slave_net_timeout.c_str());
-
-            /* Timeout for reads from server (works only for TCP/IP connections, and only for Windows prior to MySQL 4.1.22).
-            * You can this option so that a lost connection can be detected earlier than the TCP/IP
-            * Close_Wait_Timeout value of 10 minutes. Added in 4.1.1.
-            */
-            mysql_options(mysql, MYSQL_OPT_READ_TIMEOUT, &timeout); //(const char*) slave_net_timeout.c_str());
-
-            if (mysql_real_connect(mysql,
-                                  m_master_info.host.c_str(),
-                                  m_master_info.user.c_str(),
-                                  m_master_info.password.c_str(), 0, m_master_info.port, 0, 0) != 0) {
-                break;
-            }
-
-            mysql_close(mysql);
+        while (!client.connect(m_master_info.host, m_master_info.port,
+                               m_master_info.user, m_master_info.password)) {
 
             ext_state.setConnecting();
             if(!was_error) {
-                LOG_ERROR(log, "Couldn't connect to mysql master " << m_master_info.host << ":" << m_master_info.port);
+                LOG_ERROR(log, "Couldn't connect to mysql master " << m_master_info.host << ":" << m_master_info.port
+                          << ": " << client.error_message());
                 was_error = true;
             }
 
@@ -361,8 +505,6 @@ struct raii_mysql_connector
         if(was_error)
             LOG_INFO(log, "Successfully connected to " << m_master_info.host << ":" << m_master_info.port);
 
-        mysql->reconnect = 1;
-
         LOG_TRACE(log, "exit: connect_to_master");
     }
 };
@@ -375,14 +517,16 @@ void Slave::get_remote_binlog( const boost::function< bool() >& _interruptFlag)
 
     generateSlaveId();
 
-    // Moved to Slave member
-    // MYSQL mysql;
-
-    raii_mysql_connector __conn(&mysql, m_master_info, ext_state);
+    raii_binlog_connector __conn(m_client, m_master_info, ext_state);
 
-    //connect_to_master(false, &mysql);
+    register_slave_on_master();
 
-    register_slave_on_master(&mysql);
+    // The reader thread is stopped before the connection is closed, whatever way we leave
+    struct reader_guard {
+        Slave& slave;
+        reader_guard(Slave& s) : slave(s) {}
+        ~reader_guard() { slave.stop_reader(); }
+    } reader(*this);
 
 connected:
 
@@ -406,162 +550,243 @@ connected:
              << ":" << m_master_info.master_log_pos );
 
 
-    request_dump(m_master_info.master_log_name, m_master_info.master_log_pos, &mysql);
+    request_dump(m_master_info.master_log_name, m_master_info.master_log_pos);
+
+    // Packets are read from the socket in a separate thread, events are
+    // parsed and callbacks are called in this one
+    start_reader();
 
     while (!_interruptFlag()) {
 
+        ext_state.setStateProcessing(false);
+
+        Packet* packet = m_packets.begin_read(PACKET_WAIT_MS);
+
+        if (packet == NULL) {
+            continue;
+        }
+
+        const unsigned long long start = now_us();
+        const unsigned long len = packet->len;
+
+        ext_state.setStateProcessing(true);
+
+        count_packet++;
+        LOG_TRACE(log, "Got event with length: " << len << " Packet number: " << count_packet );
+
+        // end of data
+
+        if (len == packet_error || len == packet_end_data) {
+
+            // The reader stops after an error
+            const unsigned int mysql_error_number = packet->error;
+            const std::string mysql_error_message = packet->message;
+
+            m_packets.end_read(now_us() - start);
+            stop_reader();
+
+            switch(mysql_error_number) {
+                case ER_NET_PACKET_TOO_LARGE:
+                    LOG_ERROR(log, "Myslave: Log entry on master is longer than max_allowed_packet on "
+                              "slave. If the entry is correct, restart the server with a higher value of "
+                              "max_allowed_packet. max_allowed_packet=" << mysql_error_message );
+                    throw std::runtime_error(std::string("Myslave: fatal error reading binlog. max_allowed_packet=" ) + mysql_error_message);
+                    break;
+                case ER_MASTER_FATAL_ERROR_READING_BINLOG: // Ошибка -- неизвестный бинлог-файл.
+                    LOG_ERROR(log, "Myslave: fatal error reading binlog. " <<  mysql_error_message );
+                    throw std::runtime_error(std::string("Myslave: fatal error reading binlog. " ) + mysql_error_message);
+                    break;
+                case 2013: // Обработка ошибки 'Lost connection to MySQL'
+                    LOG_WARNING(log, "Myslave: Error from MySQL: " << mysql_error_message );
+                    // Check if connection closed by user for exiting from the loop
+                    if (_interruptFlag())
+                    {
+                        LOG_INFO(log, "Interrupt flag is true, breaking loop");
+                        continue;
+                    }
+                    break;
+                default:
+                    LOG_ERROR(log, "Myslave: Error reading packet from server: " << mysql_error_message
+                            << "; mysql_error: " << mysql_error_number);
+                    break;
+            }
+
+            __conn.connect(true);
+
+            goto connected;
+        } // len == packet_error
+
+        // Ok event
+
         try {
 
-            LOG_TRACE(log, "-- reading event --");
+            process_packet(packet->data.data(), len);
 
-            unsigned long len = read_event(&mysql);
+        } catch (const slave::Checksum_error&) {
 
-            ext_state.setStateProcessing(true);
+            // the stream is corrupted, like the MySQL slave we stop
+            throw;
 
-            count_packet++;
-            LOG_TRACE(log, "Got event with length: " << len << " Packet number: " << count_packet );
+        } catch (const slave::Table_map_error&) {
 
-            // end of data
+            // the rows of a replicated table can not be decoded
+            throw;
 
-            if (len == packet_error || len == packet_end_data) {
+        } catch (const std::exception& _ex ) {
 
-                uint mysql_error_number = mysql_errno(&mysql);
+            LOG_ERROR(log, "Met exception in get_remote_binlog cycle. Message: " << _ex.what() );
+            usleep(1000*1000);
+        }
 
-                switch(mysql_error_number) {
-                    case ER_NET_PACKET_TOO_LARGE:
-                        LOG_ERROR(log, "Myslave: Log entry on master is longer than max_allowed_packet on "
-                                  "slave. If the entry is correct, restart the server with a higher value of "
-                                  "max_allowed_packet. max_allowed_packet=" << mysql_error(&mysql) );
-                        throw RethrowableException(std::string("Myslave: fatal error reading binlog. max_allowed_packet=" ) + mysql_error(&mysql));
-                        break;
-                    case ER_MASTER_FATAL_ERROR_READING_BINLOG: // Ошибка -- неизвестный бинлог-файл.
-                        LOG_ERROR(log, "Myslave: fatal error reading binlog. " <<  mysql_error(&mysql) );
-                        throw RethrowableException(std::string("Myslave: fatal error reading binlog. " ) + mysql_error(&mysql));
-                        break;
-                    case 2013: // Обработка ошибки 'Lost connection to MySQL'
-                        LOG_WARNING(log, "Myslave: Error from MySQL: " << mysql_error(&mysql) );
-                        // Check if connection closed by user for exiting from the loop
-                        if (_interruptFlag())
-                        {
-                            LOG_INFO(log, "Interrupt flag is true, breaking loop");
-                            continue;
-                        }
-                        break;
-                    default:
-                        LOG_ERROR(log, "Myslave: Error reading packet from server: " << mysql_error(&mysql)
-                                << "; mysql_error: " << mysql_errno(&mysql));
-                        break;
-                }
+        m_packets.end_read(now_us() - start);
 
-                __conn.connect(true);
+    } //while
 
-                goto connected;
-            } // len == packet_error
+    stop_reader();
 
-            // Ok event
+    LOG_WARNING(log, "Binlog monitor was stopped. Binlog events are not listened.");
 
-            if (len == packet_end_data) {
-                continue;
-            }
+    deregister_slave_on_master();
+}
 
-            slave::Basic_event_info event;
 
-            if (!slave::read_log_event((const char*) mysql.net.read_pos + 1,
-                                       len - 1,
-                                       event)) {
+void Slave::process_packet(const char* data, unsigned long len)
+{
+    slave::Basic_event_info event;
 
-                LOG_TRACE(log, "Skipping unknown event.");
-                continue;
-            }
+    if (!slave::read_log_event(data + 1, len - 1, event, m_binlog_checksum)) {
 
-            //
+        LOG_TRACE(log, "Skipping unknown event.");
+        return;
+    }
 
-            LOG_TRACE(log, "Event log position: " << event.log_pos );
+    //
 
-            if (event.log_pos != 0) {
-                m_master_info.master_log_pos = event.log_pos;
-                ext_state.setLastEventTimePos(event.when, event.log_pos);
-            }
+    LOG_TRACE(log, "Event log position: " << event.log_pos );
 
-            LOG_TRACE(log, "seconds_behind_master: " << (::time(NULL) - event.when) );
+    if (event.log_pos != 0) {
+        m_master_info.master_log_pos = event.log_pos;
+        ext_state.setLastEventTimePos(event.when, event.log_pos);
+    }
 
+    LOG_TRACE(log, "seconds_behind_master: " << (::time(NULL) - event.when) );
 
-            // MySQL5.1.23 binlogs can be read only starting from a XID_EVENT
-            // MySQL5.1.23 ev->log_pos -- the binlog offset
 
-            if (event.type == XID_EVENT) {
+    // MySQL5.1.23 binlogs can be read only starting from a XID_EVENT
+    // MySQL5.1.23 ev->log_pos -- the binlog offset
 
-                ext_state.setMasterLogNamePos(m_master_info.master_log_name, m_master_info.master_log_pos);
+    if (event.type == XID_EVENT) {
 
-                LOG_TRACE(log, "Got XID event. Using binlog name:pos: "
-                          << m_master_info.master_log_name << ":" << m_master_info.master_log_pos);
+        ext_state.setMasterLogNamePos(m_master_info.master_log_name, m_master_info.master_log_pos);
 
+        LOG_TRACE(log, "Got XID event. Using binlog name:pos: "
+                  << m_master_info.master_log_name << ":" << m_master_info.master_log_pos);
 
-                if (m_xid_callback)
-                    m_xid_callback(event.server_id);
 
-            } else  if (event.type == ROTATE_EVENT) {
+        if (m_xid_callback)
+            m_xid_callback(event.server_id);
 
-                slave::Rotate_event_info rei(event.buf, event.event_len);
+    } else  if (event.type == ROTATE_EVENT) {
 
-                /*
-                 * new_log_ident - new binlog name
-                 * pos - position of the starting event
-                 */
+        slave::Rotate_event_info rei(event.buf, event.event_len);
 
-                LOG_INFO(log, "Got rotate event.");
+        /*
+         * new_log_ident - new binlog name
+         * pos - position of the starting event
+         */
 
-                /* WTF
-                 */
+        LOG_INFO(log, "Got rotate event.");
 
-                if (event.when == 0) {
+        /* WTF
+         */
 
-                    //LOG_TRACE(log, "ROTATE_FAKE");
-                }
+        if (event.when == 0) {
 
-                m_master_info.master_log_name = rei.new_log_ident;
-                m_master_info.master_log_pos = rei.pos; // this will always be equal to 4
+            //LOG_TRACE(log, "ROTATE_FAKE");
+        }
 
-                ext_state.setMasterLogNamePos(m_master_info.master_log_name, m_master_info.master_log_pos);
+        m_master_info.master_log_name = rei.new_log_ident;
+        m_master_info.master_log_pos = rei.pos; // this will always be equal to 4
 
-                LOG_TRACE(log, "new position is " << m_master_info.master_log_name << ":" << m_master_info.master_log_pos);
-                LOG_TRACE(log, "ROTATE_EVENT processed OK.");
-            }
+        ext_state.setMasterLogNamePos(m_master_info.master_log_name, m_master_info.master_log_pos);
 
+        LOG_TRACE(log, "new position is " << m_master_info.master_log_name << ":" << m_master_info.master_log_pos);
+        LOG_TRACE(log, "ROTATE_EVENT processed OK.");
+    }
 
-            if (process_event(event, m_rli, m_master_info.master_log_pos)) {
 
-                LOG_TRACE(log, "Error in processing event.");
-            }
+    if (process_event(event, m_rli, m_master_info.master_log_pos)) {
 
-        } catch (const RethrowableException& _ex ) {
+        LOG_TRACE(log, "Error in processing event.");
+    }
+}
 
-            throw std::runtime_error( _ex.what() );
 
-        } catch (const std::exception& _ex ) {
+void Slave::start_reader()
+{
+    m_packets.reset();
+    m_reader = std::thread(&Slave::read_packets, this);
+}
 
-            LOG_ERROR(log, "Met exception in get_remote_binlog cycle. Message: " << _ex.what() );
-            usleep(1000*1000);
-            continue;
-        }
 
-    } //while
+void Slave::stop_reader()
+{
+    if (!m_reader.joinable())
+        return;
 
-    LOG_WARNING(log, "Binlog monitor was stopped. Binlog events are not listened.");
+    // Wakes the reader up whether it waits for a free buffer or for the network
+    m_packets.close();
+    m_client.cancel();
 
-    deregister_slave_on_master(&mysql);
+    m_reader.join();
 }
 
+
+void Slave::read_packets()
+{
+    while (true) {
+
+        Packet* packet = m_packets.begin_write();
+
+        if (packet == NULL)
+            return;
+
+        const unsigned long long start = now_us();
+
+        BinlogClient::PacketView view;
+        const BinlogClient::ReadResult result = m_client.read_packet(view);
+        const bool last = result != BinlogClient::PacketOk;
+
+        packet->error = 0;
+
+        if (result == BinlogClient::PacketOk) {
+            packet->len = view.len;
+            packet->data.assign(view.data, view.len);
+        } else if (result == BinlogClient::EndOfData) {
+            LOG_ERROR(log, "read_packets(): end of data");
+            packet->len = packet_end_data;
+            packet->message = "end of data";
+        } else {
+            packet->len = packet_error;
+            packet->error = m_client.error();
+            packet->message = m_client.error_message();
+        }
+
+        // The packet belongs to the decoder from now on
+        m_packets.end_write(now_us() - start);
+
+        if (last)
+            return;
+    }
+}
+
+
 std::map<std::string,std::string> Slave::getRowType(const std::string& db_name,
                                                     const std::set<std::string>& tbl_names) const
 {
-    nanomysql::Connection conn(m_master_info.host.c_str(), m_master_info.user.c_str(),
-                               m_master_info.password.c_str(), "", m_master_info.port);
-
     nanomysql::Connection::result_t res;
 
-    conn.query("SHOW TABLE STATUS FROM " + db_name);
-    conn.store(res);
+    m_meta.query("SHOW TABLE STATUS FROM " + db_name, res);
 
     std::map<std::string,std::string> ret;
 
@@ -600,65 +825,32 @@ std::map<std::string,std::string> Slave::getRowType(const std::string& db_name,
     return ret;
 }
 
-void Slave::register_slave_on_master(MYSQL* mysql)
+void Slave::register_slave_on_master()
 {
-    uchar buf[1024], *pos= buf;
-
-    unsigned int report_host_len=0, report_user_len=0, report_password_len=0;
-
-    const char * report_host = "0.0.0.0";
-
-    const char* report_user = "begun_slave";
-    const char* report_password = "begun_slave";
-    unsigned int report_port = 0;
-    unsigned long rpl_recovery_rank = 0;
-
-    report_host_len= strlen(report_host);
-    report_user_len= strlen(report_user);
-    report_password_len= strlen(report_password);
-
     LOG_DEBUG(log, "Registering slave on master: m_server_id = " << m_server_id << "...");
 
-    int4store(pos, m_server_id);
-    pos+= 4;
-    pos= net_store_data(pos, (uchar*)report_host, report_host_len);
-    pos= net_store_data(pos, (uchar*)report_user, report_user_len);
-    pos= net_store_data(pos, (uchar*)report_password, report_password_len);
-    int2store(pos, (unsigned short) report_port);
-    pos+= 2;
-    int4store(pos, rpl_recovery_rank);
-    pos+= 4;
-
-    /* The master will fill in master_id */
-    int4store(pos, 0);
-    pos+= 4;
-
-    if (simple_command(mysql, COM_REGISTER_SLAVE, buf, (size_t) (pos-buf), 0)) {
+    if (!m_client.register_slave(m_server_id, "0.0.0.0", "begun_slave", "begun_slave", 0)) {
 
         LOG_ERROR(log, "Unable to register slave.");
         throw std::runtime_error("Slave::register_slave_on_master(): Error registring on slave: " +
-                                 std::string(mysql_error(mysql)));
+                                 m_client.error_message());
     }
 
     LOG_TRACE(log, "Success registering slave on master");
 }
 
-void Slave::deregister_slave_on_master(MYSQL* mysql)
+void Slave::deregister_slave_on_master()
 {
     LOG_DEBUG(log, "Deregistering slave on master: m_server_id = " << m_server_id << "...");
-    // Last '1' means 'no checking', otherwise command can hung
-    simple_command(mysql, COM_QUIT, 0, 0, 1);
+    // The answer is not waited for, otherwise the command can hang
+    m_client.quit();
 }
 
 void Slave::check_master_version()
 {
-    nanomysql::Connection conn(m_master_info.host.c_str(), m_master_info.user.c_str(),
-                               m_master_info.password.c_str(), "", m_master_info.port);
-
     nanomysql::Connection::result_t res;
 
-    conn.query("SELECT VERSION()");
-    conn.store(res);
+    m_meta.query("SELECT VERSION()", res);
 
     if (res.size() == 1 && res[0].size() == 1)
     {
@@ -679,13 +871,9 @@ void Slave::check_master_version()
 
 void Slave::check_master_binlog_format()
 {
-    nanomysql::Connection conn(m_master_info.host.c_str(), m_master_info.user.c_str(),
-                               m_master_info.password.c_str(), "", m_master_info.port);
-
     nanomysql::Connection::result_t res;
 
-    conn.query("SHOW GLOBAL VARIABLES LIKE 'binlog_format'");
-    conn.store(res);
+    m_meta.query("SHOW GLOBAL VARIABLES LIKE 'binlog_format'", res);
 
     if (res.size() == 1 && res[0].size() == 2) {
 
@@ -710,79 +898,6 @@ void Slave::check_master_binlog_format()
 
 
 
-// This will check if a QUERY_EVENT holds an "ALTER TABLE ..." string.
-namespace
-{
-static bool checkAlterQuery(const std::string& str)
-{
-    //RegularExpression regexp("^\\s*ALTER\\s+TABLE)", RegularExpression::RE_CASELESS);
-
-    enum {
-        SP0, _A0, _L0, _T0, _E0, _R, SP1, _T1, _A1, _B, _L1, _E1
-    } state = SP0;
-
-
-    for (std::string::const_iterator i = str.begin(); i != str.end(); ++i) {
-
-        if (state == SP0 && (*i == ' ' || *i == '\t' || *i == '\r' || *i == '\n')) {
-
-        } else if (state == SP0 && (*i == 'a' || *i == 'A')) {
-            state = _A0;
-
-        } else if (state == _A0 && (*i == 'l' || *i == 'L')) {
-            state = _L0;
-
-        } else if (state == _L0 && (*i == 't' || *i == 'T')) {
-            state = _T0;
-
-        } else if (state == _T0 && (*i == 'e' || *i == 'E')) {
-            state = _E0;
-
-        } else if (state == _E0 && (*i == 'r' || *i == 'R')) {
-            state = _R;
-
-        } else if (state == _R && (*i == ' ' || *i == '\t' || *i == '\r' || *i == '\n')) {
-            state = SP1;
-
-        } else if (state == SP1 && (*i == ' ' || *i == '\t' || *i == '\r' || *i == '\n')) {
-
-        } else if (state == SP1 && (*i == 't' || *i == 'T')) {
-            state = _T1;
-
-        } else if (state == _T1 && (*i == 'a' || *i == 'A')) {
-            state = _A1;
-
-        } else if (state == _A1 && (*i == 'b' || *i == 'B')) {
-            state = _B;
-
-        } else if (state == _B && (*i == 'l' || *i == 'L')) {
-            state = _L1;
-
-        } else if (state == _L1 && (*i == 'e' || *i == 'E')) {
-            state = _E1;
-
-        } else if (state == _E1) {
-            return true;
-
-        } else {
-            return false;
-        }
-    }
-
-    return false;
-}
-
-
-bool checkCreateQuery(const std::string& str)
-{
-    if (0 == ::strncasecmp("create table ", str.c_str(), 13))
-        return true;
-    return false;
-}
-}// anonymouos-namespace
-
-
-
 int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo &m_rli, unsigned long long pos)
 {
 
@@ -793,18 +908,22 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo &m_rli
 
     switch (bei.type) {
 
+    case ROTATE_EVENT:
+        // table_ids start over when the master restarts
+        m_rli.m_table_versions.clear();
+        break;
+
     case QUERY_EVENT:
     {
-        // Check for an ALTER TABLE
+        // Check for a DDL statement changing the tables we replicate
 
         slave::Query_event_info qei(bei.buf, bei.event_len);
 
         LOG_TRACE(log, "Received QUERY_EVENT: " << qei.query);
 
-        if (checkAlterQuery(qei.query) || checkCreateQuery(qei.query)) {
-
-            LOG_DEBUG(log, "Rebuilding database structure.");
-            createDatabaseStructure();
+        std::vector<DdlTable> tables;
+        if (parse_ddl(qei.query, qei.db, tables)) {
+            markTables(tables);
         }
         break;
     }
@@ -817,18 +936,32 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo &m_rli
 
         m_rli.setTableName(tmi.m_table_id, tmi.m_tblnam, tmi.m_dbnam);
 
+        // A new table_id: check the schema against the table map
+        if (!m_rli.hasTableVersion(tmi.m_table_id)) {
+            mapTable(tmi, m_rli);
+        }
+
+        // Temporal columns are decoded as the master writes them, not as the schema says
+        const PtrTable table = m_rli.getTableById(tmi.m_table_id);
+        if (table) {
+            table->decoder.set_binlog_types(tmi.m_column_types, tmi.m_column_meta);
+        }
+
         break;
     }
 
     case WRITE_ROWS_EVENT:
     case UPDATE_ROWS_EVENT:
     case DELETE_ROWS_EVENT:
+    case WRITE_ROWS_EVENT_V2:
+    case UPDATE_ROWS_EVENT_V2:
+    case DELETE_ROWS_EVENT_V2:
     {
-        LOG_TRACE(log, "Got " << (bei.type == WRITE_ROWS_EVENT ? "WRITE" :
-                                  bei.type == DELETE_ROWS_EVENT ? "DELETE" :
-                                  "UPDATE") << "_ROWS_EVENT");
+        Row_event_info roi(bei.buf, bei.event_len, (bei.type == UPDATE_ROWS_EVENT || bei.type == UPDATE_ROWS_EVENT_V2));
 
-        Row_event_info roi(bei.buf, bei.event_len, (bei.type == UPDATE_ROWS_EVENT));
+        LOG_TRACE(log, "Got " << (roi.m_type == WRITE_ROWS_EVENT ? "WRITE" :
+                                  roi.m_type == DELETE_ROWS_EVENT ? "DELETE" :
+                                  "UPDATE") << "_ROWS_EVENT" << (bei.type != roi.m_type ? "_V2" : ""));
 
         apply_row_event(m_rli, bei, roi, ext_state);
 
@@ -842,56 +975,46 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo &m_rli
     return 0;
 }
 
-void Slave::request_dump(const std::string& logname, unsigned long start_position, MYSQL* mysql)
+void Slave::request_dump(const std::string& logname, unsigned long start_position)
 {
-    uchar buf[128];
+    // Masters since 5.6 append checksums to events unless binlog_checksum is
+    // NONE, and send nothing to slaves that do not say they understand them.
+    // Older masters do not know the variable.
+    m_binlog_checksum.alg = BINLOG_CHECKSUM_ALG_OFF;
+    m_binlog_checksum.verify = m_master_info.checksum_verify;
 
-    /*
-    COM_BINLOG_DUMP accepts only 4 bytes for the position, so we are forced to
-    cast to uint32.
-    */
-
-    //
-    //start_position = 4;
+    std::string alg;
+    if (m_client.query("SET @master_binlog_checksum = @@global.binlog_checksum") &&
+        m_client.query_value("SELECT @master_binlog_checksum", alg)) {
 
-    int binlog_flags = 0;
-    int4store(buf, (uint32)start_position);
-    int2store(buf + BIN_LOG_HEADER_SIZE, binlog_flags);
+        LOG_INFO(log, "Binlog checksum: " << alg << (m_binlog_checksum.verify ? "" : ", not verified"));
 
-    uint logname_len = logname.size();
-    int4store(buf + 6, m_server_id);
-
-    memcpy(buf + 10, logname.data(), logname_len);
-
-    if (simple_command(mysql, COM_BINLOG_DUMP, buf, logname_len + 10, 1)) {
-
-        LOG_ERROR(log, "Error sending COM_BINLOG_DUMP");
-        throw std::runtime_error("Error in sending COM_BINLOG_DUMP");
+        if (alg == "CRC32")
+            m_binlog_checksum.alg = BINLOG_CHECKSUM_ALG_CRC32;
     }
-}
-
-ulong Slave::read_event(MYSQL* mysql)
-{
 
-    ulong len;
-    ext_state.setStateProcessing(false);
+    if (m_master_info.heartbeat_period) {
 
-    len = mysql_net_read_packet(mysql);
+        // An idle master sends heartbeats, so the binlog loop and its
+        // interrupt callback run at least this often
+        char query[64];
+        ::snprintf(query, sizeof(query), "SET @master_heartbeat_period = %llu",
+                   m_master_info.heartbeat_period * 1000000ULL);
 
-    if (len == packet_error) {
-        //LOG_ERROR(log, "Myslave: Error reading packet from server: " << mysql_error(mysql)
-        //          << "; mysql_error: " << mysql_errno(mysql));
-        return packet_error;
+        if (!m_client.query(query)) {
+            LOG_WARNING(log, "Unable to set heartbeat period: " << m_client.error_message());
+        }
     }
 
-    // check for end-of-data
-    if (len < 8 && mysql->net.read_pos[0] == 254) {
+    /*
+    COM_BINLOG_DUMP accepts only 4 bytes for the position, so we are forced to
+    cast to uint32.
+    */
+    if (!m_client.binlog_dump(logname, (uint32_t)start_position, m_server_id)) {
 
-        LOG_ERROR(log, "read_event(): end of data");
-        return packet_end_data;
+        LOG_ERROR(log, "Error sending COM_BINLOG_DUMP");
+        throw std::runtime_error("Error in sending COM_BINLOG_DUMP");
     }
-
-    return len;
 }
 
 void Slave::generateSlaveId()
@@ -899,13 +1022,9 @@ void Slave::generateSlaveId()
 
     std::set<unsigned int> server_ids;
 
-    nanomysql::Connection conn(m_master_info.host.c_str(), m_master_info.user.c_str(),
-                               m_master_info.password.c_str(), "", m_master_info.port);
-
     nanomysql::Connection::result_t res;
 
-    conn.query("SHOW SLAVE HOSTS");
-    conn.store(res);
+    m_meta.query("SHOW SLAVE HOSTS", res);
 
     for (nanomysql::Connection::result_t::const_iterator i = res.begin(); i != res.end(); ++i) {
 
@@ -942,14 +1061,10 @@ Slave::binlog_pos_t Slave::getLastBinlog() const
 {
 
 
-    nanomysql::Connection conn(m_master_info.host.c_str(), m_master_info.user.c_str(),
-                               m_master_info.password.c_str(), "", m_master_info.port);
-
     nanomysql::Connection::result_t res;
 
     static const std::string query = "SHOW MASTER STATUS";
-    conn.query(query);
-    conn.store(res);
+    m_meta.query(query, res);
 
     if (res.size() == 1 && res[0].size() == 4) {
 
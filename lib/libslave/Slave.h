@@ -27,11 +27,17 @@
 #include <map>
 #include <set>
 #include <memory>
+#include <thread>
 
 #include <mysql/mysql.h>
 
 #include "slave_log_event.h"
 #include "SlaveStats.h"
+#include "packetqueue.h"
+#include "binlogclient.h"
+#include "nanomysql.h"
+#include "metaconnection.h"
+#include "ddl.h"
 
 #include "mysqlcompat.h"
 
@@ -45,13 +51,42 @@ public:
 
     typedef std::vector<std::pair<std::string, std::string> > table_order_t;
     typedef std::map<std::pair<std::string, std::string>, callback> callbacks_t;
+    typedef std::map<std::pair<std::string, std::string>, batch_callback> batch_callbacks_t;
     typedef std::vector<std::string> cols_t;
     typedef std::map<std::pair<std::string, std::string>, cols_t> callback_filters_t;
+    typedef std::map<std::pair<std::string, std::string>, std::pair<std::vector<unsigned>, row_predicate> > row_filters_t;
+    typedef std::map<std::pair<std::string, std::string>, std::map<std::string, Field_decimal::Format> > decimal_formats_t;
+    // db.table -> (rows decoded, rows skipped by the row filter)
+    typedef std::map<std::string, std::pair<unsigned long, unsigned long> > row_counters_t;
+
+    // A column as information_schema describes it
+    struct ColumnDesc
+    {
+        std::string name;
+        std::string type;
+        std::string collation;
+        bool primary;
+        ColumnDefault column_default;
+
+        ColumnDesc(const std::string& n, const std::string& t, const std::string& c, bool p,
+                   const ColumnDefault& d = ColumnDefault()) :
+            name(n), type(t), collation(c), primary(p), column_default(d) {}
+    };
+
+    // Table structures read from the master. Another Slave of the same
+    // master can take them with setSchema() instead of reading them again.
+    struct Schema
+    {
+        typedef std::map<std::pair<std::string, std::string>, std::vector<ColumnDesc> > tables_t;
+
+        collate_map_t collations;
+        tables_t tables;
+    };
 
 private:
     static inline bool falseFunction() { return false; };
 
-    MYSQL mysql;
+    BinlogClient m_client;
 
     int m_server_id;
 
@@ -61,28 +96,69 @@ private:
 
     table_order_t m_table_order;
     callbacks_t m_callbacks;
+    batch_callbacks_t m_batch_callbacks;
     callback_filters_t m_callback_filters;
+    row_filters_t m_row_filters;
+    decimal_formats_t m_decimal_formats;
 
     typedef boost::function<void (unsigned int)> xid_callback_t;
     xid_callback_t m_xid_callback;
 
     RelayLogInfo m_rli;
 
+    Binlog_checksum m_binlog_checksum;
+
+    // Packets read from the master, waiting to be decoded
+    static const unsigned int PACKET_QUEUE_SIZE = 128;
+    // How often the decoder checks the interrupt flag when no packets come
+    static const unsigned int PACKET_WAIT_MS = 100;
+    PacketQueue m_packets;
+    std::thread m_reader;
+
+    // Every question to the master but the binlog dump itself goes here
+    mutable MetaConnection m_meta;
+    Schema m_schema;
+    // m_schema was given by setSchema() and has not been used yet
+    bool m_schema_shared;
+
+    // Replicated tables changed by DDL: read again at their next TABLE_MAP
+    std::set<std::pair<std::string, std::string> > m_stale_tables;
+
+    void createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli);
+
+    // Describes the tables in m_schema with one information_schema query
+    void readSchema(const table_order_t& tabs, nanomysql::Connection& conn);
+    PtrTable buildTable(const std::string& db_name, const std::string& tbl_name,
+                        const std::vector<ColumnDesc>& columns) const;
 
-    void createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli) const;
+    // Sets the callbacks and filters of a table read from the master
+    void configureTable(const std::pair<std::string, std::string>& key, Table& table);
+
+    // Forgets the replicated tables a DDL statement dropped, marks the changed ones stale
+    void markTables(const std::vector<DdlTable>& tables);
+
+    // Picks the table version for a new table_id. The structure is read from
+    // the master only if the table is stale or its TABLE_MAP does not match
+    // the current one; what the master gives is used only if it matches too.
+    // Throws Table_map_error if neither matches.
+    void mapTable(const Table_map_event_info& tmi, RelayLogInfo& rli);
 
 public:
 
-    Slave() : ext_state(empty_ext_state) {}
-    Slave(ExtStateIface &state) : ext_state(state) {}
-    Slave(const MasterInfo& _master_info) : m_master_info(_master_info), ext_state(empty_ext_state) {}
-    Slave(const MasterInfo& _master_info, ExtStateIface &state) : m_master_info(_master_info), ext_state(state) {}
+    Slave() : ext_state(empty_ext_state), m_packets(PACKET_QUEUE_SIZE), m_meta(m_master_info), m_schema_shared(false) {}
+    Slave(ExtStateIface &state) : ext_state(state), m_packets(PACKET_QUEUE_SIZE), m_meta(m_master_info), m_schema_shared(false) {}
+    Slave(const MasterInfo& _master_info) : m_master_info(_master_info), ext_state(empty_ext_state), m_packets(PACKET_QUEUE_SIZE), m_meta(m_master_info), m_schema_shared(false) {}
+    Slave(const MasterInfo& _master_info, ExtStateIface &state) : m_master_info(_master_info), ext_state(state), m_packets(PACKET_QUEUE_SIZE), m_meta(m_master_info), m_schema_shared(false) {}
 
     // Makes sense only when get_remote_binlog is not started
     void setMasterInfo(const MasterInfo& aMasterInfo)
     {
         m_master_info = aMasterInfo;
         ext_state.setMasterLogNamePos(aMasterInfo.master_log_name, aMasterInfo.master_log_pos);
+
+        // Perhaps another master
+        m_meta.close();
+        m_schema = Schema();
     }
     const MasterInfo& masterInfo() const { return m_master_info; }
 
@@ -100,11 +176,47 @@ public:
     {
         m_table_order.push_back(std::make_pair(_db_name, _tbl_name));
         m_callbacks[std::make_pair(_db_name, _tbl_name)] = _callback;
+        m_batch_callbacks.erase(std::make_pair(_db_name, _tbl_name));
         m_callback_filters[std::make_pair(_db_name, _tbl_name)] = cols_t();
 
         ext_state.initTableCount(_db_name + "." + _tbl_name);
     }
 
+    // Like setCallback(), but the callback gets all rows of a rows event at once
+    void setBatchCallback(const std::string& _db_name, const std::string& _tbl_name, batch_callback _callback, const cols_t &filter)
+    {
+        setCallback(_db_name, _tbl_name, callback(), filter);
+        m_batch_callbacks[std::make_pair(_db_name, _tbl_name)] = _callback;
+    }
+
+    // Rows of the table are passed to callbacks only if they satisfy 'pred'.
+    // Only the values in 'slots' are decoded before 'pred' is called. A slot
+    // is the column index in the callback filter, or in the table if there is
+    // no callback filter.
+    void setRowFilter(const std::string& _db_name, const std::string& _tbl_name, const std::vector<unsigned>& slots, row_predicate pred)
+    {
+        m_row_filters[std::make_pair(_db_name, _tbl_name)] = std::make_pair(slots, pred);
+    }
+
+    // How values of the DECIMAL column are given to callbacks, Double by default
+    void setDecimalFormat(const std::string& _db_name, const std::string& _tbl_name, const std::string& _column, Field_decimal::Format format)
+    {
+        m_decimal_formats[std::make_pair(_db_name, _tbl_name)][_column] = format;
+    }
+
+    // Binlog reading pipeline counters, safe to call from any thread
+    void getPipelineStats(PipelineStats& stats)
+    {
+        m_packets.get_stats(stats);
+    }
+
+    void getRowCounters(row_counters_t& counters) const
+    {
+        for (RelayLogInfo::name_to_table_t::const_iterator i = m_rli.m_table_map.begin(); i != m_rli.m_table_map.end(); ++i) {
+            counters[i->second->full_name] = std::make_pair(i->second->rows_decoded, i->second->rows_skipped);
+        }
+    }
+
     void setXidCallback(xid_callback_t _callback)
     {
         m_xid_callback = _callback;
@@ -115,12 +227,12 @@ public:
     void createDatabaseStructure() {
 
         m_rli.clear();
+        m_stale_tables.clear();
 
         createDatabaseStructure_(m_table_order, m_rli);
 
         for (RelayLogInfo::name_to_table_t::iterator i = m_rli.m_table_map.begin(); i != m_rli.m_table_map.end(); ++i) {
-            i->second->m_callback = m_callbacks[i->first];
-            i->second->set_callback_filter(m_callback_filters[i->first]);
+            configureTable(i->first, *i->second);
         }
     }
 
@@ -132,13 +244,23 @@ public:
         return m_table_order;
     }
 
+    const Schema& getSchema() const {
+        return m_schema;
+    }
+
+    // Tables described here are not read from the master by the next createDatabaseStructure()
+    void setSchema(const Schema& schema) {
+        m_schema = schema;
+        m_schema_shared = true;
+    }
+
     void init();
 
     int serverId() const { return m_server_id; }
 
-    // Closes connection, opened in get_remote_binlog. Should be called if your have get_remote_binlog
-    // blocked on reading data from mysql server in the separate thread and you want to stop this thread.
-    // You should take care that interruptFlag will return 'true' after connection is closed.
+    // Interrupts reading of the connection opened in get_remote_binlog. Should be called if your have
+    // get_remote_binlog blocked on reading data from mysql server in the separate thread and you want
+    // to stop this thread. You should take care that interruptFlag will return 'true' after that.
     void close_connection();
 
 protected:
@@ -150,19 +272,22 @@ protected:
 
     int process_event(const slave::Basic_event_info& bei, RelayLogInfo &rli, unsigned long long pos);
 
-    void request_dump(const std::string& logname, unsigned long start_position, MYSQL* mysql);
+    void request_dump(const std::string& logname, unsigned long start_position);
+
+    // Network stage of get_remote_binlog(), runs in m_reader
+    void read_packets();
+    void start_reader();
+    void stop_reader();
 
-    ulong read_event(MYSQL* mysql);
+    // Decode stage of get_remote_binlog(): parses one packet and runs the callbacks
+    void process_packet(const char* data, unsigned long len);
 
     std::map<std::string,std::string> getRowType(const std::string& db_name,
                                                  const std::set<std::string>& tbl_names) const;
 
-    void createTable(RelayLogInfo& rli,
-                     const std::string& db_name, const std::string& tbl_name,
-                     const collate_map_t& collate_map, nanomysql::Connection& conn) const;
 
-    void register_slave_on_master(MYSQL* mysql);
-    void deregister_slave_on_master(MYSQL* mysql);
+    void register_slave_on_master();
+    void deregister_slave_on_master();
 
     void generateSlaveId();
 
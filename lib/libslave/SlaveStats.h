@@ -44,18 +44,25 @@ struct MasterInfo {
     std::string master_log_name;
     unsigned long master_log_pos;
     unsigned int connect_retry;
+    // Milliseconds between heartbeats of an idle master, 0 -- no heartbeats
+    unsigned int heartbeat_period;
+    // Verify binlog event checksums, or only strip them
+    bool checksum_verify;
 
-    MasterInfo() : port(3306), master_log_pos(0), connect_retry(10) {}
+    MasterInfo() : port(3306), master_log_pos(0), connect_retry(10), heartbeat_period(0), checksum_verify(true) {}
 
     MasterInfo(std::string host_, unsigned int port_, std::string user_,
-               std::string password_, unsigned int connect_retry_) :
+               std::string password_, unsigned int connect_retry_, unsigned int heartbeat_period_ = 0,
+               bool checksum_verify_ = true) :
         host(host_),
         port(port_),
         user(user_),
         password(password_),
         master_log_name(),
         master_log_pos(0),
-        connect_retry(connect_retry_)
+        connect_retry(connect_retry_),
+        heartbeat_period(heartbeat_period_),
+        checksum_verify(checksum_verify_)
         {}
 };
 
@@ -82,6 +89,38 @@ struct State {
     {}
 };
 
+// Binlog reading pipeline: the network thread reads packets into a bounded
+// queue, the decoder parses them and runs the callbacks. Times are in
+// microseconds since start. A decoder mostly idle means the network is the
+// bottleneck, a reader often waiting for a free buffer means the decoding is.
+struct PipelineStats {
+    unsigned int        queue_depth;
+    unsigned int        queue_max_depth;
+    unsigned int        queue_capacity;
+    unsigned long       packets;
+    unsigned long long  read_us;            // reader: reading packets from the socket
+    unsigned long long  read_full_us;       // reader: waiting for a free buffer
+    unsigned long long  decode_us;          // decoder: parsing events and running callbacks
+    unsigned long long  decode_idle_us;     // decoder: waiting for packets
+    unsigned long       schema_refreshes;   // decoder: table structures read again after DDL
+    unsigned long long  schema_refresh_us;  // decoder: stalled reading them
+    unsigned long long  schema_refresh_max_us;
+
+    PipelineStats() :
+        queue_depth(0),
+        queue_max_depth(0),
+        queue_capacity(0),
+        packets(0),
+        read_us(0),
+        read_full_us(0),
+        decode_us(0),
+        decode_idle_us(0),
+        schema_refreshes(0),
+        schema_refresh_us(0),
+        schema_refresh_max_us(0)
+    {}
+};
+
 struct ExtStateIface {
     virtual State getState() = 0;
     virtual void setConnecting() = 0;
@@ -95,6 +134,8 @@ struct ExtStateIface {
     virtual void setMasterLogNamePos(const std::string& log_name, unsigned long pos) = 0;
     virtual unsigned long getMasterLogPos() = 0;
     virtual std::string getMasterLogName() = 0;
+    // Same as getMasterLogName(), but reuses the buffer of 'name'
+    virtual void copyMasterLogName(std::string& name) { name = getMasterLogName(); }
 
     // Saves master info into persistent storage, i.e. file or database.
     // In case of error will try to save master info until success.
@@ -130,6 +171,16 @@ struct ExtStateIface {
     virtual void initTableCount(const std::string& t) = 0;
     virtual void incTableCount(const std::string& t) = 0;
 
+    // incTableCount() for the per row path: 'id' is what getTableCountId()
+    // gave for table 't', 'n' rows are counted at once
+    static const unsigned int NO_TABLE_COUNT_ID = ~0U;
+    virtual unsigned int getTableCountId(const std::string& t) { return NO_TABLE_COUNT_ID; }
+    virtual void addTableCount(unsigned int id, const std::string& t, unsigned int n)
+    {
+        while (n--)
+            incTableCount(t);
+    }
+
     virtual ~ExtStateIface() {}
 };
 
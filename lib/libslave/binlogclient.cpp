@@ -0,0 +1,774 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "binlogclient.h"
+
+// Capability flags
+#define CLIENT_LONG_PASSWORD     0x00000001
+#define CLIENT_LONG_FLAG         0x00000004
+#define CLIENT_PROTOCOL_41       0x00000200
+#define CLIENT_TRANSACTIONS      0x00002000
+#define CLIENT_SECURE_CONNECTION 0x00008000
+#define CLIENT_PLUGIN_AUTH       0x00080000
+
+// Commands
+#define COM_QUIT            0x01
+#define COM_QUERY           0x03
+#define COM_BINLOG_DUMP     0x12
+#define COM_REGISTER_SLAVE  0x15
+
+// Client error codes
+#define CR_CONN_HOST_ERROR          2003
+#define CR_MALFORMED_PACKET         2027
+#define CR_AUTH_PLUGIN_CANNOT_LOAD  2059
+
+#define NATIVE_PASSWORD "mysql_native_password"
+#define UTF8_GENERAL_CI 33
+#define MAX_CHUNK 0xffffff
+
+using namespace slave;
+
+namespace
+{
+
+// SHA-1 (RFC 3174), only what mysql_native_password needs
+class Sha1
+{
+    uint32_t h[5];
+    unsigned char block[64];
+    size_t used;
+    uint64_t total;
+
+    static uint32_t rol(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+
+    void transform()
+    {
+        uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+            w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+        for (int i = 16; i < 80; ++i)
+            w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i) {
+            uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);           k = 0x5a827999; }
+            else if (i < 40) { f = b ^ c ^ d;                    k = 0x6ed9eba1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d);  k = 0x8f1bbcdc; }
+            else             { f = b ^ c ^ d;                    k = 0xca62c1d6; }
+            const uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+public:
+
+    Sha1() : used(0), total(0)
+    {
+        h[0] = 0x67452301; h[1] = 0xefcdab89; h[2] = 0x98badcfe; h[3] = 0x10325476; h[4] = 0xc3d2e1f0;
+    }
+
+    void update(const std::string& s)
+    {
+        for (size_t i = 0; i < s.size(); ++i) {
+            block[used++] = s[i];
+            if (used == 64) {
+                transform();
+                used = 0;
+            }
+        }
+        total += s.size();
+    }
+
+    std::string final()
+    {
+        const uint64_t bits = total * 8;
+        std::string pad(1, '\x80');
+        pad.append((used < 56 ? 55 - used : 119 - used), '\0');
+        for (int i = 7; i >= 0; --i)
+            pad += (char)(bits >> (i * 8));
+        update(pad);
+
+        std::string digest;
+        for (int i = 0; i < 5; ++i)
+            for (int j = 3; j >= 0; --j)
+                digest += (char)(h[i] >> (j * 8));
+        return digest;
+    }
+};
+
+std::string sha1(const std::string& s)
+{
+    Sha1 ctx;
+    ctx.update(s);
+    return ctx.final();
+}
+
+// SHA1(password) XOR SHA1(scramble + SHA1(SHA1(password)))
+std::string native_password(const std::string& password, const std::string& scramble)
+{
+    if (password.empty())
+        return std::string();
+
+    const std::string stage1 = sha1(password);
+    std::string r = sha1(scramble + sha1(stage1));
+    for (size_t i = 0; i < r.size(); ++i)
+        r[i] ^= stage1[i];
+    return r;
+}
+
+void store_int(std::string& s, uint64_t v, int bytes)
+{
+    for (int i = 0; i < bytes; ++i)
+        s += (char)(v >> (i * 8));
+}
+
+void store_lenenc_str(std::string& s, const std::string& v)
+{
+    // the strings we send are short
+    s += (char)std::min<size_t>(v.size(), 250);
+    s.append(v, 0, 250);
+}
+
+}// anonymous-namespace
+
+
+BinlogClient::BinlogClient(unsigned int connect_timeout_ms, unsigned int read_timeout_ms) :
+    m_connect_timeout_ms(connect_timeout_ms),
+    m_read_timeout_ms(read_timeout_ms),
+    m_fd(-1),
+    m_epoll(-1),
+    m_cancel(-1),
+    m_events(0),
+    m_cancelled(false),
+    m_begin(0),
+    m_next(0),
+    m_end(0),
+    m_seq(0),
+    m_error(0)
+{
+    m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    m_cancel = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    struct epoll_event ev;
+    ::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = m_cancel;
+
+    if (m_epoll == -1 || m_cancel == -1 || ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_cancel, &ev) == -1) {
+        const std::string err = ::strerror(errno);
+        if (m_epoll != -1) ::close(m_epoll);
+        if (m_cancel != -1) ::close(m_cancel);
+        throw std::runtime_error("BinlogClient: could not create epoll: " + err);
+    }
+}
+
+
+BinlogClient::~BinlogClient()
+{
+    close();
+    ::close(m_epoll);
+    ::close(m_cancel);
+}
+
+
+bool BinlogClient::connect(const std::string& host, unsigned int port, const std::string& user, const std::string& password)
+{
+    close();
+
+    m_error = 0;
+    m_error_message.clear();
+    m_cancelled = false;
+    uint64_t drain;
+    while (::read(m_cancel, &drain, sizeof(drain)) > 0) {}
+
+    struct addrinfo hints, *addrs = NULL;
+    ::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    char service[16];
+    ::snprintf(service, sizeof(service), "%u", port);
+
+    const std::string where = "Can't connect to MySQL server on '" + host + ":" + service + "'";
+
+    const int gai = ::getaddrinfo(host.c_str(), service, &hints, &addrs);
+    if (gai != 0)
+        return fail(CR_CONN_HOST_ERROR, where + ": " + ::gai_strerror(gai));
+
+    std::string reason = "no addresses";
+
+    for (struct addrinfo* a = addrs; a != NULL; a = a->ai_next) {
+
+        m_fd = ::socket(a->ai_family, a->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, a->ai_protocol);
+        if (m_fd == -1) {
+            reason = ::strerror(errno);
+            continue;
+        }
+
+        struct epoll_event ev;
+        ::memset(&ev, 0, sizeof(ev));
+        ev.events = m_events = EPOLLOUT;
+        ev.data.fd = m_fd;
+        ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_fd, &ev);
+
+        int err = 0;
+        if (::connect(m_fd, a->ai_addr, a->ai_addrlen) == -1) {
+            err = errno;
+            if (err == EINPROGRESS) {
+                socklen_t err_len = sizeof(err);
+                if (!wait(true, m_connect_timeout_ms)) {
+                    ::freeaddrinfo(addrs);
+                    const std::string msg = m_error_message;
+                    close();
+                    return fail(CR_CONN_HOST_ERROR, where + ": " + msg);
+                }
+                ::getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+            }
+        }
+
+        if (err == 0)
+            break;
+
+        reason = ::strerror(err);
+        close();
+    }
+
+    ::freeaddrinfo(addrs);
+
+    if (m_fd == -1)
+        return fail(CR_CONN_HOST_ERROR, where + ": " + reason);
+
+    // Binlog events come in bulk, let the kernel buffer more of them
+    const int one = 1, rcvbuf = READ_AHEAD * 4;
+    ::setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    ::setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    if (m_buf.size() < READ_AHEAD)
+        m_buf.resize(READ_AHEAD);
+
+    if (!handshake(user, password)) {
+        const unsigned int code = m_error;
+        const std::string msg = m_error_message;
+        close();
+        return fail(code, msg);
+    }
+
+    return true;
+}
+
+
+void BinlogClient::close()
+{
+    if (m_fd != -1) {
+        // closing the descriptor removes it from the epoll set
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    m_begin = m_next = m_end = 0;
+    m_seq = 0;
+}
+
+
+bool BinlogClient::handshake(const std::string& user, const std::string& password)
+{
+    PacketView p;
+    if (!read_one(p))
+        return false;
+
+    const unsigned char* d = (const unsigned char*)p.data;
+
+    if (p.len > 0 && d[0] == 0xff)
+        return server_error(p);
+
+    if (p.len == 0 || d[0] != 10)
+        return fail(CR_MALFORMED_PACKET, "Unsupported handshake protocol version");
+
+    const char* version_end = (const char*)::memchr(p.data + 1, 0, p.len - 1);
+    if (version_end == NULL)
+        return fail(CR_MALFORMED_PACKET, "Malformed handshake packet");
+
+    m_server_version.assign(p.data + 1, version_end);
+
+    size_t pos = version_end - p.data + 1;
+
+    // connection id, scramble part 1, filler, capabilities
+    if (pos + 4 + 8 + 1 + 2 > p.len)
+        return fail(CR_MALFORMED_PACKET, "Malformed handshake packet");
+
+    pos += 4;
+    std::string scramble(p.data + pos, 8);
+    pos += 9;
+    uint32_t caps = d[pos] | d[pos + 1] << 8;
+    pos += 2;
+
+    std::string plugin = NATIVE_PASSWORD;
+
+    // charset, status, upper capabilities, scramble length, reserved
+    if (pos + 1 + 2 + 2 + 1 + 10 <= p.len) {
+        pos += 3;
+        caps |= (uint32_t)(d[pos] | d[pos + 1] << 8) << 16;
+        pos += 2;
+        const size_t scramble_len = d[pos];
+        pos += 1 + 10;
+
+        if (caps & CLIENT_SECURE_CONNECTION) {
+            size_t part2 = std::max<size_t>(13, scramble_len > 8 ? scramble_len - 8 : 0);
+            part2 = std::min(part2, p.len - pos);
+            scramble.append(p.data + pos, part2);
+            pos += part2;
+        }
+
+        if ((caps & CLIENT_PLUGIN_AUTH) && pos < p.len) {
+            const char* end = (const char*)::memchr(p.data + pos, 0, p.len - pos);
+            plugin.assign(p.data + pos, end ? end : p.data + p.len);
+        }
+    }
+
+    // the second part ends with a NUL which is not part of the scramble
+    if (scramble.size() > 20)
+        scramble.resize(20);
+
+    if (!(caps & CLIENT_PROTOCOL_41))
+        return fail(CR_MALFORMED_PACKET, "Server " + m_server_version + " does not support protocol 4.1");
+
+    const uint32_t client_caps = CLIENT_LONG_PASSWORD | CLIENT_LONG_FLAG | CLIENT_PROTOCOL_41 |
+        CLIENT_TRANSACTIONS | CLIENT_SECURE_CONNECTION | (caps & CLIENT_PLUGIN_AUTH);
+
+    // A server with another default plugin asks to switch to it, see below
+    const std::string auth = native_password(password, scramble);
+
+    std::string response;
+    store_int(response, client_caps, 4);
+    store_int(response, MAX_PACKET, 4);
+    response += (char)UTF8_GENERAL_CI;
+    response.append(23, '\0');
+    response += user;
+    response += '\0';
+    response += (char)auth.size();
+    response += auth;
+    if (client_caps & CLIENT_PLUGIN_AUTH) {
+        response += NATIVE_PASSWORD;
+        response += '\0';
+    }
+
+    if (!write_packet(response))
+        return false;
+
+    while (true) {
+
+        if (!read_one(p))
+            return false;
+
+        const unsigned char status = p.len ? p.data[0] : 0xff;
+
+        if (status == 0x00)
+            return true;
+
+        if (status == 0xff)
+            return server_error(p);
+
+        if (status != 0xfe)
+            return fail(CR_AUTH_PLUGIN_CANNOT_LOAD, "Authentication plugin '" + plugin + "' is not supported");
+
+        // Auth switch request: plugin name and a new scramble
+        const char* name_end = (const char*)::memchr(p.data + 1, 0, p.len - 1);
+        plugin.assign(p.data + 1, name_end ? name_end : p.data + p.len);
+
+        if (plugin != NATIVE_PASSWORD)
+            return fail(CR_AUTH_PLUGIN_CANNOT_LOAD, "Authentication plugin '" + plugin + "' is not supported");
+
+        scramble.clear();
+        if (name_end)
+            scramble.assign(name_end + 1, p.data + p.len);
+        if (scramble.size() > 20)
+            scramble.resize(20);
+
+        if (!write_packet(native_password(password, scramble)))
+            return false;
+    }
+}
+
+
+bool BinlogClient::query(const std::string& sql)
+{
+    return command(COM_QUERY, sql) && read_ok();
+}
+
+
+bool BinlogClient::query_value(const std::string& sql, std::string& value)
+{
+    if (!command(COM_QUERY, sql))
+        return false;
+
+    PacketView p;
+    if (!read_one(p))
+        return false;
+
+    const unsigned char status = p.len ? p.data[0] : 0xff;
+
+    if (status == 0xff)
+        return server_error(p);
+
+    if (status == 0x00)
+        return fail(CR_MALFORMED_PACKET, "Query returned no result set: " + sql);
+
+    PacketView row;
+    if (!read_until_eof(row) || !read_until_eof(row))
+        return false;
+
+    value.clear();
+
+    // Row: length-encoded strings, 0xfb is NULL
+    if (row.len == 0 || (unsigned char)row.data[0] == 0xfb)
+        return true;
+
+    const unsigned char* d = (const unsigned char*)row.data;
+    size_t len = d[0], pos = 1;
+
+    if (d[0] >= 0xfc) {
+        const size_t bytes = d[0] == 0xfc ? 2 : d[0] == 0xfd ? 3 : 8;
+        if (row.len < 1 + bytes)
+            return fail(CR_MALFORMED_PACKET, "Malformed row packet");
+        len = 0;
+        for (size_t i = 0; i < bytes; ++i)
+            len |= (size_t)d[pos++] << (i * 8);
+    }
+
+    if (pos + len > row.len)
+        return fail(CR_MALFORMED_PACKET, "Malformed row packet");
+
+    value.assign(row.data + pos, len);
+
+    return true;
+}
+
+
+bool BinlogClient::register_slave(uint32_t server_id, const std::string& report_host,
+                                  const std::string& report_user, const std::string& report_password,
+                                  uint16_t report_port)
+{
+    std::string arg;
+    store_int(arg, server_id, 4);
+    store_lenenc_str(arg, report_host);
+    store_lenenc_str(arg, report_user);
+    store_lenenc_str(arg, report_password);
+    store_int(arg, report_port, 2);
+    // replication rank, master id (filled in by the master)
+    store_int(arg, 0, 4);
+    store_int(arg, 0, 4);
+
+    return command(COM_REGISTER_SLAVE, arg) && read_ok();
+}
+
+
+bool BinlogClient::binlog_dump(const std::string& logname, uint32_t position, uint32_t server_id, uint16_t flags)
+{
+    std::string arg;
+    store_int(arg, position, 4);
+    store_int(arg, flags, 2);
+    store_int(arg, server_id, 4);
+    arg += logname;
+
+    return command(COM_BINLOG_DUMP, arg);
+}
+
+
+BinlogClient::ReadResult BinlogClient::read_packet(PacketView& packet)
+{
+    PacketView p;
+    if (!read_one(p))
+        return ReadError;
+
+    const unsigned char status = p.len ? p.data[0] : 0xff;
+
+    if (status == 0xff) {
+        server_error(p);
+        return ReadError;
+    }
+
+    if (status == 0xfe && p.len < 8)
+        return EndOfData;
+
+    packet = p;
+    return PacketOk;
+}
+
+
+void BinlogClient::quit()
+{
+    if (m_fd != -1)
+        command(COM_QUIT, std::string());
+}
+
+
+void BinlogClient::cancel()
+{
+    m_cancelled = true;
+    const uint64_t one = 1;
+    ssize_t r = ::write(m_cancel, &one, sizeof(one));
+    (void)r;
+}
+
+
+bool BinlogClient::command(unsigned char cmd, const std::string& arg)
+{
+    m_seq = 0;
+
+    std::string payload(1, (char)cmd);
+    payload += arg;
+
+    return write_packet(payload);
+}
+
+
+bool BinlogClient::read_ok()
+{
+    PacketView p;
+    if (!read_one(p))
+        return false;
+
+    const unsigned char status = p.len ? p.data[0] : 0xff;
+
+    if (status == 0x00)
+        return true;
+
+    if (status == 0xff)
+        return server_error(p);
+
+    // A result set: column definitions and rows, each list ends with EOF
+    return read_until_eof(p) && read_until_eof(p);
+}
+
+
+// Skips packets up to an EOF packet. 'first' is the first of them, empty if there were none;
+// it is copied as the view is only valid until the next read.
+bool BinlogClient::read_until_eof(PacketView& first)
+{
+    bool empty = true;
+
+    while (true) {
+
+        PacketView p;
+        if (!read_one(p))
+            return false;
+
+        const unsigned char status = p.len ? p.data[0] : 0;
+
+        if (status == 0xff)
+            return server_error(p);
+
+        if (status == 0xfe && p.len < 9)
+            break;
+
+        if (empty) {
+            m_row.assign(p.data, p.len);
+            empty = false;
+        }
+    }
+
+    if (empty)
+        m_row.clear();
+
+    first.data = m_row.data();
+    first.len = m_row.size();
+
+    return true;
+}
+
+
+bool BinlogClient::write_packet(const std::string& payload)
+{
+    if (m_fd == -1)
+        return fail(ERROR_SERVER_LOST, "Not connected to MySQL server");
+
+    // Commands are small, they fit one chunk
+    std::string buf;
+    store_int(buf, payload.size(), 3);
+    buf += (char)m_seq++;
+    buf += payload;
+
+    size_t sent = 0;
+
+    while (sent < buf.size()) {
+
+        const ssize_t r = ::send(m_fd, buf.data() + sent, buf.size() - sent, MSG_NOSIGNAL);
+
+        if (r >= 0) {
+            sent += r;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (!wait(true, m_read_timeout_ms))
+                return false;
+        } else if (errno != EINTR) {
+            return fail(ERROR_SERVER_LOST, std::string("Lost connection to MySQL server: ") + ::strerror(errno));
+        }
+    }
+
+    return true;
+}
+
+
+// One logical packet. Chunks of a split packet are moved over the headers
+// between them, so the payload is contiguous in m_buf.
+bool BinlogClient::read_one(PacketView& packet)
+{
+    if (m_cancelled)
+        return fail(ERROR_SERVER_LOST, "Lost connection to MySQL server: cancelled");
+
+    if (m_fd == -1)
+        return fail(ERROR_SERVER_LOST, "Not connected to MySQL server");
+
+    if (m_next == m_end) {
+        m_begin = m_next = m_end = 0;
+    } else {
+        m_begin = m_next;
+    }
+
+    // offsets from m_begin, fill() may move the buffered data
+    size_t header = 0;
+    size_t joined = 0;
+    size_t chunk;
+
+    do {
+        if (!fill(header + 4))
+            return false;
+
+        const unsigned char* h = (const unsigned char*)&m_buf[m_begin + header];
+        chunk = h[0] | h[1] << 8 | h[2] << 16;
+
+        if (h[3] != m_seq)
+            return fail(ERROR_SERVER_LOST, "Lost connection to MySQL server: packets out of order");
+        m_seq++;
+
+        if (joined + chunk > MAX_PACKET)
+            return fail(ERROR_PACKET_TOO_LARGE, "Got a packet bigger than 'max_allowed_packet' bytes");
+
+        if (!fill(header + 4 + chunk))
+            return false;
+
+        if (header != joined)
+            ::memmove(&m_buf[m_begin + 4 + joined], &m_buf[m_begin + header + 4], chunk);
+
+        joined += chunk;
+        header += 4 + chunk;
+
+    } while (chunk == MAX_CHUNK);
+
+    m_next = m_begin + header;
+
+    packet.data = &m_buf[m_begin + 4];
+    packet.len = joined;
+
+    return true;
+}
+
+
+// Reads until at least n bytes from m_begin are buffered
+bool BinlogClient::fill(size_t n)
+{
+    while (m_end - m_begin < n) {
+
+        if (m_buf.size() - m_begin < n) {
+            ::memmove(&m_buf[0], &m_buf[m_begin], m_end - m_begin);
+            m_end -= m_begin;
+            m_begin = 0;
+            if (m_buf.size() < n)
+                m_buf.resize(std::max(n, m_buf.size() * 2));
+        }
+
+        const ssize_t r = ::recv(m_fd, &m_buf[m_end], m_buf.size() - m_end, 0);
+
+        if (r > 0) {
+            m_end += r;
+        } else if (r == 0) {
+            return fail(ERROR_SERVER_LOST, "Lost connection to MySQL server: connection closed by server");
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (!wait(false, m_read_timeout_ms))
+                return false;
+        } else if (errno != EINTR) {
+            return fail(ERROR_SERVER_LOST, std::string("Lost connection to MySQL server: ") + ::strerror(errno));
+        }
+    }
+
+    return true;
+}
+
+
+bool BinlogClient::wait(bool for_write, unsigned int timeout_ms)
+{
+    const uint32_t events = for_write ? EPOLLOUT : EPOLLIN;
+
+    if (events != m_events) {
+        struct epoll_event ev;
+        ::memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.fd = m_fd;
+        ::epoll_ctl(m_epoll, EPOLL_CTL_MOD, m_fd, &ev);
+        m_events = events;
+    }
+
+    struct epoll_event ready[2];
+    const int n = ::epoll_wait(m_epoll, ready, 2, timeout_ms);
+
+    if (n == -1 && errno != EINTR)
+        return fail(ERROR_SERVER_LOST, std::string("Lost connection to MySQL server: ") + ::strerror(errno));
+
+    if (n == 0)
+        return fail(ERROR_SERVER_LOST, "Lost connection to MySQL server: timeout");
+
+    if (m_cancelled)
+        return fail(ERROR_SERVER_LOST, "Lost connection to MySQL server: cancelled");
+
+    return true;
+}
+
+
+bool BinlogClient::fail(unsigned int code, const std::string& message)
+{
+    m_error = code;
+    m_error_message = message;
+    return false;
+}
+
+
+// ERR packet: 0xff, code, '#' and SQL state since 4.1, message
+bool BinlogClient::server_error(const PacketView& packet)
+{
+    if (packet.len < 3)
+        return fail(CR_MALFORMED_PACKET, "Malformed error packet");
+
+    const unsigned char* d = (const unsigned char*)packet.data;
+    size_t pos = 3;
+
+    if (packet.len >= pos + 6 && d[pos] == '#')
+        pos += 6;
+
+    return fail(d[1] | d[2] << 8, std::string(packet.data + pos, packet.len - pos));
+}
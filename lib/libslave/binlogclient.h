@@ -0,0 +1,139 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_BINLOGCLIENT_H_
+#define __SLAVE_BINLOGCLIENT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace slave
+{
+
+// Client side of the MySQL replication protocol: handshake with
+// mysql_native_password, COM_QUERY, COM_REGISTER_SLAVE, COM_BINLOG_DUMP and
+// the packet framing of the binlog stream.
+//
+// The socket is non-blocking and is waited on with epoll together with an
+// eventfd, so cancel() wakes up a blocked call from any thread. Packets are
+// returned as views into the read-ahead buffer; packets over 16 MB, which
+// the server splits, are joined in place.
+//
+// Errors are reported like libmysqlclient does: the server error code, or
+// 2013 (CR_SERVER_LOST) for network errors, timeouts and cancellation.
+class BinlogClient
+{
+public:
+
+    // One binlog stream packet: the 0x00 OK byte followed by the event
+    struct PacketView
+    {
+        const char* data;
+        size_t len;
+
+        PacketView() : data(NULL), len(0) {}
+    };
+
+    enum ReadResult { PacketOk, EndOfData, ReadError };
+
+    static const unsigned int ERROR_SERVER_LOST = 2013;
+    static const unsigned int ERROR_PACKET_TOO_LARGE = 1153;
+
+    explicit BinlogClient(unsigned int connect_timeout_ms = 10000, unsigned int read_timeout_ms = 10000);
+    ~BinlogClient();
+
+    // Opens a TCP connection and authenticates. False on error.
+    bool connect(const std::string& host, unsigned int port, const std::string& user, const std::string& password);
+    void close();
+
+    // Runs a statement, the result set if any is skipped. False on error.
+    bool query(const std::string& sql);
+
+    // Runs a query and returns the first column of its first row, NULL is
+    // returned as an empty string. False on error or if there is no result set.
+    bool query_value(const std::string& sql, std::string& value);
+
+    bool register_slave(uint32_t server_id, const std::string& report_host,
+                        const std::string& report_user, const std::string& report_password,
+                        uint16_t report_port);
+
+    // Sends COM_BINLOG_DUMP, the events are read with read_packet()
+    bool binlog_dump(const std::string& logname, uint32_t position, uint32_t server_id, uint16_t flags = 0);
+
+    // The next packet of the dump. The view is valid until the next call.
+    ReadResult read_packet(PacketView& packet);
+
+    // Sends COM_QUIT and does not wait for the answer
+    void quit();
+
+    // Makes the blocked or the next call fail with ERROR_SERVER_LOST.
+    // Thread-safe, stays in effect until the next connect().
+    void cancel();
+
+    unsigned int error() const { return m_error; }
+    const std::string& error_message() const { return m_error_message; }
+    const std::string& server_version() const { return m_server_version; }
+
+private:
+
+    static const size_t READ_AHEAD = 1 << 20;
+    static const size_t MAX_PACKET = 1 << 30;
+
+    BinlogClient(const BinlogClient&);
+    BinlogClient& operator=(const BinlogClient&);
+
+    bool handshake(const std::string& user, const std::string& password);
+    bool command(unsigned char cmd, const std::string& arg);
+    bool read_ok();
+    bool read_until_eof(PacketView& first_row);
+
+    bool write_packet(const std::string& payload);
+    bool read_one(PacketView& packet);
+
+    bool fill(size_t n);
+    bool wait(bool for_write, unsigned int timeout_ms);
+
+    bool fail(unsigned int code, const std::string& message);
+    bool server_error(const PacketView& packet);
+
+    unsigned int m_connect_timeout_ms;
+    unsigned int m_read_timeout_ms;
+
+    int m_fd;
+    int m_epoll;
+    int m_cancel;
+    uint32_t m_events;
+    std::atomic<bool> m_cancelled;
+
+    std::vector<char> m_buf;
+    // Buffered bytes are [m_begin, m_end), the packet handed out last ends at m_next
+    size_t m_begin;
+    size_t m_next;
+    size_t m_end;
+    unsigned char m_seq;
+    // First row read by read_until_eof()
+    std::string m_row;
+
+    unsigned int m_error;
+    std::string m_error_message;
+    std::string m_server_version;
+};
+
+}// slave
+
+#endif
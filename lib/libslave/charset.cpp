@@ -0,0 +1,221 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <string.h>
+
+#include <map>
+#include <mutex>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "charset.h"
+
+namespace
+{
+
+// U+FFFD, what bytes the charset has no character for become
+const char REPLACEMENT[] = "\xEF\xBF\xBD";
+
+boost::shared_ptr<const slave::ByteTable> build_table(iconv_t cd)
+{
+    boost::shared_ptr<slave::ByteTable> table(new slave::ByteTable);
+
+    for (unsigned int b = 0; b < 256; ++b) {
+        char in = char(b);
+        char out[8];
+        char* src = &in;
+        char* dst = out;
+        size_t src_len = 1, dst_len = sizeof(out);
+
+        ::iconv(cd, NULL, NULL, NULL, NULL);
+        const size_t r = ::iconv(cd, &src, &src_len, &dst, &dst_len);
+        const size_t n = sizeof(out) - dst_len;
+
+        if (r == (size_t)-1 || src_len != 0 || n == 0 || n > 4) {
+            ::memcpy(table->utf8[b], REPLACEMENT, 3);
+            table->len[b] = 3;
+        } else {
+            ::memcpy(table->utf8[b], out, n);
+            table->len[b] = n;
+        }
+    }
+    return table;
+}
+
+// Tables are the same for all columns of a charset
+boost::shared_ptr<const slave::ByteTable> byte_table(const std::string& charset, iconv_t cd)
+{
+    static std::mutex lock;
+    static std::map<std::string, boost::shared_ptr<const slave::ByteTable> > tables;
+
+    std::lock_guard<std::mutex> guard(lock);
+    boost::shared_ptr<const slave::ByteTable>& table = tables[charset];
+    if (!table)
+        table = build_table(cd);
+    return table;
+}
+
+bool ascii_compatible(iconv_t cd)
+{
+    char in[127], out[127 * 4];
+    for (unsigned int i = 0; i < sizeof(in); ++i)
+        in[i] = char(i + 1);
+
+    char* src = in;
+    char* dst = out;
+    size_t src_len = sizeof(in), dst_len = sizeof(out);
+
+    ::iconv(cd, NULL, NULL, NULL, NULL);
+    const size_t r = ::iconv(cd, &src, &src_len, &dst, &dst_len);
+    return r != (size_t)-1 && sizeof(out) - dst_len == sizeof(in) && ::memcmp(in, out, sizeof(in)) == 0;
+}
+
+}// anonymous-namespace
+
+
+namespace slave
+{
+
+size_t ascii_prefix(const char* p, size_t len)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= len; i += 32) {
+        const unsigned int m = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*)(p + i)));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        const unsigned int m = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(p + i)));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+#endif
+    while (i < len && !(p[i] & 0x80))
+        ++i;
+    return i;
+}
+
+Transcoder::Transcoder(const std::string& charset, int maxlen) :
+    m_kind(Identity), m_ascii(true), m_iconv((iconv_t)-1)
+{
+    if (charset == "utf8" || charset == "UTF8" || charset == "utf8mb3" || charset == "utf8mb4")
+        return;
+
+    m_iconv = ::iconv_open("UTF8", charset.c_str());
+    if (m_iconv == (iconv_t)-1)
+        return;
+
+    m_ascii = ascii_compatible(m_iconv);
+
+    if (maxlen == 1) {
+        m_kind = SingleByte;
+        m_table = byte_table(charset, m_iconv);
+    } else {
+        m_kind = Iconv;
+    }
+}
+
+Transcoder::~Transcoder()
+{
+    if (m_iconv != (iconv_t)-1)
+        ::iconv_close(m_iconv);
+}
+
+void Transcoder::convert(const char* from, size_t len, std::string& to) const
+{
+    // Most strings are ASCII whatever the charset
+    if (m_kind == Identity || (m_ascii && ascii_prefix(from, len) == len)) {
+        to.assign(from, len);
+        return;
+    }
+
+    if (m_kind == SingleByte)
+        convert_bytes(from, len, to);
+    else
+        convert_iconv(from, len, to);
+}
+
+void Transcoder::convert_bytes(const char* from, size_t len, std::string& to) const
+{
+    // 3 bytes at most for a character, entries are copied 4 bytes at once
+    to.resize(len * 3 + 1);
+    char* out = &to[0];
+
+    const ByteTable& table = *m_table;
+    const char* end = from + len;
+
+    while (from < end) {
+        const unsigned char b = *from;
+
+        // words of Cyrillic text are short: only ASCII runs long enough are copied
+        if (b < 0x80 && m_ascii && end - from >= 16) {
+            const size_t n = ascii_prefix(from, end - from);
+            if (n >= 16) {
+                ::memcpy(out, from, n);
+                out += n;
+                from += n;
+                continue;
+            }
+        }
+
+        ::memcpy(out, table.utf8[b], 4);
+        out += table.len[b];
+        ++from;
+    }
+
+    to.resize(out - &to[0]);
+}
+
+void Transcoder::convert_iconv(const char* from, size_t len, std::string& to) const
+{
+    // A lead byte is never ASCII: the ASCII bytes the string starts with
+    // are whole characters
+    const size_t ascii = m_ascii ? ascii_prefix(from, len) : 0;
+
+    to.resize(len * 4);
+    ::memcpy(&to[0], from, ascii);
+
+    char* src = const_cast<char*>(from) + ascii;
+    size_t src_len = len - ascii;
+    char* dst = &to[0] + ascii;
+    size_t dst_len = to.size() - ascii;
+
+    ::iconv(m_iconv, NULL, NULL, NULL, NULL);
+    while (src_len > 0) {
+        if (::iconv(m_iconv, &src, &src_len, &dst, &dst_len) != (size_t)-1)
+            break;
+        if ((errno != EILSEQ && errno != EINVAL) || dst_len < 3)
+            break;
+
+        // no character for the byte, or the string ends inside of one
+        ::memcpy(dst, REPLACEMENT, 3);
+        dst += 3;
+        dst_len -= 3;
+        ++src;
+        --src_len;
+    }
+
+    to.resize(dst - &to[0]);
+}
+
+}// slave
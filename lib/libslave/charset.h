@@ -0,0 +1,71 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_CHARSET_H_
+#define __SLAVE_CHARSET_H_
+
+#include <stddef.h>
+#include <iconv.h>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace slave
+{
+
+// Length of the run of ASCII bytes 'p' starts with; checks 16 (SSE2) or
+// 32 (AVX2) bytes at a time where the compiler targets them.
+size_t ascii_prefix(const char* p, size_t len);
+
+// UTF-8 of every byte of a single-byte charset
+struct ByteTable
+{
+    char utf8[256][4];
+    unsigned char len[256];
+};
+
+// Converts the strings of one MySQL charset to UTF-8. ASCII runs are copied
+// as they are, the other bytes of single-byte charsets (latin1, cp1251,
+// koi8r...) go through a table built once per charset, multi-byte charsets
+// through iconv. Charsets iconv doesn't know, and utf8 itself, are copied.
+class Transcoder : boost::noncopyable
+{
+public:
+    // 'maxlen' -- the longest character of the charset in bytes
+    Transcoder(const std::string& charset, int maxlen);
+    ~Transcoder();
+
+    bool identity() const { return m_kind == Identity; }
+
+    // Replaces 'to' with the UTF-8 of [from, from + len); keeps the buffer
+    // of 'to' when it is big enough
+    void convert(const char* from, size_t len, std::string& to) const;
+
+private:
+    enum Kind { Identity, SingleByte, Iconv };
+
+    Kind m_kind;
+    // ASCII bytes stand for themselves
+    bool m_ascii;
+    boost::shared_ptr<const ByteTable> m_table;
+    iconv_t m_iconv;
+
+    void convert_bytes(const char* from, size_t len, std::string& to) const;
+    void convert_iconv(const char* from, size_t len, std::string& to) const;
+};
+
+}// slave
+
+#endif
@@ -0,0 +1,33 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_CRC32_H_
+#define __SLAVE_CRC32_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace slave
+{
+
+// CRC-32 of zlib (reflected polynomial 0xEDB88320), which is what MySQL puts
+// into binlog event checksums. binlog_crc32(0, buf, len) is the checksum of buf.
+//
+// Uses PCLMULQDQ folding on x86-64 CPUs that have it, slicing-by-8 otherwise
+// and for the last bytes.
+uint32_t binlog_crc32(uint32_t crc, const void* buf, size_t len);
+
+}// slave
+
+#endif
@@ -0,0 +1,298 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <ctype.h>
+#include <strings.h>
+
+#include "ddl.h"
+
+namespace slave
+{
+
+namespace
+{
+
+struct Token
+{
+    // Quoted: `name`; Other: punctuation and string literals
+    enum Kind { Word, Quoted, Other, End };
+
+    Kind kind;
+    std::string text;
+
+    Token() : kind(End) {}
+    Token(Kind k, const std::string& t) : kind(k), text(t) {}
+
+    bool is(const char* keyword) const { return kind == Word && ::strcasecmp(text.c_str(), keyword) == 0; }
+    bool is_char(char c) const { return kind == Other && text.size() == 1 && text[0] == c; }
+    bool is_name() const { return kind == Word || kind == Quoted; }
+};
+
+inline bool word_char(char c)
+{
+    return ::isalnum((unsigned char)c) || c == '_' || c == '$' || (unsigned char)c >= 0x80;
+}
+
+// Splits a statement into tokens, comments are dropped
+class Lexer
+{
+public:
+
+    explicit Lexer(const std::string& s) : m_s(s), m_pos(0) {}
+
+    Token next() {
+
+        skip_space();
+
+        if (m_pos >= m_s.size())
+            return Token();
+
+        const size_t start = m_pos;
+        const char c = m_s[m_pos];
+
+        if (word_char(c)) {
+            while (m_pos < m_s.size() && word_char(m_s[m_pos]))
+                ++m_pos;
+            return Token(Token::Word, m_s.substr(start, m_pos - start));
+        }
+
+        if (c == '`' || c == '\'' || c == '"') {
+            std::string text;
+            ++m_pos;
+            while (m_pos < m_s.size()) {
+                if (c != '`' && m_s[m_pos] == '\\' && m_pos + 1 < m_s.size()) {
+                    text += m_s[m_pos + 1];
+                    m_pos += 2;
+                } else if (m_s[m_pos] == c) {
+                    // doubled quote stands for itself
+                    if (m_pos + 1 < m_s.size() && m_s[m_pos + 1] == c) {
+                        text += c;
+                        m_pos += 2;
+                    } else {
+                        ++m_pos;
+                        break;
+                    }
+                } else {
+                    text += m_s[m_pos++];
+                }
+            }
+            return Token(c == '`' ? Token::Quoted : Token::Other, text);
+        }
+
+        ++m_pos;
+        return Token(Token::Other, std::string(1, c));
+    }
+
+private:
+
+    void skip_space() {
+
+        while (m_pos < m_s.size()) {
+
+            const char c = m_s[m_pos];
+
+            if (::isspace((unsigned char)c)) {
+                ++m_pos;
+
+            } else if (c == '/' && m_pos + 1 < m_s.size() && m_s[m_pos + 1] == '*') {
+                const size_t end = m_s.find("*/", m_pos + 2);
+                m_pos = end == std::string::npos ? m_s.size() : end + 2;
+
+            } else if (c == '#' || (c == '-' && m_s.compare(m_pos, 3, "-- ") == 0)) {
+                const size_t end = m_s.find('\n', m_pos);
+                m_pos = end == std::string::npos ? m_s.size() : end + 1;
+
+            } else {
+                break;
+            }
+        }
+    }
+
+    const std::string& m_s;
+    size_t m_pos;
+};
+
+// [db.]table starting at 'tok'; 'tok' is the token after the name on return
+bool read_name(Lexer& lex, Token& tok, const std::string& default_db, std::string& db, std::string& table)
+{
+    if (!tok.is_name())
+        return false;
+
+    table = tok.text;
+    tok = lex.next();
+
+    if (tok.is_char('.')) {
+        tok = lex.next();
+        if (!tok.is_name())
+            return false;
+        db = table;
+        table = tok.text;
+        tok = lex.next();
+    } else {
+        db = default_db;
+    }
+    return true;
+}
+
+// ALTER [ONLINE | OFFLINE] [IGNORE] TABLE name [... RENAME [TO | AS] new_name ...]
+bool parse_alter(Lexer& lex, const std::string& default_db, std::vector<DdlTable>& tables)
+{
+    Token tok = lex.next();
+    while (tok.is("ONLINE") || tok.is("OFFLINE") || tok.is("IGNORE"))
+        tok = lex.next();
+
+    if (!tok.is("TABLE"))
+        return false;
+
+    tok = lex.next();
+    std::string db, table;
+    if (!read_name(lex, tok, default_db, db, table))
+        return false;
+
+    int depth = 0;
+    while (tok.kind != Token::End) {
+
+        if (tok.is_char('(')) {
+            ++depth;
+        } else if (tok.is_char(')')) {
+            --depth;
+        } else if (depth == 0 && tok.is("RENAME")) {
+
+            tok = lex.next();
+            if (tok.is("COLUMN") || tok.is("INDEX") || tok.is("KEY"))
+                continue;
+            if (tok.is("TO") || tok.is("AS"))
+                tok = lex.next();
+
+            std::string new_db, new_table;
+            if (read_name(lex, tok, default_db, new_db, new_table)) {
+                tables.push_back(DdlTable(db, table, true));
+                tables.push_back(DdlTable(new_db, new_table, false));
+                return true;
+            }
+            continue;
+        }
+        tok = lex.next();
+    }
+
+    tables.push_back(DdlTable(db, table, false));
+    return true;
+}
+
+// CREATE [OR REPLACE] [TEMPORARY] TABLE [IF NOT EXISTS] name ...
+bool parse_create(Lexer& lex, const std::string& default_db, std::vector<DdlTable>& tables)
+{
+    Token tok = lex.next();
+    if (tok.is("OR")) {
+        if (!lex.next().is("REPLACE"))
+            return false;
+        tok = lex.next();
+    }
+
+    if (!tok.is("TABLE"))
+        return false;
+
+    tok = lex.next();
+    if (tok.is("IF")) {
+        if (!lex.next().is("NOT") || !lex.next().is("EXISTS"))
+            return false;
+        tok = lex.next();
+    }
+
+    std::string db, table;
+    if (!read_name(lex, tok, default_db, db, table))
+        return false;
+
+    tables.push_back(DdlTable(db, table, false));
+    return true;
+}
+
+// RENAME TABLE old TO new [, old TO new] ...
+bool parse_rename(Lexer& lex, const std::string& default_db, std::vector<DdlTable>& tables)
+{
+    if (!lex.next().is("TABLE"))
+        return false;
+
+    Token tok = lex.next();
+    do {
+        std::string db, table, new_db, new_table;
+        if (!read_name(lex, tok, default_db, db, table) || !tok.is("TO"))
+            return false;
+
+        tok = lex.next();
+        if (!read_name(lex, tok, default_db, new_db, new_table))
+            return false;
+
+        tables.push_back(DdlTable(db, table, true));
+        tables.push_back(DdlTable(new_db, new_table, false));
+
+    } while (tok.is_char(',') && (tok = lex.next()).kind != Token::End);
+
+    return true;
+}
+
+// DROP TABLE[S] [IF EXISTS] name [, name] ...
+bool parse_drop(Lexer& lex, const std::string& default_db, std::vector<DdlTable>& tables)
+{
+    Token tok = lex.next();
+    if (!tok.is("TABLE") && !tok.is("TABLES"))
+        return false;
+
+    tok = lex.next();
+    if (tok.is("IF")) {
+        if (!lex.next().is("EXISTS"))
+            return false;
+        tok = lex.next();
+    }
+
+    do {
+        std::string db, table;
+        if (!read_name(lex, tok, default_db, db, table))
+            return false;
+
+        tables.push_back(DdlTable(db, table, true));
+
+    } while (tok.is_char(',') && (tok = lex.next()).kind != Token::End);
+
+    return true;
+}
+
+}// anonymous-namespace
+
+
+bool parse_ddl(const std::string& query, const std::string& default_db, std::vector<DdlTable>& tables)
+{
+    tables.clear();
+
+    Lexer lex(query);
+    const Token first = lex.next();
+
+    bool ok = false;
+
+    if (first.is("ALTER"))
+        ok = parse_alter(lex, default_db, tables);
+    else if (first.is("CREATE"))
+        ok = parse_create(lex, default_db, tables);
+    else if (first.is("RENAME"))
+        ok = parse_rename(lex, default_db, tables);
+    else if (first.is("DROP"))
+        ok = parse_drop(lex, default_db, tables);
+
+    if (!ok)
+        tables.clear();
+
+    return ok && !tables.empty();
+}
+
+}// slave
@@ -0,0 +1,44 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_DDL_H_
+#define __SLAVE_DDL_H_
+
+#include <string>
+#include <vector>
+
+namespace slave
+{
+
+// A table a DDL statement changes. 'gone' -- there is no table under this
+// name afterwards (DROP TABLE, the old name of a RENAME), otherwise its
+// structure has to be read again.
+struct DdlTable
+{
+    std::string db;
+    std::string table;
+    bool gone;
+
+    DdlTable(const std::string& d, const std::string& t, bool g) : db(d), table(t), gone(g) {}
+};
+
+// Pulls the affected tables out of ALTER TABLE, CREATE TABLE, RENAME TABLE
+// and DROP TABLE statements; tables without a database get 'default_db'.
+// Temporary tables are ignored. False if the statement is none of these,
+// other queries are rejected by their first word.
+bool parse_ddl(const std::string& query, const std::string& default_db, std::vector<DdlTable>& tables);
+
+}// slave
+
+#endif
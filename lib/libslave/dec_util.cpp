@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <limits>
+
 #include "dec_util.h"
 
 #include <mysql/m_string.h>
@@ -201,6 +204,147 @@ void dec2dbl(decimal_t *from, double *to)
 }
 
 
+namespace
+{
+
+// Groups of up to 9 digits of a binary decimal, most significant first,
+// intg of them before the point
+struct Digits
+{
+    bool neg;
+    int n;
+    int intg;
+    dec1 val[(65 + DIG_PER_DEC1 - 1) / DIG_PER_DEC1 + 2];
+    int len[(65 + DIG_PER_DEC1 - 1) / DIG_PER_DEC1 + 2];
+
+    void add(dec1 v, int l) { val[n] = v; len[n] = l; ++n; }
+};
+
+// Big endian group of 'bytes' bytes; negative numbers have all their bits
+// inverted, 'mask' undoes it
+inline dec1 read_group(const unsigned char *&p, int bytes, uint32_t mask)
+{
+    uint32_t v;
+    switch (bytes) {
+    case 1: v = p[0]; break;
+    case 2: v = (uint32_t(p[0]) << 8) | p[1]; break;
+    case 3: v = (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2]; break;
+    default: v = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3]; break;
+    }
+    p += bytes;
+    return dec1((v ^ mask) & (0xFFFFFFFFU >> (32 - 8 * bytes)));
+}
+
+void read_digits(const char *from, int precision, int scale, Digits &d)
+{
+    const int intg = precision - scale,
+        intg0 = intg / DIG_PER_DEC1, frac0 = scale / DIG_PER_DEC1,
+        intg0x = intg - intg0 * DIG_PER_DEC1, frac0x = scale - frac0 * DIG_PER_DEC1;
+
+    // the sign bit is the first bit of the first group, flipped
+    const unsigned char *p = (const unsigned char *)from;
+    const uint32_t mask = (*p & 0x80) ? 0 : 0xFFFFFFFFU;
+    const int first_bytes = intg0x ? dig2bytes[intg0x] : intg0 || frac0 ? 4 : dig2bytes[frac0x];
+    const uint32_t sign = 0x80U << (8 * (first_bytes - 1));
+
+    d.neg = mask != 0;
+    d.n = 0;
+
+    if (intg0x)
+        d.add(read_group(p, dig2bytes[intg0x], mask), intg0x);
+    for (int i = 0; i < intg0; ++i)
+        d.add(read_group(p, sizeof(dec1), mask), DIG_PER_DEC1);
+    d.intg = d.n;
+    for (int i = 0; i < frac0; ++i)
+        d.add(read_group(p, sizeof(dec1), mask), DIG_PER_DEC1);
+    if (frac0x)
+        d.add(read_group(p, dig2bytes[frac0x], mask), frac0x);
+
+    if (d.n)
+        d.val[0] ^= sign;
+}
+
+} // anonymous-namespace
+
+double bin2dbl(const char *from, int precision, int scale)
+{
+    Digits d;
+    read_digits(from, precision, scale, d);
+
+    // dec2dbl() steps: the last fraction group counts as 9 digits
+    double result = 0.0;
+    int exp = 0;
+    for (int i = 0; i < d.n; ++i) {
+        if (i < d.intg) {
+            result = result * DIG_BASE + d.val[i];
+        } else {
+            result = result * DIG_BASE + d.val[i] * powers10[DIG_PER_DEC1 - d.len[i]];
+            exp += DIG_PER_DEC1;
+        }
+    }
+    result /= scaler10[exp / 10] * scaler1[exp % 10];
+
+    return d.neg ? -result : result;
+}
+
+bool bin2scaled(const char *from, int precision, int scale, int64_t *to)
+{
+    Digits d;
+    read_digits(from, precision, scale, d);
+
+    const uint64_t limit = uint64_t(std::numeric_limits<int64_t>::max()) + (d.neg ? 1 : 0);
+    uint64_t v = 0;
+    for (int i = 0; i < d.n; ++i) {
+        const uint64_t p = powers10[d.len[i]];
+        if (v > (limit - d.val[i]) / p)
+            return false;
+        v = v * p + d.val[i];
+    }
+
+    *to = d.neg ? int64_t(0 - v) : int64_t(v);
+    return true;
+}
+
+int bin2str(const char *from, int precision, int scale, char *to)
+{
+    Digits d;
+    read_digits(from, precision, scale, d);
+
+    // digits, most significant first
+    char digits[DEC_TEXT_MAX];
+    int n = 0;
+    for (int i = 0; i < d.n; ++i) {
+        dec1 v = d.val[i];
+        for (int j = d.len[i]; j-- > 0; ) {
+            digits[n + j] = char('0' + v % 10);
+            v /= 10;
+        }
+        n += d.len[i];
+    }
+
+    const int point = n - scale;
+    int lead = 0;
+    while (lead < point && digits[lead] == '0')
+        ++lead;
+
+    bool zero = true;
+    for (int i = lead; i < n && zero; ++i)
+        zero = digits[i] == '0';
+
+    char *out = to;
+    if (d.neg && !zero)
+        *out++ = '-';
+    if (lead == point)
+        *out++ = '0';
+    else
+        out = std::copy(digits + lead, digits + point, out);
+    if (scale > 0) {
+        *out++ = '.';
+        out = std::copy(digits + point, digits + n, out);
+    }
+    return int(out - to);
+}
+
 } // namespace dec_util
 
 } // namespace slave
@@ -81,6 +81,21 @@ int bin2dec(const char *from, decimal_t *to, int precision, int scale);
 // converts from internal MySql type decimal_t to double
 void dec2dbl(decimal_t *from, double *to);
 
+// Straight from the binary format, without a decimal_t in between.
+// precision and scale are those of DECIMAL(precision, scale).
+
+// The same double bin2dec() and dec2dbl() give
+double bin2dbl(const char *from, int precision, int scale);
+
+// Value times 10^scale; false if it doesn't fit into int64_t
+bool bin2scaled(const char *from, int precision, int scale, int64_t *to);
+
+// Text as MySQL prints it: no leading zeros, exactly 'scale' digits after
+// the point. 'to' must have room for DEC_TEXT_MAX characters, returns the
+// length written; no terminating zero.
+static const int DEC_TEXT_MAX = 2 + 65 + 1;
+int bin2str(const char *from, int precision, int scale, char *to);
+
 } // namespace dec_util
 
 } // namespace slave
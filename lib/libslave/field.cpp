@@ -13,7 +13,10 @@
 */
 
 
+#include <algorithm>
+#include <cerrno>
 #include <cstdio>
+#include <cstdlib>
 #include <vector>
 #include <stdexcept>
 #include <sstream>                                                                                                                
@@ -25,6 +28,7 @@
 
 #include "dec_util.h"
 #include "field.h"
+#include "types.h"
 
 #include "Logging.h"
 
@@ -202,11 +206,26 @@ const char* Field_timestamp::unpack(const char* from) {
     return from + pack_length();
 }
 
+// '2011-03-13 09:49:09' as SELECT gives DATETIME and TIMESTAMP values, to the
+// packed 20110313094909 of the binlog
+static ulonglong datetime_from_text(const std::string &from) {
+    unsigned y = 0, mo = 0, d = 0, h = 0, mi = 0, s = 0;
+    ::sscanf(from.c_str(), "%u-%u-%u %u:%u:%u", &y, &mo, &d, &h, &mi, &s);
+    return ((y * 100ULL + mo) * 100 + d) * 1000000 + (h * 100 + mi) * 100 + s;
+}
+
+// As SELECT gives it: '2011-03-13 09:49:09' of the session time zone, which
+// the dump sets to '+00:00'
 void Field_timestamp::unpacka(const std::string &from) {
-    uint32 tmp;
+    ulonglong tmp = 0;
     std::istringstream iss(from);
     iss >> tmp;
-    field_data = tmp;
+    if (iss.peek() == '-') {
+        unsigned y = 0, mo = 0, d = 0, h = 0, mi = 0, s = 0;
+        ::sscanf(from.c_str(), "%u-%u-%u %u:%u:%u", &y, &mo, &d, &h, &mi, &s);
+        tmp = y ? days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60 + s : 0;
+    }
+    field_data = uint32(tmp);
 }
 
 Field_year::Field_year(const std::string& field_name_arg, const std::string& type):
@@ -226,10 +245,7 @@ const char* Field_datetime::unpack(const char* from) {
 }
 
 void Field_datetime::unpacka(const std::string &from) {
-    ulonglong tmp;
-    std::istringstream iss(from);
-    iss >> tmp;
-    field_data = tmp;
+    field_data = datetime_from_text(from);
 }
 
 Field_date::Field_date(const std::string& field_name_arg, const std::string& type):
@@ -346,7 +362,7 @@ Field_longstr::Field_longstr(const std::string& field_name_arg, const std::strin
     Field_str(field_name_arg, type)  {}
 
 Field_varstring::Field_varstring(const std::string& field_name_arg, const std::string& type, const collate_info& collate):
-    Field_longstr(field_name_arg, type), collate_to_utf8((iconv_t)-1) {
+    Field_longstr(field_name_arg, type), to_utf8(collate.charset, collate.maxlen) {
 
     // field size is determined by string type capacity
 
@@ -366,10 +382,6 @@ Field_varstring::Field_varstring(const std::string& field_name_arg, const std::s
 
     // max length of string
     field_length = symbols;
-
-    if (collate.charset != "utf8" && collate.charset != "UTF8") {
-        collate_to_utf8 = iconv_open("UTF8", collate.charset.c_str());
-    }
 }
 
 const char* Field_varstring::unpack(const char* from) {
@@ -385,20 +397,9 @@ const char* Field_varstring::unpack(const char* from) {
         from++;
     }
 
-    if (length_row > 0 && collate_to_utf8 != (iconv_t)-1) {
-        size_t src_len = length_row;
-        size_t dst_len = length_row*3;
-        size_t dst_len_init = dst_len;
-        char * buf_utf8 = new char[dst_len];
-        char * src_buf = (char *)from;
-        char * dst_buf = buf_utf8;
-        iconv(collate_to_utf8, &src_buf, &src_len, &dst_buf, &dst_len);\
-        field_data = std::string(buf_utf8, dst_len_init-dst_len);
-        delete []buf_utf8;
-    }
-    else {
-        field_data = std::string(from, length_row);
-    }
+    std::string utf8;
+    to_utf8.convert(from, length_row, utf8);
+    field_data = utf8;
 
     LOG_TRACE(log, "  varstr: '" << boost::any_cast<std::string>(field_data) << "' // " << length_bytes << " " << length_row);
 
@@ -409,12 +410,6 @@ void Field_varstring::unpacka(const std::string &from) {
     field_data = from;
 }
 
-Field_varstring::~Field_varstring() {
-    if (collate_to_utf8 != (iconv_t)-1) {
-        iconv_close(collate_to_utf8);
-    }
-}
-
 Field_blob::Field_blob(const std::string& field_name_arg, const std::string& type):
     Field_longstr(field_name_arg, type), packlength(2) {}
 
@@ -493,7 +488,8 @@ unsigned int Field_blob::get_length(const char *pos) {
 Field_decimal::Field_decimal(const std::string& field_name_arg, const std::string& type):
     Field_longstr(field_name_arg, type),
     intg(0),
-    frac(0)
+    frac(0),
+    format(Double)
 {
     // Получаем размеры поля: decimal(M,D)
     // M - общее количество цифр, M-D - до запятой
@@ -518,24 +514,61 @@ Field_decimal::Field_decimal(const std::string& field_name_arg, const std::strin
 
 const char* Field_decimal::unpack(const char *from)
 {
-    double result = dec2double(from);
-    field_data = result;
+    FieldValue v;
+    decode(from, v);
+    field_data = v.toAny();
     return from + pack_length();
 }
 
-double Field_decimal::dec2double(const char* from)
+void Field_decimal::decode(const char* from, FieldValue& v) const
 {
-    decimal_t val;
-    val.len = intg + frac;
-    size_t bytes = val.len * sizeof(decimal_digit_t);
-    val.buf = (decimal_digit_t *)alloca(bytes);
-    memset(val.buf, 0, bytes);
+    switch (format) {
+    case Scaled:
+    {
+        int64_t scaled;
+        if (dec_util::bin2scaled(from, intg + frac, frac, &scaled)) {
+            v.setLongLong(scaled);
+            break;
+        }
+    }
+    // fall through: too big for 64 bits
+    case String:
+    {
+        char buf[dec_util::DEC_TEXT_MAX];
+        v.setString(buf, dec_util::bin2str(from, intg + frac, frac, buf));
+        break;
+    }
+    default:
+        v.setDouble(dec_util::bin2dbl(from, intg + frac, frac));
+        break;
+    }
+}
 
-    dec_util::bin2dec(from, &val, intg+frac, frac);
-    double v = 0;
-    dec_util::dec2dbl(&val, &v);
+// From the text SELECT gives, which is already the one bin2str() makes
+void Field_decimal::unpacka(const std::string &from)
+{
+    if (format == String) {
+        field_data = from;
+        return;
+    }
+
+    if (format == Scaled) {
+        // exactly 'frac' digits after the point: without it the text is the scaled value
+        std::string digits(from);
+        digits.erase(std::remove(digits.begin(), digits.end(), '.'), digits.end());
+
+        char* end = NULL;
+        errno = 0;
+        const long long scaled = ::strtoll(digits.c_str(), &end, 10);
+        if (errno == 0 && *end == '\0') {
+            field_data = scaled;
+            return;
+        }
+        field_data = from;
+        return;
+    }
 
-    return v;
+    field_data = ::strtod(from.c_str(), NULL);
 }
 
 
@@ -24,7 +24,9 @@
 
 #include <boost/any.hpp>
 
+#include "charset.h"
 #include "collate.h"
+#include "fieldvalue.h"
 
 #ifdef test
 #undef test
@@ -33,6 +35,63 @@
 namespace slave
 {
 
+// Column types in TABLE_MAP events, the same numbers as enum_field_types
+// of MySQL; the 5.6 ones are missing from older client headers
+enum Binlog_column_type
+{
+    BINLOG_TYPE_DECIMAL = 0,
+    BINLOG_TYPE_TINY = 1,
+    BINLOG_TYPE_SHORT = 2,
+    BINLOG_TYPE_LONG = 3,
+    BINLOG_TYPE_FLOAT = 4,
+    BINLOG_TYPE_DOUBLE = 5,
+    BINLOG_TYPE_NULL = 6,
+    BINLOG_TYPE_TIMESTAMP = 7,
+    BINLOG_TYPE_LONGLONG = 8,
+    BINLOG_TYPE_INT24 = 9,
+    BINLOG_TYPE_DATE = 10,
+    BINLOG_TYPE_TIME = 11,
+    BINLOG_TYPE_DATETIME = 12,
+    BINLOG_TYPE_YEAR = 13,
+    BINLOG_TYPE_NEWDATE = 14,
+    BINLOG_TYPE_VARCHAR = 15,
+    BINLOG_TYPE_BIT = 16,
+    BINLOG_TYPE_TIMESTAMP2 = 17,
+    BINLOG_TYPE_DATETIME2 = 18,
+    BINLOG_TYPE_TIME2 = 19,
+    BINLOG_TYPE_JSON = 245,
+    BINLOG_TYPE_NEWDECIMAL = 246,
+    BINLOG_TYPE_ENUM = 247,
+    BINLOG_TYPE_SET = 248,
+    BINLOG_TYPE_TINY_BLOB = 249,
+    BINLOG_TYPE_MEDIUM_BLOB = 250,
+    BINLOG_TYPE_LONG_BLOB = 251,
+    BINLOG_TYPE_BLOB = 252,
+    BINLOG_TYPE_VAR_STRING = 253,
+    BINLOG_TYPE_STRING = 254,
+    BINLOG_TYPE_GEOMETRY = 255
+};
+
+// Binary layout of a column inside a row image, see RowDecoder
+struct ColumnLayout
+{
+    // How to find the end of the value
+    enum Storage { Fixed, LengthPrefixed };
+    // How to read the value; Custom goes through Field::unpack().
+    // Datetime2, Timestamp2 and Time2 are the MySQL 5.6 temporal formats, big
+    // endian with fractional seconds; they are decoded to the values the old
+    // formats give, without the fraction. Decimal is read by Field_decimal::decode(),
+    // Transcoded are Bytes converted to UTF-8 by Field_varstring::decode().
+    enum Value { UInt, ULongLong, Int, Float, Double, BitBE, Bytes, Transcoded, Datetime2, Timestamp2, Time2, Decimal, Custom };
+
+    Storage storage;
+    Value value;
+    // Value size for Fixed storage, size of the length prefix for LengthPrefixed
+    unsigned int width;
+
+    ColumnLayout(Storage s, Value v, unsigned int w) : storage(s), value(v), width(w) {}
+};
+
 class Field
 {
 public:
@@ -53,6 +112,10 @@ public:
 
     virtual unsigned int pack_length() const = 0;
 
+    virtual ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::Custom, pack_length());
+    }
+
     const std::string getFieldType() const {
         return field_type;
     }
@@ -102,6 +165,10 @@ public:
     Field_tiny(const std::string& field_name_arg, const std::string& type);
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::UInt, 1);
+    }
 };
 
 class Field_short: public Field_num {
@@ -111,6 +178,10 @@ public:
 
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::UInt, 2);
+    }
 };
 
 class Field_medium: public Field_num {
@@ -120,6 +191,10 @@ public:
 
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::UInt, 3);
+    }
 };
 
 class Field_long: public Field_num {
@@ -129,6 +204,10 @@ public:
 
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::UInt, 4);
+    }
 };
 
 class Field_longlong: public Field_num {
@@ -138,6 +217,10 @@ public:
 
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::ULongLong, 8);
+    }
 };
 
 class Field_float: public Field_real {
@@ -147,6 +230,10 @@ public:
 
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::Float, sizeof(float));
+    }
 };
 
 class Field_double: public Field_real {
@@ -156,6 +243,10 @@ public:
 
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::Double, sizeof(double));
+    }
 };
 
 class Field_timestamp: public Field_str {
@@ -165,6 +256,10 @@ public:
 
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::UInt, 4);
+    }
 };
 
 class Field_year: public Field_tiny {
@@ -179,6 +274,10 @@ public:
 
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::UInt, 3);
+    }
 };
 
 class Field_time: public Field_str {
@@ -188,6 +287,10 @@ public:
     Field_time(const std::string& field_name_arg, const std::string& type);
 
     const char* unpack(const char* from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::UInt, 3);
+    }
 };
 
 class Field_datetime: public Field_str {
@@ -197,23 +300,36 @@ public:
 
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::ULongLong, 8);
+    }
 };
 
 class Field_varstring: public Field_longstr {
 
     // How many bytes are needed for holding the length
     unsigned int length_bytes;
-    iconv_t collate_to_utf8;
+    Transcoder to_utf8;
 
     unsigned int pack_length() const { return (unsigned int) field_length+length_bytes; }
 
 public:
     Field_varstring(const std::string& field_name_arg, const std::string& type, 
                     const collate_info& collate);
-    ~Field_varstring();
 
     const char* unpack(const char* from);
     void unpacka(const std::string &from);
+
+    // The value of 'len' bytes at 'from' in UTF-8
+    void decode(const char* from, unsigned int len, FieldValue& v) const {
+        to_utf8.convert(from, len, v.setString());
+    }
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::LengthPrefixed,
+                            to_utf8.identity() ? ColumnLayout::Bytes : ColumnLayout::Transcoded, length_bytes);
+    }
 };
 
 class Field_blob: public Field_longstr {
@@ -227,6 +343,10 @@ public:
 protected:
     // Number of bytes for holding the data length
     unsigned int packlength;
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::LengthPrefixed, ColumnLayout::Bytes, packlength);
+    }
 };
 
 class Field_tinyblob: public Field_blob {
@@ -261,6 +381,10 @@ protected:
 
     // Number of elements in enum
     unsigned short count_elements;	
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::Int, pack_length());
+    }
 };
 
 class Field_set: public Field_enum {
@@ -275,15 +399,36 @@ public:
     Field_set(const std::string& field_name_arg, const std::string& type);
 
     const char* unpack(const char* from);
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::ULongLong, pack_length());
+    }
 };
 
 class Field_decimal : public Field_longstr {
-    double dec2double(const char*);
-    int intg;
-    int frac;
 public:
+    // What a value is decoded to: the nearest double, the value times
+    // 10^scale as a 64 bit integer, or the text MySQL prints. Scaled values
+    // not fitting into 64 bits (precision above 18) are given as text.
+    enum Format { Double, Scaled, String };
+
     Field_decimal(const std::string& field_name_arg, const std::string& type);
     const char* unpack(const char *from);
+    void unpacka(const std::string &from);
+
+    void decode(const char* from, FieldValue& v) const;
+
+    void set_format(Format f) { format = f; }
+    Format get_format() const { return format; }
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::Decimal, pack_length());
+    }
+
+private:
+    int intg;
+    int frac;
+    Format format;
 };
 
 class Field_bit : public Field
@@ -298,6 +443,10 @@ public:
     unsigned int pack_length() const {
         return _pack_length;
     }
+
+    ColumnLayout layout() const {
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::BitBE, _pack_length);
+    }
 };
 
 
@@ -0,0 +1,113 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_FIELDVALUE_H_
+#define __SLAVE_FIELDVALUE_H_
+
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+#include <boost/any.hpp>
+
+namespace slave
+{
+
+// Decoded value of a single column. Numbers are stored inline and strings
+// keep their buffer between rows, so refilling a FieldValue doesn't touch
+// the heap once its capacity is warmed up.
+struct FieldValue
+{
+    enum Type { Null, Int, UInt, ULongLong, LongLong, Float, Double, String };
+
+    Type type;
+    union {
+        int32_t  i;
+        uint32_t u;
+        uint64_t ull;
+        int64_t  ll;
+        float    f;
+        double   d;
+    };
+    std::string s;
+
+    FieldValue() : type(Null), ull(0) {}
+
+    bool isNull() const { return type == Null; }
+
+    void setNull() { type = Null; }
+    void setInt(int32_t v) { type = Int; i = v; }
+    void setUInt(uint32_t v) { type = UInt; u = v; }
+    void setULongLong(uint64_t v) { type = ULongLong; ull = v; }
+    void setLongLong(int64_t v) { type = LongLong; ll = v; }
+    void setFloat(float v) { type = Float; f = v; }
+    void setDouble(double v) { type = Double; d = v; }
+    void setString(const char* p, size_t n) { type = String; s.assign(p, n); }
+    // The string to fill in place
+    std::string& setString() { type = String; return s; }
+
+    // Field::field_data compatible conversions
+    void assign(const boost::any& a)
+    {
+        if (a.empty())
+            setNull();
+        else if (a.type() == typeid(std::string))
+        {
+            const std::string& v = *boost::any_cast<std::string>(&a);
+            setString(v.data(), v.size());
+        }
+        else if (a.type() == typeid(double))
+            setDouble(boost::any_cast<double>(a));
+        else if (a.type() == typeid(float))
+            setFloat(boost::any_cast<float>(a));
+        else if (a.type() == typeid(int))
+            setInt(boost::any_cast<int>(a));
+        else if (a.type() == typeid(unsigned int))
+            setUInt(boost::any_cast<unsigned int>(a));
+        else if (a.type() == typeid(unsigned long long))
+            setULongLong(boost::any_cast<unsigned long long>(a));
+        else if (a.type() == typeid(unsigned long))
+            setULongLong(boost::any_cast<unsigned long>(a));
+        else if (a.type() == typeid(long long))
+            setLongLong(boost::any_cast<long long>(a));
+        else if (a.type() == typeid(unsigned short))
+            setUInt(boost::any_cast<unsigned short>(a));
+        else if (a.type() == typeid(unsigned char))
+            setUInt(boost::any_cast<unsigned char>(a));
+        else
+            setNull();
+    }
+
+    boost::any toAny() const
+    {
+        switch (type) {
+        case Int:       return boost::any(int(i));
+        case UInt:      return boost::any((unsigned int)u);
+        case ULongLong: return boost::any((unsigned long long)ull);
+        case LongLong:  return boost::any((long long)ll);
+        case Float:     return boost::any(f);
+        case Double:    return boost::any(d);
+        case String:    return boost::any(s);
+        default:        break;
+        }
+        return boost::any();
+    }
+};
+
+// Decoded row: one slot per requested column
+typedef std::vector<FieldValue> RowBuffer;
+
+}// slave
+
+#endif
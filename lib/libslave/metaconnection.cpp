@@ -0,0 +1,93 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mysql/errmsg.h>
+
+#include "metaconnection.h"
+#include "Logging.h"
+
+namespace slave
+{
+
+namespace
+{
+bool connection_lost(unsigned int code)
+{
+    return code == CR_SERVER_GONE_ERROR || code == CR_SERVER_LOST;
+}
+
+void query_store(const std::string& q, nanomysql::Connection::result_t& res, nanomysql::Connection& conn)
+{
+    res.clear();
+    conn.query(q);
+    conn.store(res);
+}
+}// anonymous-namespace
+
+
+void MetaConnection::connect()
+{
+    m_conn.reset();
+    m_conn.reset(new nanomysql::Connection(m_master_info.host.c_str(), m_master_info.user.c_str(),
+                                           m_master_info.password.c_str(), "", m_master_info.port));
+    ++m_connects;
+
+    LOG_DEBUG(log, "Metadata connection to " << m_master_info.host << ":" << m_master_info.port
+              << " established, " << m_connects << " so far");
+}
+
+
+void MetaConnection::run(const boost::function<void (nanomysql::Connection&)>& f)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const time_t now = ::time(NULL);
+
+    if (m_conn && now - m_last_used >= PING_IDLE_SEC && !m_conn->ping()) {
+        LOG_WARNING(log, "Metadata connection is lost, reconnecting");
+        m_conn.reset();
+    }
+
+    if (m_conn) {
+        try {
+            f(*m_conn);
+            m_last_used = now;
+            return;
+        } catch (const nanomysql::Error& e) {
+            // anything but a lost connection would fail again on a new one
+            if (!connection_lost(e.code()))
+                throw;
+            LOG_WARNING(log, "Metadata connection failed, reconnecting: " << e.what());
+        }
+    }
+
+    connect();
+    f(*m_conn);
+    m_last_used = now;
+}
+
+
+void MetaConnection::query(const std::string& q, nanomysql::Connection::result_t& res)
+{
+    run(boost::bind(query_store, boost::cref(q), boost::ref(res), _1));
+}
+
+
+void MetaConnection::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_conn.reset();
+}
+
+}// slave
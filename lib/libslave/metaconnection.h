@@ -0,0 +1,73 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_METACONNECTION_H_
+#define __SLAVE_METACONNECTION_H_
+
+#include <time.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/function.hpp>
+
+#include "nanomysql.h"
+#include "SlaveStats.h"
+
+namespace slave
+{
+
+// The one connection a Slave asks the master about its version, binlog
+// format, binlog position, slave hosts and table structures through.
+// Connects on first use and is kept afterwards, so that reconnecting to
+// the binlog does not cost a handshake per question.
+//
+// A connection idle for PING_IDLE_SEC is pinged before use, and a query
+// that lost a kept connection (CR_SERVER_GONE_ERROR, CR_SERVER_LOST) is run
+// once more on a new one: the server drops idle connections after
+// wait_timeout. Other errors are thrown right away.
+class MetaConnection
+{
+public:
+
+    static const time_t PING_IDLE_SEC = 30;
+
+    explicit MetaConnection(const MasterInfo& master_info) : m_master_info(master_info), m_last_used(0), m_connects(0) {}
+
+    // Runs 'f' on the connection. Errors of a new connection are thrown.
+    void run(const boost::function<void (nanomysql::Connection&)>& f);
+
+    void query(const std::string& q, nanomysql::Connection::result_t& res);
+
+    void close();
+
+    // Handshakes made so far
+    unsigned long connects() const { return m_connects; }
+
+private:
+
+    void connect();
+
+    const MasterInfo& m_master_info;
+
+    std::mutex m_mutex;
+    std::unique_ptr<nanomysql::Connection> m_conn;
+    time_t m_last_used;
+    unsigned long m_connects;
+};
+
+}// slave
+
+#endif
@@ -12,8 +12,10 @@ namespace nanomysql
         std::string name;
         size_t type;
         std::string data;
+        // NULL in the result set, 'data' is empty then
+        bool is_null;
 
-        field(const std::string& n, size_t t) : name(n), type(t) {}
+        field(const std::string& n, size_t t) : name(n), type(t), is_null(false) {}
 
         template <typename T>
         operator T() const
@@ -24,6 +24,15 @@
 
 namespace nanomysql {
 
+// Errors the server or the client library reported, with mysql_errno()
+class Error : public std::runtime_error {
+public:
+    Error(const std::string& msg, unsigned int code) : std::runtime_error(msg), m_code(code) {}
+    unsigned int code() const { return m_code; }
+private:
+    unsigned int m_code;
+};
+
 class Connection {
 
     MYSQL* m_conn;
@@ -45,7 +54,7 @@ class Connection {
             msg += "]";
         }
 
-        throw std::runtime_error(msg);
+        throw Error(msg, ::mysql_errno(m_conn));
     }
 
     struct _mysql_res_wrap {
@@ -100,6 +109,12 @@ public:
         close();
     }
 
+    // False if the server does not answer
+    bool ping()
+    {
+        return ::mysql_ping(m_conn) == 0;
+    }
+
     void close()
     {
         if (m_conn) {
@@ -154,6 +169,7 @@ public:
 
             for (size_t z = 0; z != num_fields; ++z) {
                 fields_n[z]->second.data.assign(row[z], lens[z]);
+                fields_n[z]->second.is_null = row[z] == NULL;
             }
 
             f(fields);
@@ -0,0 +1,155 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_PACKETQUEUE_H_
+#define __SLAVE_PACKETQUEUE_H_
+
+#include <sys/time.h>
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "SlaveStats.h"
+
+namespace slave
+{
+
+inline unsigned long long now_us()
+{
+    struct timeval tv;
+    ::gettimeofday(&tv, NULL);
+    return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// One packet read from the master. 'len' is what read_event() returned,
+// on errors 'error' and 'message' are taken from the connection.
+struct Packet
+{
+    std::string data;
+    unsigned long len;
+    unsigned int error;
+    std::string message;
+
+    Packet() : len(0), error(0) {}
+};
+
+// Bounded ring of packets between the network reader thread and the decoder.
+// The buffers are reused, so once they have grown to the usual packet size
+// reading does not allocate. One producer, one consumer: the slot being
+// filled or processed is only touched by its owner, the lock guards the
+// counters only.
+class PacketQueue
+{
+public:
+
+    explicit PacketQueue(unsigned int capacity) : m_packets(capacity), m_head(0), m_count(0), m_closed(false) {
+        m_stats.queue_capacity = capacity;
+    }
+
+    // Producer: a free slot, waits while the queue is full. NULL once closed.
+    Packet* begin_write() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_count == m_packets.size() && !m_closed) {
+            const unsigned long long start = now_us();
+            while (m_count == m_packets.size() && !m_closed)
+                m_not_full.wait(lock);
+            m_stats.read_full_us += now_us() - start;
+        }
+        return m_closed ? NULL : &m_packets[(m_head + m_count) % m_packets.size()];
+    }
+
+    // Producer: publishes the slot from begin_write(), 'read_us' is the time spent reading it
+    void end_write(unsigned long long read_us) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_count++;
+        m_stats.packets++;
+        m_stats.read_us += read_us;
+        if (m_count > m_stats.queue_max_depth)
+            m_stats.queue_max_depth = m_count;
+        m_not_empty.notify_one();
+    }
+
+    // Consumer: the oldest packet, waits up to 'timeout_ms' for one. NULL on timeout.
+    Packet* begin_read(unsigned int timeout_ms) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_count == 0) {
+            const unsigned long long start = now_us();
+            m_not_empty.wait_for(lock, std::chrono::milliseconds(timeout_ms));
+            m_stats.decode_idle_us += now_us() - start;
+        }
+        return m_count ? &m_packets[m_head] : NULL;
+    }
+
+    // Consumer: releases the packet from begin_read(), 'decode_us' is the time spent on it
+    void end_read(unsigned long long decode_us) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_head = (m_head + 1) % m_packets.size();
+        m_count--;
+        m_stats.decode_us += decode_us;
+        m_not_full.notify_one();
+    }
+
+    // Wakes up the producer, begin_write() returns NULL from now on
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_not_full.notify_one();
+    }
+
+    // Drops queued packets and opens the queue again
+    void reset() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_head = 0;
+        m_count = 0;
+        m_closed = false;
+    }
+
+    // Consumer: the stream stood still 'us' while table structures were read
+    void add_schema_refresh(unsigned long long us) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.schema_refreshes++;
+        m_stats.schema_refresh_us += us;
+        if (us > m_stats.schema_refresh_max_us)
+            m_stats.schema_refresh_max_us = us;
+    }
+
+    // queue_max_depth and schema_refresh_max_us are the maximums since the previous call
+    void get_stats(PipelineStats& stats) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        stats = m_stats;
+        stats.queue_depth = m_count;
+        m_stats.queue_max_depth = m_count;
+        m_stats.schema_refresh_max_us = 0;
+    }
+
+private:
+
+    std::vector<Packet> m_packets;
+    unsigned int m_head;
+    unsigned int m_count;
+    bool m_closed;
+
+    PipelineStats m_stats;
+
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+};
+
+}// slave
+
+#endif
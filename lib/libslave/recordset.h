@@ -16,18 +16,47 @@
 #define __SLAVE_RECORDSET_H_
 
 #include <boost/any.hpp>
+#include <boost/shared_ptr.hpp>
 #include <map>
 #include <string>
+#include <vector>
+
+#include "field.h"
+#include "fieldvalue.h"
 
 namespace slave
 {
 
-// One row in a table. Key -- field name, value - pair of (field type, value)
-typedef std::vector< std::pair<std::string, boost::any> > Row;
+// One row in a table: decoded values by slot. Without a column filter the slot
+// is the column index, otherwise the position of the column in the filter.
+// Column metadata for a slot is RecordSet::field(slot).
+typedef RowBuffer Row;
+
+// Old row format: pair of (field type, value). Built on demand by
+// RecordSet::anyRow() for code which still wants it.
+typedef std::vector< std::pair<std::string, boost::any> > AnyRow;
 
+// The libslave reuses one RecordSet per table, m_old_row is meaningful
+// for Update events only.
+//
+// With binlog_row_image=MINIMAL or NOBLOB the images carry only some of the
+// columns. m_present and m_old_present mark the slots found in m_row and
+// m_old_row, other slots are NULL. Both are empty for full images.
 struct RecordSet
 {
     Row m_row, m_old_row;
+    std::vector<bool> m_present, m_old_present;
+
+    bool partial() const { return !m_present.empty(); }
+    bool has(unsigned int slot) const { return m_present.empty() || m_present[slot]; }
+
+    // Fields of the row slots, owned by the Table
+    const std::vector< boost::shared_ptr<Field> >* fields;
+
+    const Field& field(unsigned int slot) const { return *(*fields)[slot]; }
+
+    AnyRow anyRow() const { return toAnyRow(m_row); }
+    AnyRow anyOldRow() const { return toAnyRow(m_old_row); }
 
     std::string tbl_name;
     std::string db_name;
@@ -40,7 +69,53 @@ struct RecordSet
 	 
     // Root master ID from which this record originated
     unsigned int master_id;
-    RecordSet(): master_id(0) {}
+    RecordSet(): fields(NULL), master_id(0) {}
+
+private:
+
+    AnyRow toAnyRow(const Row& row) const {
+        AnyRow res;
+        res.reserve(row.size());
+        for (unsigned int i = 0; i < row.size(); ++i) {
+            // Filter columns missing from the table have no field
+            const Field* f = (*fields)[i].get();
+            res.push_back(std::make_pair(f ? f->field_type : std::string(), row[i].toAny()));
+        }
+        return res;
+    }
+};
+
+// All rows of one rows event. Record sets are reused between events, only
+// the first size() of them belong to the current event.
+class RecordSetBatch
+{
+public:
+
+    RecordSetBatch() : m_size(0) {}
+
+    unsigned int size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const RecordSet& operator[](unsigned int i) const { return m_rows[i]; }
+
+    void clear() { m_size = 0; }
+
+    // Next free record set. A new one is copied from 'proto', which should
+    // carry the table names.
+    RecordSet& add(const RecordSet& proto) {
+        if (m_size == m_rows.size()) {
+            m_rows.push_back(proto);
+        }
+        return m_rows[m_size++];
+    }
+
+    // Drops the record set returned by the last add()
+    void drop() { --m_size; }
+
+private:
+
+    std::vector<RecordSet> m_rows;
+    unsigned int m_size;
 };
 
 }// slave
@@ -39,10 +39,19 @@ public:
     typedef std::map<std::pair<std::string, std::string>, PtrTable> name_to_table_t;
     name_to_table_t m_table_map;
 
+    // Version of the table schema the rows of a table_id are decoded with,
+    // NULL for the tables not replicated. The master gives a table a new
+    // table_id whenever its definition changes, so a table_id checked
+    // against its TABLE_MAP once stays good until the binlog is rotated
+    // (table_ids start over when the master restarts).
+    typedef std::map<unsigned long, PtrTable> id_to_table_t;
+    id_to_table_t m_table_versions;
+
 
     void clear() {
         m_map_table_name.clear();
         m_table_map.clear();
+        m_table_versions.clear();
     }
 
 
@@ -50,14 +59,16 @@ public:
         m_map_table_name[table_id] = std::make_pair(db_name, table_name);
     }
 
-    const std::pair<std::string,std::string> getTableNameById(int table_id) {
+    const std::pair<std::string,std::string>& getTableNameById(int table_id) const {
+
+        static const std::pair<std::string,std::string> empty;
 
         id_to_name_t::const_iterator p = m_map_table_name.find(table_id);
 
         if (p != m_map_table_name.end()) {
             return p->second;
         } else {
-            return std::make_pair(std::string(), std::string());
+            return empty;
         }
     }
 
@@ -77,6 +88,25 @@ public:
         m_table_map[std::make_pair(db_name, table_name)] = table;
     }
 
+    bool hasTableVersion(unsigned long table_id) const {
+        return m_table_versions.find(table_id) != m_table_versions.end();
+    }
+
+    void setTableVersion(unsigned long table_id, PtrTable table) {
+        m_table_versions[table_id] = table;
+    }
+
+    // The table version of a table_id, or the current table of its name if
+    // the TABLE_MAP has not been checked
+    PtrTable getTableById(unsigned long table_id) {
+        id_to_table_t::const_iterator p = m_table_versions.find(table_id);
+
+        if (p != m_table_versions.end()) {
+            return p->second;
+        }
+        return getTable(getTableNameById(table_id));
+    }
+
 };
 }
 #endif
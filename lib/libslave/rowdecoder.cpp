@@ -0,0 +1,538 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <mysql/my_global.h>
+#undef min
+#undef max
+
+#include "rowdecoder.h"
+#include "Logging.h"
+
+namespace slave
+{
+
+namespace
+{
+inline unsigned int read_length(const unsigned char* p, unsigned int bytes)
+{
+    switch (bytes) {
+    case 1: return p[0];
+    case 2: return uint2korr(p);
+    case 3: return uint3korr(p);
+    default: return uint4korr(p);
+    }
+}
+
+inline uint64_t read_ulonglong(const unsigned char* p, unsigned int bytes)
+{
+    switch (bytes) {
+    case 1: return p[0];
+    case 2: return uint2korr(p);
+    case 3: return uint3korr(p);
+    case 4: return uint4korr(p);
+    case 8: return uint8korr(p);
+    default: break;
+    }
+
+    uint64_t v = 0;
+    for (unsigned int i = bytes; i-- > 0; )
+        v = (v << 8) | p[i];
+    return v;
+}
+
+inline bool is_null(const unsigned char* nulls, unsigned int bit)
+{
+    return (nulls[bit >> 3] >> (bit & 7)) & 1;
+}
+
+inline uint64_t read_be(const unsigned char* p, unsigned int bytes)
+{
+    uint64_t v = 0;
+    for (unsigned int i = 0; i < bytes; ++i)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+// Layout of a column the binlog writes with 'type', for the temporal formats
+// of MySQL 5.6 the metadata is the number of fractional digits
+ColumnLayout binlog_layout(const Field& field, unsigned char type, unsigned int meta)
+{
+    const unsigned int frac = (std::min(meta, 6U) + 1) / 2;
+
+    switch (type) {
+    case BINLOG_TYPE_DATETIME2:
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::Datetime2, 5 + frac);
+    case BINLOG_TYPE_TIMESTAMP2:
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::Timestamp2, 4 + frac);
+    case BINLOG_TYPE_TIME2:
+        return ColumnLayout(ColumnLayout::Fixed, ColumnLayout::Time2, 3 + frac);
+    default:
+        break;
+    }
+    return field.layout();
+}
+
+bool fixed(const ColumnLayout& l, ColumnLayout::Value value, unsigned int width)
+{
+    return l.storage == ColumnLayout::Fixed && l.value == value && l.width == width;
+}
+
+bool prefixed(const ColumnLayout& l, unsigned int width)
+{
+    return l.storage == ColumnLayout::LengthPrefixed && l.width == width;
+}
+
+unsigned int decimal_size(unsigned int precision, unsigned int scale)
+{
+    static const unsigned int dig2bytes[] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 4};
+    const unsigned int intg = precision - std::min(precision, scale);
+    return (intg / 9) * 4 + dig2bytes[intg % 9] + (scale / 9) * 4 + dig2bytes[scale % 9];
+}
+
+// Whether a column the binlog writes with 'type' and 'meta' can be read as 'field'
+bool binlog_compatible(const Field& field, unsigned char type, unsigned int meta)
+{
+    const ColumnLayout l = field.layout();
+
+    switch (type) {
+    case BINLOG_TYPE_TINY:
+    case BINLOG_TYPE_YEAR:
+        return fixed(l, ColumnLayout::UInt, 1);
+    case BINLOG_TYPE_SHORT:
+        return fixed(l, ColumnLayout::UInt, 2);
+    case BINLOG_TYPE_INT24:
+        return fixed(l, ColumnLayout::UInt, 3) && dynamic_cast<const Field_num*>(&field) != NULL;
+    case BINLOG_TYPE_LONG:
+        return fixed(l, ColumnLayout::UInt, 4) && dynamic_cast<const Field_num*>(&field) != NULL;
+    case BINLOG_TYPE_LONGLONG:
+        return fixed(l, ColumnLayout::ULongLong, 8) && dynamic_cast<const Field_num*>(&field) != NULL;
+    case BINLOG_TYPE_FLOAT:
+        return fixed(l, ColumnLayout::Float, meta);
+    case BINLOG_TYPE_DOUBLE:
+        return fixed(l, ColumnLayout::Double, meta);
+
+    case BINLOG_TYPE_DATE:
+    case BINLOG_TYPE_NEWDATE:
+        return dynamic_cast<const Field_date*>(&field) != NULL;
+    case BINLOG_TYPE_TIME:
+    case BINLOG_TYPE_TIME2:
+        return dynamic_cast<const Field_time*>(&field) != NULL;
+    case BINLOG_TYPE_TIMESTAMP:
+    case BINLOG_TYPE_TIMESTAMP2:
+        return dynamic_cast<const Field_timestamp*>(&field) != NULL;
+    case BINLOG_TYPE_DATETIME:
+    case BINLOG_TYPE_DATETIME2:
+        return dynamic_cast<const Field_datetime*>(&field) != NULL;
+
+    case BINLOG_TYPE_VARCHAR:
+    case BINLOG_TYPE_VAR_STRING:
+        return prefixed(l, meta > 255 ? 2 : 1);
+    case BINLOG_TYPE_BLOB:
+        return prefixed(l, meta);
+    case BINLOG_TYPE_BIT:
+        return fixed(l, ColumnLayout::BitBE, (meta >> 8) + ((meta & 0xFF) ? 1 : 0));
+    case BINLOG_TYPE_NEWDECIMAL:
+        return dynamic_cast<const Field_decimal*>(&field) != NULL && l.width == decimal_size(meta >> 8, meta & 0xFF);
+
+    case BINLOG_TYPE_STRING:
+    {
+        // CHAR, ENUM and SET: the real type and the length share the metadata
+        unsigned int real_type = meta >> 8;
+        unsigned int length = meta & 0xFF;
+        if ((real_type & 0x30) != 0x30) {
+            length |= ((real_type & 0x30) ^ 0x30) << 4;
+            real_type |= 0x30;
+        }
+
+        switch (real_type) {
+        case BINLOG_TYPE_ENUM:
+            return fixed(l, ColumnLayout::Int, length);
+        case BINLOG_TYPE_SET:
+            return fixed(l, ColumnLayout::ULongLong, length);
+        default:
+            return prefixed(l, length > 255 ? 2 : 1);
+        }
+    }
+
+    default:
+        return true;
+    }
+}
+}// anonymous-namespace
+
+
+void RowDecoder::compile(const std::vector<boost::shared_ptr<Field> >& fields, const std::vector<int>& slots, unsigned int nslots,
+                         const std::vector<unsigned int>& peek_slots)
+{
+    m_columns.clear();
+    m_binlog_types.clear();
+    m_binlog_meta.clear();
+
+    m_slots = nslots;
+    m_null_bytes = (fields.size() + 7) / 8;
+
+    for (unsigned int i = 0; i < fields.size(); ++i) {
+
+        const int slot = i < slots.size() ? slots[i] : -1;
+        const bool peek = slot >= 0 && std::find(peek_slots.begin(), peek_slots.end(), (unsigned int)slot) != peek_slots.end();
+        m_columns.push_back(Column(fields[i]->layout(), slot, peek, fields[i].get()));
+    }
+
+    compile_program(m_program, All);
+    compile_program(m_peek_program, Peek);
+    compile_program(m_skip_program, None);
+
+    LOG_DEBUG(log, "RowDecoder: " << m_columns.size() << " columns compiled into " << m_program.size() << " steps");
+}
+
+
+void RowDecoder::set_binlog_types(const std::vector<unsigned char>& types, const std::vector<unsigned int>& meta)
+{
+    // A field count mismatch is reported when the rows are decoded
+    if (types.size() != m_columns.size() || meta.size() != types.size())
+        return;
+
+    if (types == m_binlog_types && meta == m_binlog_meta)
+        return;
+
+    m_binlog_types = types;
+    m_binlog_meta = meta;
+
+    for (unsigned int i = 0; i < m_columns.size(); ++i)
+        m_columns[i].layout = binlog_layout(*m_columns[i].field, types[i], meta[i]);
+
+    compile_program(m_program, All);
+    compile_program(m_peek_program, Peek);
+    compile_program(m_skip_program, None);
+
+    LOG_DEBUG(log, "RowDecoder: binlog column types changed, " << m_program.size() << " steps");
+}
+
+
+bool RowDecoder::matches(const std::vector<unsigned char>& types, const std::vector<unsigned int>& meta) const
+{
+    if (types.empty())
+        return true;
+
+    if (types.size() != m_columns.size() || meta.size() != types.size())
+        return false;
+
+    for (unsigned int i = 0; i < m_columns.size(); ++i) {
+        if (!binlog_compatible(*m_columns[i].field, types[i], meta[i]))
+            return false;
+    }
+    return true;
+}
+
+
+void RowDecoder::compile_program(std::vector<Step>& program, Want want) const
+{
+    program.clear();
+
+    for (unsigned int i = 0; i < m_columns.size(); ++i) {
+
+        const Column& col = m_columns[i];
+
+        if (wanted(col, want)) {
+            program.push_back(Step(Step::Decode, i, 1));
+
+        } else if (col.layout.storage == ColumnLayout::LengthPrefixed) {
+            program.push_back(Step(Step::SkipPrefixed, i, 1));
+
+        } else if (!program.empty() && program.back().code == Step::SkipFixed) {
+            // Glue consecutive unrequested fixed-width columns into one step
+            program.back().count++;
+
+        } else {
+            program.push_back(Step(Step::SkipFixed, i, 1));
+        }
+    }
+}
+
+
+bool RowDecoder::full_image(const std::vector<unsigned char>& cols) const
+{
+    const unsigned int n = m_columns.size();
+
+    if (cols.size() < (n + 7) / 8)
+        return false;
+
+    for (unsigned int i = 0; i < n / 8; ++i) {
+        if (cols[i] != 0xFF)
+            return false;
+    }
+
+    const unsigned int tail = n & 7;
+    return tail == 0 || (cols[n / 8] & ((1U << tail) - 1)) == ((1U << tail) - 1);
+}
+
+
+const unsigned char* RowDecoder::decode_value(const Column& col, const unsigned char* ptr, FieldValue& v) const
+{
+    const ColumnLayout& l = col.layout;
+
+    switch (l.value) {
+
+    case ColumnLayout::UInt:
+        v.setUInt(read_length(ptr, l.width));
+        return ptr + l.width;
+
+    case ColumnLayout::ULongLong:
+        v.setULongLong(read_ulonglong(ptr, l.width));
+        return ptr + l.width;
+
+    case ColumnLayout::Int:
+        v.setInt(l.width == 1 ? int32_t(int8_t(ptr[0])) : int32_t(int16_t(uint2korr(ptr))));
+        return ptr + l.width;
+
+    case ColumnLayout::Float:
+    {
+        float f;
+        ::memcpy(&f, ptr, sizeof(f));
+        v.setFloat(f);
+        return ptr + l.width;
+    }
+
+    case ColumnLayout::Double:
+    {
+        double d;
+        ::memcpy(&d, ptr, sizeof(d));
+        v.setDouble(d);
+        return ptr + l.width;
+    }
+
+    case ColumnLayout::BitBE:
+    {
+        uint64_t b = 0;
+        for (unsigned int i = 0; i < l.width; ++i)
+            b = (b << 8) | ptr[i];
+        v.setULongLong(b);
+        return ptr + l.width;
+    }
+
+    case ColumnLayout::Bytes:
+    {
+        const unsigned int len = read_length(ptr, l.width);
+        ptr += l.width;
+        v.setString((const char*)ptr, len);
+        return ptr + len;
+    }
+
+    case ColumnLayout::Transcoded:
+    {
+        const unsigned int len = read_length(ptr, l.width);
+        ptr += l.width;
+        static_cast<const Field_varstring*>(col.field)->decode((const char*)ptr, len, v);
+        return ptr + len;
+    }
+
+    case ColumnLayout::Datetime2:
+    {
+        // 1 bit sign (always set), 17 bits year*13+month, 5 bits day,
+        // 5 bits hour, 6 bits minute, 6 bits second
+        const uint64_t packed = read_be(ptr, 5) - 0x8000000000ULL;
+        const uint64_t ymd = packed >> 17;
+        const uint64_t ym = ymd >> 5;
+        const uint64_t hms = packed & 0x1FFFF;
+        v.setULongLong((ym / 13) * 10000000000ULL + (ym % 13) * 100000000ULL + (ymd & 31) * 1000000ULL +
+                       (hms >> 12) * 10000 + ((hms >> 6) & 63) * 100 + (hms & 63));
+        return ptr + l.width;
+    }
+
+    case ColumnLayout::Timestamp2:
+        v.setUInt(uint32_t(read_be(ptr, 4)));
+        return ptr + l.width;
+
+    case ColumnLayout::Time2:
+    {
+        // 1 bit sign, 1 bit unused, 10 bits hour, 6 bits minute, 6 bits
+        // second; a negative time with a fraction is stored as the next
+        // integer below it
+        int64_t packed = int64_t(read_be(ptr, 3)) - 0x800000;
+        if (packed < 0 && l.width > 3 && read_be(ptr + 3, l.width - 3) != 0)
+            ++packed;
+        const bool neg = packed < 0;
+        const uint64_t hms = neg ? -packed : packed;
+        const int32_t hhmmss = int32_t(((hms >> 12) & 1023) * 10000 + ((hms >> 6) & 63) * 100 + (hms & 63));
+        // The old format is a little endian 3 byte integer, read unsigned
+        v.setUInt(uint32_t(neg ? -hhmmss : hhmmss) & 0xFFFFFF);
+        return ptr + l.width;
+    }
+
+    case ColumnLayout::Decimal:
+        static_cast<const Field_decimal*>(col.field)->decode((const char*)ptr, v);
+        return ptr + l.width;
+
+    default:
+        break;
+    }
+
+    ptr = (const unsigned char*)col.field->unpack((const char*)ptr);
+    v.assign(col.field->field_data);
+    return ptr;
+}
+
+
+const unsigned char* RowDecoder::skip_value(const Column& col, const unsigned char* ptr) const
+{
+    if (col.layout.storage == ColumnLayout::LengthPrefixed)
+        return ptr + col.layout.width + read_length(ptr, col.layout.width);
+
+    return ptr + col.layout.width;
+}
+
+
+const unsigned char* RowDecoder::decode(const unsigned char* row, const std::vector<unsigned char>& cols, RowBuffer& out) const
+{
+    out.resize(m_slots);
+    return run(m_program, All, row, cols, out);
+}
+
+
+const unsigned char* RowDecoder::peek(const unsigned char* row, const std::vector<unsigned char>& cols, RowBuffer& out) const
+{
+    out.resize(m_slots);
+    return run(m_peek_program, Peek, row, cols, out);
+}
+
+
+const unsigned char* RowDecoder::skip(const unsigned char* row, const std::vector<unsigned char>& cols) const
+{
+    // Nothing is written to the row by the skip program
+    RowBuffer none;
+    return run(m_skip_program, None, row, cols, none);
+}
+
+
+bool RowDecoder::has_peek_columns(const std::vector<unsigned char>& cols) const
+{
+    if (full_image(cols))
+        return true;
+
+    for (unsigned int i = 0; i < m_columns.size(); ++i) {
+        if (wanted(m_columns[i], Peek) && !(i / 8 < cols.size() && (cols[i / 8] & (1 << (i & 7)))))
+            return false;
+    }
+    return true;
+}
+
+
+void RowDecoder::present(const std::vector<unsigned char>& cols, std::vector<bool>& out) const
+{
+    if (full_image(cols)) {
+        out.clear();
+        return;
+    }
+
+    out.assign(m_slots, false);
+    for (unsigned int i = 0; i < m_columns.size(); ++i) {
+        if (m_columns[i].slot >= 0 && i / 8 < cols.size() && (cols[i / 8] & (1 << (i & 7))))
+            out[m_columns[i].slot] = true;
+    }
+}
+
+
+const unsigned char* RowDecoder::run(const std::vector<Step>& program, Want want,
+                                     const unsigned char* row, const std::vector<unsigned char>& cols, RowBuffer& out) const
+{
+    if (!full_image(cols))
+        return decode_sparse(want, row, cols, out);
+
+    // With a full image there is a null bit for every column, so the null bit
+    // of the column is at its own index
+    const unsigned char* nulls = row;
+    const unsigned char* ptr = row + m_null_bytes;
+
+    for (std::vector<Step>::const_iterator s = program.begin(); s != program.end(); ++s) {
+
+        if (s->code == Step::SkipFixed) {
+
+            for (unsigned int i = s->first, e = s->first + s->count; i != e; ++i) {
+                ptr += m_columns[i].layout.width & (0U - !is_null(nulls, i));
+            }
+            continue;
+        }
+
+        const Column& col = m_columns[s->first];
+
+        if (s->code == Step::SkipPrefixed) {
+
+            if (!is_null(nulls, s->first))
+                ptr = skip_value(col, ptr);
+            continue;
+        }
+
+        FieldValue& v = out[col.slot];
+
+        if (is_null(nulls, s->first)) {
+            v.setNull();
+            continue;
+        }
+
+        ptr = decode_value(col, ptr, v);
+    }
+
+    return ptr;
+}
+
+
+const unsigned char* RowDecoder::decode_sparse(Want want, const unsigned char* row, const std::vector<unsigned char>& cols, RowBuffer& out) const
+{
+    unsigned int present = 0;
+    for (unsigned int i = 0; i < m_columns.size(); ++i) {
+        if (cols[i / 8] & (1 << (i & 7)))
+            present++;
+    }
+
+    const unsigned char* nulls = row;
+    const unsigned char* ptr = row + (present + 7) / 8;
+    unsigned int null_bit = 0;
+
+    for (unsigned int i = 0; i < m_columns.size(); ++i) {
+
+        const Column& col = m_columns[i];
+        const bool decode = wanted(col, want);
+
+        if (!(cols[i / 8] & (1 << (i & 7)))) {
+            if (decode)
+                out[col.slot].setNull();
+            continue;
+        }
+
+        const bool null = is_null(nulls, null_bit++);
+
+        if (!decode) {
+            if (!null)
+                ptr = skip_value(col, ptr);
+            continue;
+        }
+
+        FieldValue& v = out[col.slot];
+
+        if (null) {
+            v.setNull();
+            continue;
+        }
+
+        ptr = decode_value(col, ptr, v);
+    }
+
+    return ptr;
+}
+
+}// slave
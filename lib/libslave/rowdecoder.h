@@ -0,0 +1,134 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_ROWDECODER_H_
+#define __SLAVE_ROWDECODER_H_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "field.h"
+#include "fieldvalue.h"
+
+namespace slave
+{
+
+// Decode program for the row images of one table.
+//
+// The program is compiled once from the table schema and the column filter:
+// runs of fixed-width columns nobody asked for collapse into a single skip
+// step, other unrequested columns are skipped by their length prefix without
+// copying the value, requested columns are read straight into their RowBuffer slot without
+// going through the virtual Field::unpack() and boost::any. Only columns with
+// Custom layout (charset conversion) still call the Field.
+class RowDecoder
+{
+public:
+
+    RowDecoder() : m_slots(0), m_null_bytes(0) {}
+
+    // slots[i] -- output slot of column i, or -1 if the column is not requested
+    // peek_slots -- the slots peek() decodes
+    void compile(const std::vector<boost::shared_ptr<Field> >& fields, const std::vector<int>& slots, unsigned int nslots,
+                 const std::vector<unsigned int>& peek_slots = std::vector<unsigned int>());
+
+    // Number of slots in the output row
+    unsigned int slots() const { return m_slots; }
+
+    // Column types and metadata of the TABLE_MAP event. The schema tells
+    // nothing about how the master writes temporal columns: tables created
+    // by MySQL 5.6 use the datetime2/timestamp2/time2 formats, older ones
+    // don't. Recompiles the program when the types change.
+    void set_binlog_types(const std::vector<unsigned char>& types, const std::vector<unsigned int>& meta);
+
+    // True if the columns the program was compiled from can read the rows
+    // of a TABLE_MAP event with these column types and metadata: same number
+    // of columns, same widths and kinds. Types it knows nothing about, and
+    // table maps without column types, are taken on trust.
+    bool matches(const std::vector<unsigned char>& types, const std::vector<unsigned int>& meta) const;
+
+    // Decodes one row image starting at 'row', returns pointer past the image.
+    // 'cols' is the column bitmap of the rows event.
+    const unsigned char* decode(const unsigned char* row, const std::vector<unsigned char>& cols, RowBuffer& out) const;
+
+    // Like decode(), but only the peek slots are filled in
+    const unsigned char* peek(const unsigned char* row, const std::vector<unsigned char>& cols, RowBuffer& out) const;
+
+    // Returns pointer past the row image without decoding anything
+    const unsigned char* skip(const unsigned char* row, const std::vector<unsigned char>& cols) const;
+
+    // True if all the columns peek() decodes are present in an image with column bitmap 'cols'
+    bool has_peek_columns(const std::vector<unsigned char>& cols) const;
+
+    // Marks the slots carried by an image with column bitmap 'cols'. A full
+    // image leaves 'out' empty, there every slot is present.
+    void present(const std::vector<unsigned char>& cols, std::vector<bool>& out) const;
+
+private:
+
+    // Which requested columns a program decodes
+    enum Want { All, Peek, None };
+
+    struct Column
+    {
+        ColumnLayout layout;
+        int slot;
+        bool peek;
+        Field* field;
+
+        Column(const ColumnLayout& l, int s, bool p, Field* f) : layout(l), slot(s), peek(p), field(f) {}
+    };
+
+    struct Step
+    {
+        enum Code { SkipFixed, SkipPrefixed, Decode };
+
+        Code code;
+        unsigned int first;
+        unsigned int count;
+
+        Step(Code c, unsigned int f, unsigned int n) : code(c), first(f), count(n) {}
+    };
+
+    std::vector<Column> m_columns;
+    std::vector<Step> m_program;
+    std::vector<Step> m_peek_program;
+    std::vector<Step> m_skip_program;
+    unsigned int m_slots;
+    unsigned int m_null_bytes;
+
+    // What set_binlog_types() was last called with
+    std::vector<unsigned char> m_binlog_types;
+    std::vector<unsigned int> m_binlog_meta;
+
+    static bool wanted(const Column& col, Want want) { return col.slot >= 0 && (want == All || (want == Peek && col.peek)); }
+
+    void compile_program(std::vector<Step>& program, Want want) const;
+
+    const unsigned char* run(const std::vector<Step>& program, Want want,
+                             const unsigned char* row, const std::vector<unsigned char>& cols, RowBuffer& out) const;
+
+    bool full_image(const std::vector<unsigned char>& cols) const;
+
+    const unsigned char* decode_value(const Column& col, const unsigned char* ptr, FieldValue& v) const;
+
+    const unsigned char* skip_value(const Column& col, const unsigned char* ptr) const;
+
+    const unsigned char* decode_sparse(Want want, const unsigned char* row, const std::vector<unsigned char>& cols, RowBuffer& out) const;
+};
+
+}// slave
+
+#endif
@@ -16,7 +16,10 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <algorithm>
 #include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <mysql/my_global.h>
 #undef min
@@ -29,6 +32,7 @@
 
 #include "SlaveStats.h"
 #include "Logging.h"
+#include "crc32.h"
 
 #include "mysqlcompat.h"
 
@@ -76,12 +80,14 @@ Query_event_info::Query_event_info(const char* buf, unsigned int event_len) {
         ::abort();
     }
 
-    unsigned int db_len = (unsigned int)buf[LOG_EVENT_HEADER_LEN + Q_DB_LEN_OFFSET];
+    unsigned int db_len = (unsigned char)buf[LOG_EVENT_HEADER_LEN + Q_DB_LEN_OFFSET];
 
     unsigned int status_vars_len = uint2korr(buf + LOG_EVENT_HEADER_LEN + Q_STATUS_VARS_LEN_OFFSET);
 
     size_t data_len = event_len - (LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN) - status_vars_len;
 
+    db.assign(buf + LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN + status_vars_len, db_len);
+
     query.assign(buf + LOG_EVENT_HEADER_LEN + QUERY_HEADER_LEN + status_vars_len + db_len + 1,
                  data_len - db_len - 1);
 }
@@ -105,20 +111,106 @@ Table_map_event_info::Table_map_event_info(const char* buf, unsigned int event_l
     size_t tblen = *(p_tblen);
 
     m_tblnam.assign((const char*)(p_tblen + 1), tblen);
+
+    // Column types and their metadata follow the names
+    unsigned char* p = p_tblen + tblen + 2;
+    const unsigned char* end = (const unsigned char*)buf + event_len;
+
+    if (p >= end)
+        return;
+
+    const unsigned long width = mysql_net_field_length(&p);
+
+    if (p + width >= end) {
+        LOG_ERROR(log, "Sanity check failed: table map of " << m_dbnam << "." << m_tblnam << " has no column types");
+        return;
+    }
+
+    m_column_types.assign(p, p + width);
+    p += width;
+
+    const unsigned long meta_len = mysql_net_field_length(&p);
+    const unsigned char* meta_end = p + meta_len;
+
+    if (meta_end > end) {
+        LOG_ERROR(log, "Sanity check failed: table map of " << m_dbnam << "." << m_tblnam << " has no column metadata");
+        m_column_types.clear();
+        return;
+    }
+
+    m_column_meta.assign(width, 0);
+
+    for (unsigned long i = 0; i < width && p < meta_end; ++i) {
+
+        switch (m_column_types[i]) {
+
+        case BINLOG_TYPE_FLOAT:
+        case BINLOG_TYPE_DOUBLE:
+        case BINLOG_TYPE_TINY_BLOB:
+        case BINLOG_TYPE_MEDIUM_BLOB:
+        case BINLOG_TYPE_LONG_BLOB:
+        case BINLOG_TYPE_BLOB:
+        case BINLOG_TYPE_GEOMETRY:
+        case BINLOG_TYPE_JSON:
+        case BINLOG_TYPE_TIMESTAMP2:
+        case BINLOG_TYPE_DATETIME2:
+        case BINLOG_TYPE_TIME2:
+            m_column_meta[i] = p[0];
+            p += 1;
+            break;
+
+        case BINLOG_TYPE_VARCHAR:
+        case BINLOG_TYPE_BIT:
+            m_column_meta[i] = uint2korr(p);
+            p += 2;
+            break;
+
+        case BINLOG_TYPE_NEWDECIMAL:
+        case BINLOG_TYPE_STRING:
+        case BINLOG_TYPE_VAR_STRING:
+        case BINLOG_TYPE_ENUM:
+        case BINLOG_TYPE_SET:
+            m_column_meta[i] = (p[0] << 8) | p[1];
+            p += 2;
+            break;
+
+        default:
+            break;
+        }
+    }
 }
 
 Row_event_info::Row_event_info(const char* buf, unsigned int event_len, bool do_update) {
 
-    if (event_len < LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN + 2) {
-        LOG_ERROR(log, "Sanity check failed: " << event_len << " " << LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN + 2);
+    const Log_event_type type = (Log_event_type)buf[EVENT_TYPE_OFFSET];
+    const bool v2 = type >= WRITE_ROWS_EVENT_V2 && type <= DELETE_ROWS_EVENT_V2;
+    const unsigned int header_len = v2 ? ROWS_HEADER_LEN_V2 : ROWS_HEADER_LEN;
+
+    if (event_len < LOG_EVENT_HEADER_LEN + header_len + 2) {
+        LOG_ERROR(log, "Sanity check failed: " << event_len << " " << LOG_EVENT_HEADER_LEN + header_len + 2);
         ::abort();
     }
 
+    m_type = v2 ? Log_event_type(type - WRITE_ROWS_EVENT_V2 + WRITE_ROWS_EVENT) : type;
+
     has_after_image = do_update;
 
     m_table_id = uint6korr(buf + LOG_EVENT_HEADER_LEN + RW_MAPID_OFFSET);
 
-    unsigned char* start = (unsigned char*)(buf + LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN);
+    unsigned char* start = (unsigned char*)(buf + LOG_EVENT_HEADER_LEN + header_len);
+
+    // v2: extra row data, its length includes the length field
+    if (v2) {
+
+        const unsigned int extra_len = uint2korr(buf + LOG_EVENT_HEADER_LEN + RW_VHLEN_OFFSET);
+
+        if (extra_len < 2 || event_len < LOG_EVENT_HEADER_LEN + header_len + extra_len) {
+            LOG_ERROR(log, "Sanity check failed: rows event extra data " << extra_len << ", event length " << event_len);
+            ::abort();
+        }
+
+        start += extra_len - 2;
+    }
 
     m_width = mysql_net_field_length(&start);
 
@@ -151,7 +243,27 @@ inline void check_format_description_postlen(unsigned char* b, slave::Log_event_
 }
 
 
-inline void check_format_description(const char* buf, unsigned int event_len) {
+// Format description events of MySQL 5.6.1 and later end with the checksum
+// algorithm of the binlog and a checksum, whatever the algorithm is
+inline bool has_checksum_alg(const char* buf) {
+
+    const char* version = buf + LOG_EVENT_MINIMAL_HEADER_LEN + ST_SERVER_VER_OFFSET;
+    const std::string v(version, ::strnlen(version, ST_SERVER_VER_LEN));
+
+    unsigned int major = 0, minor = 0, patch = 0;
+    ::sscanf(v.c_str(), "%u.%u.%u", &major, &minor, &patch);
+
+    return major * 10000 + minor * 100 + patch >= 50601;
+}
+
+
+// Returns the checksum algorithm of the binlog
+inline Binlog_checksum_alg check_format_description(const char* buf, unsigned int event_len) {
+
+    const bool with_alg = has_checksum_alg(buf);
+    const Binlog_checksum_alg alg = with_alg ?
+        (Binlog_checksum_alg)(unsigned char)buf[event_len - BINLOG_CHECKSUM_LEN - BINLOG_CHECKSUM_ALG_DESC_LEN] :
+        BINLOG_CHECKSUM_ALG_OFF;
 
     buf += LOG_EVENT_MINIMAL_HEADER_LEN;
 
@@ -172,21 +284,15 @@ inline void check_format_description(const char* buf, unsigned int event_len) {
         ::abort();
     }
 
-    // Check that binlog contains different event types not more than we know
-    // If less - it's ok, backward compatibility
+    // Newer servers have more event types than we know, their events are skipped
     const size_t number_of_event_types =
-        event_len - (LOG_EVENT_MINIMAL_HEADER_LEN + ST_COMMON_HEADER_LEN_OFFSET + 1);
-
-    if (number_of_event_types > LOG_EVENT_TYPES)
-    {
-        LOG_ERROR(log, "Invalid Format_description event: number_of_event_types " << number_of_event_types
-                  << " > " << LOG_EVENT_TYPES);
-        ::abort();
-    }
+        event_len - (LOG_EVENT_MINIMAL_HEADER_LEN + ST_COMMON_HEADER_LEN_OFFSET + 1) -
+        (with_alg ? BINLOG_CHECKSUM_ALG_DESC_LEN + BINLOG_CHECKSUM_LEN : 0);
 
     unsigned char event_lens[LOG_EVENT_TYPES] = { 0, };
 
-    ::memcpy(&event_lens[0], (unsigned char*)(buf + ST_COMMON_HEADER_LEN_OFFSET + 1), LOG_EVENT_TYPES);
+    ::memcpy(&event_lens[0], (unsigned char*)(buf + ST_COMMON_HEADER_LEN_OFFSET + 1),
+             std::min<size_t>(number_of_event_types, LOG_EVENT_TYPES));
 
     check_format_description_postlen(event_lens, XID_EVENT, 0);
     check_format_description_postlen(event_lens, QUERY_EVENT, QUERY_HEADER_LEN);
@@ -197,10 +303,39 @@ inline void check_format_description(const char* buf, unsigned int event_len) {
     check_format_description_postlen(event_lens, UPDATE_ROWS_EVENT, ROWS_HEADER_LEN);
     check_format_description_postlen(event_lens, DELETE_ROWS_EVENT, ROWS_HEADER_LEN);
 
+    return alg;
+}
+
+
+// The checksum is the last BINLOG_CHECKSUM_LEN bytes of the event and covers the rest of it
+inline void strip_checksum(Basic_event_info& bei, bool verify) {
+
+    if (bei.event_len < LOG_EVENT_HEADER_LEN + BINLOG_CHECKSUM_LEN) {
+        LOG_ERROR(log, "Sanity check failed: " << bei.event_len << " " << LOG_EVENT_HEADER_LEN + BINLOG_CHECKSUM_LEN);
+        ::abort();
+    }
+
+    bei.event_len -= BINLOG_CHECKSUM_LEN;
+
+    if (!verify)
+        return;
+
+    const uint32_t expected = uint4korr(bei.buf + bei.event_len);
+    const uint32_t actual = binlog_crc32(0, bei.buf, bei.event_len);
+
+    if (expected != actual) {
+
+        char msg[160];
+        ::snprintf(msg, sizeof(msg), "Binlog event checksum mismatch: type %d, log_pos %lu, %08x != %08x",
+                   (int)bei.type, (unsigned long)bei.log_pos, actual, expected);
+
+        LOG_ERROR(log, msg);
+        throw Checksum_error(msg);
+    }
 }
 
 
-bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei)
+bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, Binlog_checksum& checksum)
 
 {
 
@@ -210,7 +345,6 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei)
     /* Check the integrity */
 
     if (event_len < EVENT_LEN_OFFSET ||
-        bei.type >= ENUM_END_EVENT ||
         (uint) event_len != uint4korr(buf+EVENT_LEN_OFFSET))
     {
         LOG_ERROR(log, "Sanity check failed: " << event_len);
@@ -220,11 +354,20 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei)
     switch (bei.type) {
 
     case FORMAT_DESCRIPTION_EVENT:
+    {
+        const Binlog_checksum_alg alg = check_format_description(buf, event_len);
+
+        if (has_checksum_alg(buf))
+            strip_checksum(bei, checksum.verify && alg == BINLOG_CHECKSUM_ALG_CRC32);
 
-        check_format_description(buf, event_len);
+        if (alg != checksum.alg) {
+            LOG_INFO(log, "Binlog checksum algorithm: " << (int)alg);
+            checksum.alg = alg;
+        }
 
         return true;
         break;
+    }
 
     case QUERY_EVENT:
     case ROTATE_EVENT:
@@ -232,7 +375,14 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei)
     case WRITE_ROWS_EVENT:
     case UPDATE_ROWS_EVENT:
     case DELETE_ROWS_EVENT:
+    case WRITE_ROWS_EVENT_V2:
+    case UPDATE_ROWS_EVENT_V2:
+    case DELETE_ROWS_EVENT_V2:
     case TABLE_MAP_EVENT:
+
+        if (checksum.alg == BINLOG_CHECKSUM_ALG_CRC32)
+            strip_checksum(bei, checksum.verify);
+
         return true;
         break;
 
@@ -255,11 +405,17 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei)
     case EXECUTE_LOAD_QUERY_EVENT:
     case INCIDENT_EVENT:
     case HEARTBEAT_LOG_EVENT:
+    case IGNORABLE_LOG_EVENT:
+    case ROWS_QUERY_LOG_EVENT:
+    case GTID_LOG_EVENT:
+    case ANONYMOUS_GTID_LOG_EVENT:
+    case PREVIOUS_GTIDS_LOG_EVENT:
         return false;
         break;
 
     default:
-        LOG_ERROR( log, "Unknown event code: " << (int) bei.type);
+        // event types of newer servers
+        LOG_TRACE(log, "Unknown event code: " << (int) bei.type);
         return false;
         break;
     }
@@ -280,31 +436,25 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei)
  *
  */
 
-
-size_t n_set_bits(const std::vector<unsigned char>& b, unsigned int count) {
-
-    size_t ret = 0;
-
-    for (unsigned int i = 0; i < count; ++i) {
-
-        if (b[i / 8] & (1 << (i & 7)))
-            ret++;
-    }
-
-    return ret;
-}
+// What the row filter says about a row
+enum RowFilterResult
+{
+    FilterPass,     // row goes to the callback as is
+    FilterSkip,     // row is dropped
+    FilterEnter,    // update moved the row into the filtered set, sent as Write
+    FilterExit      // update moved the row out of the filtered set, sent as Delete
+};
 
 
 unsigned char* unpack_row(boost::shared_ptr<slave::Table> table,
                           slave::Row& _row,
+                          std::vector<bool>& present,
                           unsigned int colcnt,
                           unsigned char* row,
-                          const std::vector<unsigned char>& cols,
-                          const std::vector<unsigned char>& cols_ai)
+                          const std::vector<unsigned char>& cols)
 {
 
-    LOG_TRACE(log, "Unpacking row: " << table->fields.size() << "," << colcnt << "," << cols.size()
-              << "," << cols_ai.size());
+    LOG_TRACE(log, "Unpacking row: " << table->fields.size() << "," << colcnt << "," << cols.size());
 
     if (colcnt != table->fields.size()) {
         LOG_ERROR(log, "Field count mismatch in unpacking row for "
@@ -312,149 +462,187 @@ unsigned char* unpack_row(boost::shared_ptr<slave::Table> table,
         return NULL;
     }
 
+    table->decoder.present(cols, present);
+    return (unsigned char*)table->decoder.decode(row, cols, _row);
+}
 
-    // pointer to start of data; skip master_null_bytes
 
-    size_t master_null_byte_count = (n_set_bits(cols, colcnt) + 7) / 8;
+unsigned char* do_writedelete_row(boost::shared_ptr<slave::Table> table,
+                                  const Basic_event_info& bei,
+                                  const Row_event_info& roi, 
+                                  unsigned char* row_start,
+                                  slave::RecordSet& _record_set) {
 
-    unsigned char* ptr = row + master_null_byte_count;
+    unsigned char* t = unpack_row(table, _record_set.m_row, _record_set.m_present, roi.m_width, row_start, roi.m_cols);
 
-    //
-    unsigned char* null_ptr = row;
-    unsigned int null_mask = 1U;
-    unsigned char null_bits = *null_ptr++;
-
-    bool all_fields = table->filter.empty();
-    const std::vector<unsigned char> &filter = table->filter;
-    if (all_fields) {
-        _row.reserve(colcnt);
-    } 
-    else {
-        _row.resize(table->n_filter_count);
+    if (t == NULL) {
+        return NULL;
+    }
+
+    _record_set.when = bei.when;
+    _record_set.fields = &table->row_fields;
+    _record_set.type_event = (roi.m_type == WRITE_ROWS_EVENT ? slave::RecordSet::Write : slave::RecordSet::Delete);
+    _record_set.master_id = bei.server_id;
+
+    // binlog_row_image=MINIMAL: the columns the insert did not set have their DEFAULT
+    if (roi.m_type == WRITE_ROWS_EVENT && _record_set.partial()) {
+        table->fill_defaults(_record_set);
     }
 
-    for (unsigned i = 0; i < colcnt; i++) {
+    table->rows_decoded++;
 
-        slave::PtrField field = table->fields[i];
+    return t;
+}
 
-        if (!(cols[i / 8] & (1 << (i & 7)))) {
+unsigned char* do_update_row(boost::shared_ptr<slave::Table> table,
+                             const Basic_event_info& bei,
+                             const Row_event_info& roi, 
+                             unsigned char* row_start,
+                             slave::RecordSet& _record_set,
+                             RowFilterResult filter) {
 
-            LOG_TRACE(log, "field " << field->getFieldName() << " is not in column list.");
-            continue;
-        }
+    unsigned char* t;
 
-        if (!cols_ai.empty() && !(cols_ai[i / 8] & (1 << (i & 7)))) {
+    _record_set.type_event = slave::RecordSet::Update;
 
-            LOG_TRACE(log, "field " << field->getFieldName() << " is not in the update after-image.");
-            continue;
-        }
+    if (filter == FilterExit) {
 
-        if ((null_mask & 0xFF) == 0) {
-            null_mask = 1U;
-            null_bits = *null_ptr++;
+        // The row left the filtered set: it is deleted by its before image
+        t = unpack_row(table, _record_set.m_row, _record_set.m_present, roi.m_width, row_start, roi.m_cols);
 
-            LOG_TRACE(log, "null mask reset.");
+        if (t == NULL) {
+            return NULL;
         }
 
-        if (null_bits & null_mask) {
+        t = (unsigned char*)table->decoder.skip(t, roi.m_cols_ai);
+        _record_set.type_event = slave::RecordSet::Delete;
 
-            LOG_TRACE(log, "set_null found");
+    } else if (filter == FilterEnter) {
 
-            if (all_fields) {
-                _row.push_back(std::make_pair(field->field_type, boost::any()));
-            } else if (filter[i / 8] & (1 << (i & 7))) {
-                _row[table->filter_fields[i]] = std::make_pair(field->field_type, boost::any());
-            }
+        // The row entered the filtered set: it is inserted by its after image
+        t = (unsigned char*)table->decoder.skip(row_start, roi.m_cols);
+        t = unpack_row(table, _record_set.m_row, _record_set.m_present, roi.m_width, t, roi.m_cols_ai);
 
-        } else {
+        if (t == NULL) {
+            return NULL;
+        }
 
-            // We only unpack the field if it was non-null
+        _record_set.type_event = slave::RecordSet::Write;
 
-            ptr = (unsigned char*)field->unpack((const char*)ptr);
+    } else {
 
-            if (all_fields) {
-                _row.push_back(std::make_pair(field->field_type, field->field_data));
-            } else if (filter[i / 8] & (1 << (i & 7))) {
-                _row[table->filter_fields[i]] = std::make_pair(field->field_type, field->field_data);
-            }
+        t = unpack_row(table, _record_set.m_old_row, _record_set.m_old_present, roi.m_width, row_start, roi.m_cols);
 
+        if (t == NULL) {
+            return NULL;
         }
 
-        null_mask <<= 1;
-
-        LOG_TRACE(log, "field: " << field->getFieldName());
+        t = unpack_row(table, _record_set.m_row, _record_set.m_present, roi.m_width, t, roi.m_cols_ai);
 
+        if (t == NULL) {
+            return NULL;
+        }
     }
 
-    return ptr;
-}
+    _record_set.when = bei.when;
+    _record_set.fields = &table->row_fields;
+    _record_set.master_id = bei.server_id;
 
+    table->rows_decoded++;
 
-unsigned char* do_writedelete_row(boost::shared_ptr<slave::Table> table,
-                                  const Basic_event_info& bei,
-                                  const Row_event_info& roi, 
-                                  unsigned char* row_start,
-                                  ExtStateIface &ext_state) {
+    return t;
+}
 
-    slave::RecordSet _record_set;
+// Checks the row filter of the table decoding only the filter columns.
+// On FilterSkip 'end' points past the row.
+//
+// Updates are checked on both images, so that a row moving out of the
+// filtered set is deleted and a row moving into it is inserted. A before
+// image without the filter columns (binlog_row_image=MINIMAL) tells nothing,
+// then only the after image counts. Columns missing from the after image
+// were not changed and are taken from the before image. A row whose filter
+// columns are in neither image passes: the writer is left to find out.
+RowFilterResult filter_row(boost::shared_ptr<slave::Table> table,
+                           const Basic_event_info& bei,
+                           const Row_event_info& roi,
+                           unsigned char* row_start,
+                           slave::RecordSet& buf,
+                           unsigned char*& end) {
+
+    // Field count mismatch is reported by unpack_row()
+    if (!table->row_filter || roi.m_width != table->fields.size()) {
+        return FilterPass;
+    }
 
-    unsigned char* t = unpack_row(table, _record_set.m_row, roi.m_width, row_start, roi.m_cols, roi.m_cols_ai);
+    if (roi.m_type != UPDATE_ROWS_EVENT) {
 
-    if (t == NULL) {
-        return NULL;
-    }
+        if (!table->decoder.has_peek_columns(roi.m_cols)) {
+            return FilterPass;
+        }
 
-    _record_set.when = bei.when;
-    _record_set.tbl_name = table->table_name;
-    _record_set.db_name = table->database_name;
-    _record_set.type_event = (bei.type == WRITE_ROWS_EVENT ? slave::RecordSet::Write : slave::RecordSet::Delete);
-    _record_set.master_id = bei.server_id;
+        end = (unsigned char*)table->decoder.peek(row_start, roi.m_cols, buf.m_row);
 
-    table->call_callback(_record_set, ext_state);
+        if (table->row_filter(buf.m_row)) {
+            return FilterPass;
+        }
 
-    return t;
-}
+        table->rows_skipped++;
+        return FilterSkip;
+    }
 
-unsigned char* do_update_row(boost::shared_ptr<slave::Table> table,
-                             const Basic_event_info& bei,
-                             const Row_event_info& roi, 
-                             unsigned char* row_start,
-                             ExtStateIface &ext_state) {
+    const unsigned char* after = table->decoder.peek(row_start, roi.m_cols, buf.m_old_row);
+    end = (unsigned char*)table->decoder.peek(after, roi.m_cols_ai, buf.m_row);
 
-    slave::RecordSet _record_set;
+    const bool old_known = table->decoder.has_peek_columns(roi.m_cols);
 
-    unsigned char* t = unpack_row(table, _record_set.m_old_row, roi.m_width, row_start, roi.m_cols, roi.m_cols_ai);
+    if (!table->decoder.has_peek_columns(roi.m_cols_ai)) {
 
-    if (t == NULL) {
-        return NULL;
+        if (!old_known) {
+            return FilterPass;
+        }
+
+        table->decoder.present(roi.m_cols_ai, buf.m_present);
+        for (unsigned int i = 0; i < buf.m_present.size(); ++i) {
+            if (!buf.m_present[i]) {
+                buf.m_row[i] = buf.m_old_row[i];
+            }
+        }
     }
 
-    t = unpack_row(table, _record_set.m_row, roi.m_width, t, roi.m_cols, roi.m_cols_ai);
+    const bool new_pass = table->row_filter(buf.m_row);
+    const bool old_pass = old_known ? table->row_filter(buf.m_old_row) : new_pass;
 
-    if (t == NULL) {
-        return NULL;
+    if (old_pass == new_pass) {
+        if (new_pass) {
+            return FilterPass;
+        }
+        table->rows_skipped++;
+        return FilterSkip;
     }
 
-    _record_set.when = bei.when;
-    _record_set.tbl_name = table->table_name;
-    _record_set.db_name = table->database_name;
-    _record_set.type_event = slave::RecordSet::Update;
-    _record_set.master_id = bei.server_id;
+    return new_pass ? FilterEnter : FilterExit;
+}
 
-    table->call_callback(_record_set, ext_state);
+unsigned char* do_row(boost::shared_ptr<slave::Table> table,
+                      const Basic_event_info& bei,
+                      const Row_event_info& roi, 
+                      unsigned char* row_start,
+                      slave::RecordSet& _record_set,
+                      RowFilterResult filter) {
 
-    return t;
+    if (roi.m_type == UPDATE_ROWS_EVENT) {
+        return do_update_row(table, bei, roi, row_start, _record_set, filter);
+    }
+    return do_writedelete_row(table, bei, roi, row_start, _record_set);
 }
 
 
 void apply_row_event(slave::RelayLogInfo& rli, const Basic_event_info& bei, const Row_event_info& roi, ExtStateIface &ext_state) {
 
 
-    std::pair<std::string,std::string> key = rli.getTableNameById(roi.m_table_id);
-
-    LOG_DEBUG(log, "applyRowEvent(): " << roi.m_table_id << " " << key.first << "." << key.second);
+    LOG_DEBUG(log, "applyRowEvent(): " << roi.m_table_id);
 
-    boost::shared_ptr<slave::Table> table = rli.getTable(key);
+    boost::shared_ptr<slave::Table> table = rli.getTableById(roi.m_table_id);
 
     if (table) {
 
@@ -463,15 +651,46 @@ void apply_row_event(slave::RelayLogInfo& rli, const Basic_event_info& bei, cons
 
         unsigned char* row_start = roi.m_rows_buf;
 
+        if (table->m_batch_callback) {
+
+            // Decode the whole event first, then hand it over at once
+            table->batch.clear();
+
+            while (row_start < roi.m_rows_end &&
+                   row_start != NULL) {
+
+                unsigned char* end;
+                const RowFilterResult filter = filter_row(table, bei, roi, row_start, table->record_set, end);
+                if (filter == FilterSkip) {
+                    row_start = end;
+                    continue;
+                }
+
+                row_start = do_row(table, bei, roi, row_start, table->batch.add(table->record_set), filter);
+
+                if (row_start == NULL) {
+                    table->batch.drop();
+                }
+            }
+
+            table->call_batch_callback(ext_state);
+            return;
+        }
+
         while (row_start < roi.m_rows_end &&
                row_start != NULL) {
 
-            if (bei.type == UPDATE_ROWS_EVENT) {
+            unsigned char* end;
+            const RowFilterResult filter = filter_row(table, bei, roi, row_start, table->record_set, end);
+            if (filter == FilterSkip) {
+                row_start = end;
+                continue;
+            }
 
-                row_start = do_update_row(table, bei, roi, row_start, ext_state);
+            row_start = do_row(table, bei, roi, row_start, table->record_set, filter);
 
-            } else {
-                row_start = do_writedelete_row(table, bei, roi, row_start, ext_state);
+            if (row_start != NULL) {
+                table->call_callback(table->record_set, ext_state);
             }
         }
     }
@@ -17,6 +17,8 @@
 #define __SLAVE_SLAVE_LOG_EVENT_H
 
 
+#include <stdexcept>
+
 #include "relayloginfo.h"
 
 
@@ -65,6 +67,18 @@ enum Log_event_type
 
   HEARTBEAT_LOG_EVENT= 27,
 
+  /* MySQL 5.6 */
+  IGNORABLE_LOG_EVENT= 28,
+  ROWS_QUERY_LOG_EVENT= 29,
+
+  WRITE_ROWS_EVENT_V2 = 30,
+  UPDATE_ROWS_EVENT_V2 = 31,
+  DELETE_ROWS_EVENT_V2 = 32,
+
+  GTID_LOG_EVENT= 33,
+  ANONYMOUS_GTID_LOG_EVENT= 34,
+  PREVIOUS_GTIDS_LOG_EVENT= 35,
+
   ENUM_END_EVENT
 };
 
@@ -91,7 +105,9 @@ enum Log_event_type
 
 #define ROWS_HEADER_LEN        8
 #define RW_MAPID_OFFSET    0
-#define ROWS_HEADER_LEN        8
+#define ROWS_HEADER_LEN_V2     10
+#define RW_FLAGS_OFFSET    6
+#define RW_VHLEN_OFFSET    8
 
 #define LOG_EVENT_MINIMAL_HEADER_LEN 19
 
@@ -104,6 +120,44 @@ enum Log_event_type
 
 #define START_V3_HEADER_LEN     (2 + ST_SERVER_VER_LEN + 4)
 
+#define BINLOG_CHECKSUM_LEN          4
+#define BINLOG_CHECKSUM_ALG_DESC_LEN 1
+
+
+enum Binlog_checksum_alg
+{
+  BINLOG_CHECKSUM_ALG_OFF = 0,
+  BINLOG_CHECKSUM_ALG_CRC32 = 1,
+  BINLOG_CHECKSUM_ALG_UNDEF = 255
+};
+
+// Checksums of the events of a binlog stream. Starts with the algorithm
+// negotiated for the connection, format description events switch it to the
+// one their binlog file is written with.
+struct Binlog_checksum {
+
+    Binlog_checksum_alg alg;
+    // false: trust the network, the checksums are only stripped
+    bool verify;
+
+    Binlog_checksum() : alg(BINLOG_CHECKSUM_ALG_OFF), verify(true) {}
+};
+
+// An event does not match its checksum
+class Checksum_error : public std::runtime_error
+{
+public:
+    explicit Checksum_error(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+// The structure of a replicated table does not match its table map, its rows
+// can not be decoded
+class Table_map_error : public std::runtime_error
+{
+public:
+    explicit Table_map_error(const std::string& msg) : std::runtime_error(msg) {}
+};
+
 
 //-----------------------------------------------------------------------------------------
 
@@ -135,6 +189,8 @@ struct Rotate_event_info {
 struct Query_event_info {
 
     std::string query;
+    // Default database of the statement
+    std::string db;
 
     Query_event_info(const char* buf, unsigned int event_len);
 };
@@ -145,11 +201,20 @@ struct Table_map_event_info {
     std::string m_tblnam;
     std::string m_dbnam;
 
+    // Column types as the binlog has them (BINLOG_TYPE_*) and their metadata
+    std::vector<unsigned char> m_column_types;
+    std::vector<unsigned int> m_column_meta;
+
     Table_map_event_info(const char* buf, unsigned int event_len);
 };
 
+// Rows events of both versions: v2 (MySQL 5.6) has a longer post header
+// with extra data, the rest is the same
 struct Row_event_info {
 
+    // WRITE_ROWS_EVENT, UPDATE_ROWS_EVENT or DELETE_ROWS_EVENT, for v2 events too
+    Log_event_type m_type;
+
     unsigned long m_width;
     unsigned long m_table_id;
 
@@ -165,7 +230,9 @@ struct Row_event_info {
 };
 
 
-bool read_log_event(const char* buf, unsigned int event_len, Basic_event_info& info);
+// Checks the event, verifies and strips its checksum: info.event_len does not
+// include it. False for the events libslave does not handle.
+bool read_log_event(const char* buf, unsigned int event_len, Basic_event_info& info, Binlog_checksum& checksum);
 
 void apply_row_event(slave::RelayLogInfo& rli, const Basic_event_info& bei, const Row_event_info& roi, ExtStateIface &ext_state);
 
@@ -25,7 +25,9 @@
 
 #include "field.h"
 #include "recordset.h"
+#include "rowdecoder.h"
 #include "SlaveStats.h"
+#include "Logging.h"
 
 
 namespace slave
@@ -33,6 +35,21 @@ namespace slave
 
 typedef boost::shared_ptr<Field> PtrField;
 typedef boost::function<void (RecordSet&)> callback;
+typedef boost::function<void (const RecordSetBatch&)> batch_callback;
+typedef boost::function<bool (const RowBuffer&)> row_predicate;
+
+
+// DEFAULT of a column: none known, NULL, or 'text' as the master prints it
+struct ColumnDefault
+{
+    enum Kind { None, Null, Value };
+
+    Kind kind;
+    std::string text;
+
+    ColumnDefault() : kind(None) {}
+    ColumnDefault(Kind k, const std::string& t = "") : kind(k), text(t) {}
+};
 
 
 class Table {
@@ -44,22 +61,72 @@ public:
     std::vector<unsigned> filter_fields;
     unsigned n_filter_count;
 
+    RowDecoder decoder;
+    // Field of every slot of the decoded row, see RecordSet::fields
+    std::vector<PtrField> row_fields;
+
+    // Reused for every row of the table, so the row buffers keep their
+    // capacity between rows
+    RecordSet record_set;
+
+    // Rows of the current rows event, when the table has a batch callback
+    RecordSetBatch batch;
+
     callback m_callback;
+    batch_callback m_batch_callback;
+
+    // Rows not passing row_filter are skipped right after the values of
+    // row_filter_slots are decoded, callbacks don't see them
+    std::vector<unsigned> row_filter_slots;
+    row_predicate row_filter;
+
+    // Rows passed to callbacks and rows dropped by row_filter
+    unsigned long rows_decoded;
+    unsigned long rows_skipped;
+
+    // Values of the slots a Write row image leaves out, see set_default()
+    RowBuffer defaults;
+    std::vector<bool> has_default;
 
     void call_callback(slave::RecordSet& _rs, ExtStateIface &ext_state) {
 
         // Some stats
-        ext_state.incTableCount(full_name);
+        ext_state.addTableCount(count_id, full_name, 1);
         ext_state.setLastFilteredUpdateTime();
 
         m_callback(_rs);
     }
 
+    void call_batch_callback(ExtStateIface &ext_state) {
+
+        if (batch.empty()) {
+            return;
+        }
+
+        // Some stats
+        ext_state.addTableCount(count_id, full_name, batch.size());
+        ext_state.setLastFilteredUpdateTime();
+
+        m_batch_callback(batch);
+    }
+
     void set_callback_filter(const std::vector<std::string> &_filter) {
+        // the slots change, set_default() is called again
+        defaults.clear();
+        has_default.clear();
+
         if (_filter.empty()) {
             filter.clear();
             filter_fields.clear();
             n_filter_count = 0;
+
+            std::vector<int> slots(fields.size());
+            for (unsigned i = 0; i < slots.size(); i++) {
+                slots[i] = i;
+            }
+            check_row_filter(fields.size());
+            decoder.compile(fields, slots, fields.size(), row_filter_slots);
+            row_fields = fields;
             return;
         }
 
@@ -85,6 +152,68 @@ public:
                 }
             }
         }
+
+        std::vector<int> slots(fields.size(), -1);
+        for (unsigned i = 0; i < slots.size(); i++) {
+            if (filter[i / 8] & (1 << (i & 7))) {
+                slots[i] = filter_fields[i];
+            }
+        }
+        check_row_filter(n_filter_count);
+        decoder.compile(fields, slots, n_filter_count, row_filter_slots);
+
+        row_fields.assign(n_filter_count, PtrField());
+        for (unsigned i = 0; i < slots.size(); i++) {
+            if (slots[i] >= 0) {
+                row_fields[slots[i]] = fields[i];
+            }
+        }
+    }
+
+    // Should be called before set_callback_filter()
+    void set_row_filter(const std::vector<unsigned>& slots, row_predicate pred) {
+        row_filter_slots = slots;
+        row_filter = pred;
+    }
+
+    // With binlog_row_image=MINIMAL an insert carries only the columns the
+    // statement set, the others got their DEFAULT on the master. Gives the
+    // value Write rows get for the column when their image leaves it out.
+    // Should be called after set_callback_filter() and the decimal formats:
+    // the value is read the way Field::unpacka() reads it. Types without
+    // unpacka() (enum, set, bit, time) and year have no default here.
+    void set_default(unsigned column, const ColumnDefault& def) {
+        if (column >= fields.size()) {
+            return;
+        }
+        defaults.resize(row_fields.size());
+        has_default.resize(row_fields.size(), false);
+
+        Field& field = *fields[column];
+        for (unsigned slot = 0; slot < row_fields.size(); slot++) {
+            if (row_fields[slot] != fields[column]) {
+                continue;
+            }
+            defaults[slot].setNull();
+            has_default[slot] = def.kind == ColumnDefault::Null;
+
+            if (def.kind == ColumnDefault::Value && !dynamic_cast<Field_year*>(&field)) {
+                field.field_data = boost::any();
+                field.unpacka(def.text);
+                has_default[slot] = !field.field_data.empty();
+                defaults[slot].assign(field.field_data);
+            }
+        }
+    }
+
+    // Fills the slots a partial Write row image left out with their defaults
+    void fill_defaults(RecordSet& rs) const {
+        for (unsigned slot = 0; slot < rs.m_present.size() && slot < has_default.size(); slot++) {
+            if (!rs.m_present[slot] && has_default[slot]) {
+                rs.m_row[slot] = defaults[slot];
+                rs.m_present[slot] = true;
+            }
+        }
     }
 
     const std::string table_name;
@@ -92,15 +221,36 @@ public:
 
     std::string full_name;
     std::string pk_field;
+    // ExtStateIface::getTableCountId() of full_name
+    unsigned int count_id;
 
     Table(const std::string& db_name, const std::string& tbl_name) :
         n_filter_count(0),
+        rows_decoded(0), rows_skipped(0),
         table_name(tbl_name), database_name(db_name),
         full_name(database_name + "." + table_name),
-        pk_field("")
-        {}
+        pk_field(""),
+        count_id(ExtStateIface::NO_TABLE_COUNT_ID)
+        {
+            record_set.tbl_name = table_name;
+            record_set.db_name = database_name;
+        }
 
-    Table() {}
+    Table() : n_filter_count(0), rows_decoded(0), rows_skipped(0), count_id(ExtStateIface::NO_TABLE_COUNT_ID) {}
+
+private:
+
+    void check_row_filter(unsigned nslots) {
+        for (unsigned i = 0; row_filter && i < row_filter_slots.size(); i++) {
+            if (row_filter_slots[i] >= nslots) {
+                LOG_ERROR(log, "Row filter column " << row_filter_slots[i] << " is out of range for " << full_name << ", filter disabled");
+                row_filter.clear();
+            }
+        }
+        if (!row_filter) {
+            row_filter_slots.clear();
+        }
+    }
 
 };
 
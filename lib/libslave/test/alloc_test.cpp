@@ -0,0 +1,168 @@
+
+// Checks that applying rows events to a warmed up table does not touch the heap.
+// Builds the table and the events in memory, no MySQL server is needed.
+
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <new>
+
+#include "Slave.h"
+#include "binlog_events.h"
+#include "test_util.h"
+
+static bool counting = false;
+static unsigned long allocations = 0;
+
+void* operator new(size_t size)
+{
+    if (counting)
+        ++allocations;
+
+    void* p = ::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) throw()
+{
+    ::free(p);
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void* p) throw()
+{
+    operator delete(p);
+}
+
+
+namespace
+{
+
+using namespace slave_test;
+
+const unsigned long TABLE_ID = 42;
+const unsigned ROWS = 100;
+const unsigned RUNS = 1000;
+
+unsigned long rows_seen = 0;
+
+void callback(const slave::RecordSet& rs)
+{
+    ++rows_seen;
+}
+
+void batch_callback(const slave::RecordSetBatch& batch)
+{
+    rows_seen += batch.size();
+}
+
+void put_row(std::string& buf, unsigned id, const std::string& name, const std::string& text)
+{
+    buf += '\0';                                    // null bitmap
+    buf.append((const char*)&id, 4);                // int
+    buf += char(name.size());                       // varchar(64)
+    buf += name;
+    unsigned short len = text.size();               // text
+    buf.append((const char*)&len, 2);
+    buf += text;
+    unsigned long long big = id * 1000ULL;          // bigint
+    buf.append((const char*)&big, 8);
+    buf.append(2, '\0');                            // smallint
+}
+
+// Rows event: common header, post header, column count and bitmap(s), rows
+std::string make_event(slave::Log_event_type type, unsigned rows)
+{
+    const bool update = type == slave::UPDATE_ROWS_EVENT;
+
+    std::string buf = rows_header(type, TABLE_ID);
+
+    buf += char(5);
+    buf += char(0x1f);
+    if (update)
+        buf += char(0x1f);
+
+    for (unsigned i = 0; i < rows; ++i) {
+        put_row(buf, i, "some rather long name " + std::string(i % 7, 'x'), std::string(100 + i % 13, 't'));
+        if (update)
+            put_row(buf, i, "the other name " + std::string(i % 5, 'y'), std::string(120 + i % 11, 'u'));
+    }
+
+    return buf;
+}
+
+bool check(const char* what, const std::vector<std::string>& filter, slave::Log_event_type type, bool batch = false)
+{
+    slave::collate_info ci;
+    ci.charset = "utf8";
+    ci.maxlen = 3;
+
+    slave::PtrTable table(new slave::Table("db", "t"));
+    table->fields.push_back(slave::PtrField(new slave::Field_long("id", "int(11)")));
+    table->fields.push_back(slave::PtrField(new slave::Field_varstring("name", "varchar(64)", ci)));
+    table->fields.push_back(slave::PtrField(new slave::Field_blob("descr", "text")));
+    table->fields.push_back(slave::PtrField(new slave::Field_longlong("big", "bigint(20)")));
+    table->fields.push_back(slave::PtrField(new slave::Field_short("small", "smallint(6)")));
+    if (batch)
+        table->m_batch_callback = batch_callback;
+    else
+        table->m_callback = callback;
+    table->set_callback_filter(filter);
+
+    slave::RelayLogInfo rli;
+    rli.setTableName(TABLE_ID, "t", "db");
+    rli.setTable("t", "db", table);
+
+    slave::EmptyExtState ext_state;
+
+    const std::string ev = make_event(type, ROWS);
+
+    slave::Basic_event_info bei;
+    bei.parse(ev.data(), ev.size());
+    slave::Row_event_info roi(ev.data(), ev.size(), type == slave::UPDATE_ROWS_EVENT);
+
+    // Warm up: the row buffers reach their capacity
+    slave::apply_row_event(rli, bei, roi, ext_state);
+
+    rows_seen = 0;
+    allocations = 0;
+    counting = true;
+
+    for (unsigned i = 0; i < RUNS; ++i)
+        slave::apply_row_event(rli, bei, roi, ext_state);
+
+    counting = false;
+
+    const bool ok = allocations == 0 && rows_seen == ROWS * RUNS;
+    std::cout << (ok ? "OK   " : "FAIL ") << what << ": " << rows_seen << " rows, "
+              << allocations << " allocations" << std::endl;
+    return ok;
+}
+
+}// anonymous-namespace
+
+
+int main()
+{
+    std::vector<std::string> all;
+    std::vector<std::string> some;
+    some.push_back("big");
+    some.push_back("name");
+
+    Checks checks;
+    checks.add(check("insert, all columns", all, slave::WRITE_ROWS_EVENT));
+    checks.add(check("insert, filtered columns", some, slave::WRITE_ROWS_EVENT));
+    checks.add(check("update, all columns", all, slave::UPDATE_ROWS_EVENT));
+    checks.add(check("update, filtered columns", some, slave::UPDATE_ROWS_EVENT));
+    checks.add(check("delete, filtered columns", some, slave::DELETE_ROWS_EVENT));
+    checks.add(check("insert batch, all columns", all, slave::WRITE_ROWS_EVENT, true));
+    checks.add(check("update batch, filtered columns", some, slave::UPDATE_ROWS_EVENT, true));
+
+    return checks.exit_code();
+}
@@ -0,0 +1,373 @@
+// Checks the native binlog client against a stand-in master on localhost.
+//
+//   binlog_client_test
+//       the stand-in serves a generated stream: small events, events of
+//       exactly 16 MB - 1 and of 40 MB, which need several chunks, in
+//       random sized writes; then cancellation and a server error
+//   binlog_client_test --replay FILE
+//       the stand-in serves a stream recorded with --record
+//   binlog_client_test HOST PORT USER PASSWORD BINLOG POS [--record FILE]
+//       reads a real master from BINLOG:POS up to its current end
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+#include "binlogclient.h"
+#include "test_util.h"
+
+namespace
+{
+
+using namespace slave_test;
+
+const unsigned int BINLOG_DUMP_NON_BLOCK = 1;
+const size_t MAX_CHUNK = 0xffffff;
+
+// Frames a payload like the server does: a packet of exactly N * 16 MB - N
+// bytes is followed by an empty one
+std::string frame(const std::string& payload, unsigned char& seq)
+{
+    std::string out;
+    size_t pos = 0;
+    while (true) {
+        const size_t chunk = std::min(payload.size() - pos, MAX_CHUNK);
+        out += char(chunk);
+        out += char(chunk >> 8);
+        out += char(chunk >> 16);
+        out += char(seq++);
+        out.append(payload, pos, chunk);
+        pos += chunk;
+        if (chunk < MAX_CHUNK)
+            return out;
+    }
+}
+
+std::string ok_packet()
+{
+    return std::string(7, '\0');
+}
+
+std::string eof_packet()
+{
+    return std::string("\xfe\0\0\x02\0", 5);
+}
+
+std::string error_packet(unsigned short code, const std::string& message)
+{
+    std::string p("\xff");
+    p += char(code);
+    p += char(code >> 8);
+    p += "#HY000";
+    p += message;
+    return p;
+}
+
+// Binlog event as sent in the dump: OK byte, then header and body with a marker
+std::string event_packet(size_t len, unsigned n)
+{
+    std::string p(1, '\0');
+    for (size_t i = 0; i < len; ++i)
+        p += char('a' + (n + i) % 26);
+    return p;
+}
+
+bool recv_all(int fd, char* buf, size_t len)
+{
+    while (len) {
+        const ssize_t r = ::recv(fd, buf, len, 0);
+        if (r <= 0)
+            return false;
+        buf += r;
+        len -= r;
+    }
+    return true;
+}
+
+bool read_packet(int fd, std::string& payload, unsigned char& seq)
+{
+    unsigned char h[4];
+    if (!recv_all(fd, (char*)h, 4))
+        return false;
+    payload.resize(h[0] | h[1] << 8 | h[2] << 16);
+    seq = h[3] + 1;
+    return payload.empty() || recv_all(fd, &payload[0], payload.size());
+}
+
+// Writes in pieces of random size, so the client sees partial headers and payloads
+void send_chunked(int fd, const std::string& data)
+{
+    size_t pos = 0;
+    while (pos < data.size()) {
+        const size_t n = std::min<size_t>(data.size() - pos, 1 + ::rand() % 65536);
+        const ssize_t r = ::send(fd, data.data() + pos, n, MSG_NOSIGNAL);
+        if (r <= 0)
+            return;
+        pos += r;
+    }
+}
+
+// One connection of the stand-in master. 'stream' is what follows
+// COM_BINLOG_DUMP; with 'hold' the connection stays open after it.
+void serve(int listen_fd, const std::string& stream, bool hold)
+{
+    const int fd = ::accept(listen_fd, NULL, NULL);
+    if (fd == -1)
+        return;
+
+    unsigned char seq = 0;
+
+    // Handshake v10 asking for mysql_native_password
+    std::string hs("\x0a" "5.5.0-standin");
+    hs += '\0';
+    hs.append("\x01\0\0\0", 4);
+    hs += "12345678";
+    hs += '\0';
+    hs.append("\xff\xf7", 2);
+    hs += char(33);
+    hs.append("\x02\0", 2);
+    hs.append("\x0f\x80", 2);
+    hs += char(21);
+    hs.append(10, '\0');
+    hs += "abcdefghijkl";
+    hs += '\0';
+    hs += "mysql_native_password";
+    hs += '\0';
+    send_chunked(fd, frame(hs, seq));
+
+    std::string p;
+    read_packet(fd, p, seq);
+
+    // Switch the plugin once, the client has to answer with the new scramble
+    std::string sw("\xfe" "mysql_native_password", 22);
+    sw += '\0';
+    sw += "ABCDEFGHIJKLMNOPQRST";
+    sw += '\0';
+    send_chunked(fd, frame(sw, seq));
+    read_packet(fd, p, seq);
+    send_chunked(fd, frame(p.size() == 20 ? ok_packet() : error_packet(1045, "Access denied"), seq));
+
+    while (read_packet(fd, p, seq) && !p.empty()) {
+        switch (p[0]) {
+            case 0x03:
+                if (p.compare(1, 6, "SELECT") == 0) {
+                    // one column, one row: 'CRC32'
+                    std::string rs = frame(std::string(1, '\x01'), seq);
+                    rs += frame(std::string("\x03" "def\0\0\0\x01v\0\x0c\x21\0\x0f\0\0\0\xfd\0\0\x1f\0\0", 23), seq);
+                    rs += frame(eof_packet(), seq);
+                    rs += frame(std::string("\x05" "CRC32"), seq);
+                    rs += frame(eof_packet(), seq);
+                    send_chunked(fd, rs);
+                    break;
+                }
+                send_chunked(fd, frame(ok_packet(), seq));
+                break;
+            case 0x15:
+                send_chunked(fd, frame(ok_packet(), seq));
+                break;
+            case 0x12:
+                send_chunked(fd, stream);
+                if (hold) {
+                    char c;
+                    ::recv(fd, &c, 1, 0);
+                }
+                ::close(fd);
+                return;
+            default:
+                ::close(fd);
+                return;
+        }
+    }
+
+    ::close(fd);
+}
+
+int listen_local(unsigned short& port)
+{
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+
+    if (fd == -1 || ::bind(fd, (struct sockaddr*)&addr, len) || ::listen(fd, 4) ||
+        ::getsockname(fd, (struct sockaddr*)&addr, &len)) {
+        std::cerr << "listen: " << ::strerror(errno) << std::endl;
+        ::exit(1);
+    }
+
+    port = ntohs(addr.sin_port);
+    return fd;
+}
+
+bool connect_and_dump(slave::BinlogClient& client, unsigned short port)
+{
+    std::string checksum;
+    return client.connect("127.0.0.1", port, "repl", "secret") &&
+        client.query("SET @master_heartbeat_period = 1000000000") &&
+        client.query("SET @master_binlog_checksum = @@global.binlog_checksum") &&
+        client.query_value("SELECT @master_binlog_checksum", checksum) && checksum == "CRC32" &&
+        client.register_slave(42, "0.0.0.0", "begun_slave", "begun_slave", 0) &&
+        client.binlog_dump("mysql-bin.000001", 4, 42);
+}
+
+// Reads the packets of 'stream' and compares them with 'expected'
+bool check_stream(const std::string& what, const std::string& stream, const std::vector<std::string>& expected,
+                  bool hold, slave::BinlogClient::ReadResult last, unsigned int last_error = 0)
+{
+    unsigned short port;
+    const int listen_fd = listen_local(port);
+    std::thread server(serve, listen_fd, stream, hold);
+
+    slave::BinlogClient client(1000, hold ? 60000 : 1000);
+    bool ok = connect_and_dump(client, port);
+    if (!ok)
+        std::cout << "     connect: " << client.error_message() << std::endl;
+
+    size_t n = 0;
+    std::thread canceller;
+    slave::BinlogClient::PacketView view;
+    slave::BinlogClient::ReadResult r = slave::BinlogClient::ReadError;
+
+    while (ok && (r = client.read_packet(view)) == slave::BinlogClient::PacketOk) {
+        ok = n < expected.size() && std::string(view.data, view.len) == expected[n];
+        ++n;
+        if (hold && n == expected.size()) {
+            // the reader blocks now, cancel it from another thread
+            canceller = std::thread([&client] { ::usleep(100000); client.cancel(); });
+        }
+    }
+
+    ok = ok && n == expected.size() && r == last && (!last_error || client.error() == last_error);
+    if (!ok)
+        std::cout << "     " << n << " of " << expected.size() << " packets, error "
+                  << client.error() << ": " << client.error_message() << std::endl;
+
+    if (canceller.joinable())
+        canceller.join();
+    client.close();
+    server.join();
+    ::close(listen_fd);
+
+    return report(ok, what);
+}
+
+bool self_test()
+{
+    std::vector<std::string> events;
+    events.push_back(event_packet(19, 0));
+    events.push_back(event_packet(1000, 1));
+    events.push_back(event_packet(MAX_CHUNK - 1, 2));      // exactly one full chunk
+    events.push_back(event_packet(40 << 20, 3));           // three chunks
+    events.push_back(event_packet(200, 4));
+    for (unsigned i = 5; i < 2000; ++i)
+        events.push_back(event_packet(30 + i % 500, i));
+
+    std::string stream;
+    unsigned char seq = 1;
+    for (size_t i = 0; i < events.size(); ++i)
+        stream += frame(events[i], seq);
+
+    Checks checks;
+
+    unsigned char s;
+    checks.add(check_stream("stream, then cancel", stream, events, true,
+                            slave::BinlogClient::ReadError, slave::BinlogClient::ERROR_SERVER_LOST));
+    s = seq;
+    checks.add(check_stream("stream, then end of data", stream + frame(std::string("\xfe\0\0\0\0", 5), s), events, false,
+                            slave::BinlogClient::EndOfData));
+    s = seq;
+    checks.add(check_stream("stream, then server error", stream + frame(error_packet(1236, "Could not find first log file name"), s),
+                            events, false, slave::BinlogClient::ReadError, 1236));
+
+    return checks.ok();
+}
+
+std::vector<std::string> split_recording(const std::string& stream)
+{
+    // Payloads of a recorded stream, joining the chunks
+    std::vector<std::string> packets;
+    size_t pos = 0;
+    std::string payload;
+    while (pos + 4 <= stream.size()) {
+        const unsigned char* h = (const unsigned char*)stream.data() + pos;
+        const size_t len = h[0] | h[1] << 8 | h[2] << 16;
+        payload.append(stream, pos + 4, len);
+        pos += 4 + len;
+        if (len < MAX_CHUNK) {
+            packets.push_back(payload);
+            payload.clear();
+        }
+    }
+    return packets;
+}
+
+int live(int argc, char** argv)
+{
+    slave::BinlogClient client;
+
+    if (!client.connect(argv[1], ::atoi(argv[2]), argv[3], argv[4]) ||
+        !client.register_slave(4242, "0.0.0.0", "begun_slave", "begun_slave", 0) ||
+        !client.binlog_dump(argv[5], ::atoi(argv[6]), 4242, BINLOG_DUMP_NON_BLOCK)) {
+        std::cerr << "FAIL " << client.error() << ": " << client.error_message() << std::endl;
+        return 1;
+    }
+
+    std::ofstream record;
+    if (argc == 9 && std::string(argv[7]) == "--record")
+        record.open(argv[8], std::ios::binary);
+
+    unsigned long packets = 0, bytes = 0;
+    unsigned char seq = 1;
+    slave::BinlogClient::PacketView view;
+    slave::BinlogClient::ReadResult r;
+
+    while ((r = client.read_packet(view)) == slave::BinlogClient::PacketOk) {
+        ++packets;
+        bytes += view.len;
+        if (record.is_open())
+            record << frame(std::string(view.data, view.len), seq);
+    }
+
+    if (record.is_open())
+        record << frame(std::string("\xfe\0\0\0\0", 5), seq);
+
+    std::cout << client.server_version() << ": " << packets << " events, " << bytes << " bytes" << std::endl;
+    if (r != slave::BinlogClient::EndOfData)
+        std::cout << "error " << client.error() << ": " << client.error_message() << std::endl;
+
+    return r == slave::BinlogClient::EndOfData ? 0 : 1;
+}
+
+}// anonymous-namespace
+
+
+int main(int argc, char** argv)
+{
+    if (argc == 3 && std::string(argv[1]) == "--replay") {
+        std::ifstream in(argv[2], std::ios::binary);
+        const std::string stream((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::vector<std::string> packets = split_recording(stream);
+        // the recording ends with the EOF packet
+        if (!packets.empty())
+            packets.pop_back();
+        return check_stream("replay " + std::string(argv[2]), stream, packets, false,
+                            slave::BinlogClient::EndOfData) ? 0 : 1;
+    }
+
+    if (argc == 7 || argc == 9)
+        return live(argc, argv);
+
+    return self_test() ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+// Builders of binlog events for the tests that decode events made in memory
+
+#ifndef __SLAVE_TEST_BINLOG_EVENTS_H_
+#define __SLAVE_TEST_BINLOG_EVENTS_H_
+
+#include <string.h>
+#include <zlib.h>
+#include <string>
+
+#include "Slave.h"
+
+namespace slave_test
+{
+
+inline void set_len(std::string& ev)
+{
+    const unsigned len = ev.size();
+    ::memcpy(&ev[EVENT_LEN_OFFSET], &len, 4);
+}
+
+// Common header of an event, set_len() fills its length in when the body is there
+inline std::string header(slave::Log_event_type type)
+{
+    std::string ev(LOG_EVENT_HEADER_LEN, '\0');
+    ev[EVENT_TYPE_OFFSET] = char(type);
+    return ev;
+}
+
+// Common and post header of a v1 rows event of the table
+inline std::string rows_header(slave::Log_event_type type, unsigned long table_id)
+{
+    std::string ev = header(type);
+    ev.resize(LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN, '\0');
+    ::memcpy(&ev[LOG_EVENT_HEADER_LEN + RW_MAPID_OFFSET], &table_id, 4);
+    return ev;
+}
+
+// Table map event of the table: column types, their packed metadata and the null bitmap
+inline std::string table_map(unsigned long table_id, const std::string& db, const std::string& table,
+                             const std::string& types, const std::string& meta)
+{
+    std::string ev = header(slave::TABLE_MAP_EVENT);
+    ev.append((const char*)&table_id, 6);
+    ev.append(2, '\0');
+
+    ev += char(db.size());
+    ev += db;
+    ev += '\0';
+    ev += char(table.size());
+    ev += table;
+    ev += '\0';
+
+    ev += char(types.size());
+    ev += types;
+    ev += char(meta.size());
+    ev += meta;
+    ev.append((types.size() + 7) / 8, '\0');
+
+    set_len(ev);
+    return ev;
+}
+
+inline void put_be(std::string& buf, unsigned long long v, unsigned bytes)
+{
+    for (unsigned i = bytes; i-- > 0; )
+        buf += char(v >> (8 * i));
+}
+
+// Sets the length and appends the CRC32 the master computes
+inline void add_checksum(std::string& ev)
+{
+    ev.append(BINLOG_CHECKSUM_LEN, '\0');
+    set_len(ev);
+    const uint32_t crc = ::crc32(0, (const Bytef*)ev.data(), ev.size() - BINLOG_CHECKSUM_LEN);
+    ::memcpy(&ev[ev.size() - BINLOG_CHECKSUM_LEN], &crc, 4);
+}
+
+// Format description event; masters since 5.6.1 add the v2 rows events, the
+// checksum algorithm and a checksum
+inline std::string make_fde(const std::string& version, slave::Binlog_checksum_alg alg)
+{
+    const bool with_alg = version >= "5.6.1";
+    const unsigned types = with_alg ? 35 : 27;
+
+    std::string ev = header(slave::FORMAT_DESCRIPTION_EVENT);
+    ev += char(4);
+    ev += char(0);
+    ev += version;
+    ev.append(ST_SERVER_VER_LEN - version.size(), '\0');
+    ev.append(4, '\0');
+    ev += char(LOG_EVENT_HEADER_LEN);
+
+    std::string lens(types, '\0');
+    lens[slave::QUERY_EVENT - 1] = QUERY_HEADER_LEN;
+    lens[slave::ROTATE_EVENT - 1] = ROTATE_HEADER_LEN;
+    lens[slave::FORMAT_DESCRIPTION_EVENT - 1] = START_V3_HEADER_LEN + 1 + types;
+    lens[slave::TABLE_MAP_EVENT - 1] = TABLE_MAP_HEADER_LEN;
+    lens[slave::WRITE_ROWS_EVENT - 1] = ROWS_HEADER_LEN;
+    lens[slave::UPDATE_ROWS_EVENT - 1] = ROWS_HEADER_LEN;
+    lens[slave::DELETE_ROWS_EVENT - 1] = ROWS_HEADER_LEN;
+    if (with_alg) {
+        lens[slave::WRITE_ROWS_EVENT_V2 - 1] = ROWS_HEADER_LEN_V2;
+        lens[slave::UPDATE_ROWS_EVENT_V2 - 1] = ROWS_HEADER_LEN_V2;
+        lens[slave::DELETE_ROWS_EVENT_V2 - 1] = ROWS_HEADER_LEN_V2;
+    }
+    ev += lens;
+
+    if (!with_alg) {
+        set_len(ev);
+        return ev;
+    }
+
+    ev += char(alg);
+    if (alg == slave::BINLOG_CHECKSUM_ALG_CRC32) {
+        add_checksum(ev);
+    } else {
+        ev.append(BINLOG_CHECKSUM_LEN, '\0');
+        set_len(ev);
+    }
+    return ev;
+}
+
+}// slave_test
+
+#endif
@@ -0,0 +1,182 @@
+// Checks the conversion of varchar values to UTF-8: single-byte charsets
+// through their tables, multi-byte ones through iconv, ASCII copied, and
+// that the results are those of iconv.
+// "charset_test bench" times it against iconv on ASCII and cp1251 text.
+
+#include <iconv.h>
+#include <string.h>
+#include <sys/time.h>
+#include <iostream>
+#include <string>
+
+#include "charset.h"
+#include "test_util.h"
+
+namespace
+{
+
+using namespace slave_test;
+
+// What the old code did: iconv the whole value
+std::string by_iconv(iconv_t cd, const std::string& s)
+{
+    std::string out(s.size() * 4, '\0');
+    char* src = const_cast<char*>(s.data());
+    char* dst = &out[0];
+    size_t src_len = s.size(), dst_len = out.size();
+    ::iconv(cd, NULL, NULL, NULL, NULL);
+    ::iconv(cd, &src, &src_len, &dst, &dst_len);
+    out.resize(out.size() - dst_len);
+    return out;
+}
+
+std::string convert(const slave::Transcoder& t, const std::string& s)
+{
+    std::string out;
+    t.convert(s.data(), s.size(), out);
+    return out;
+}
+
+bool check_ascii_prefix()
+{
+    bool ok = true;
+    for (unsigned len = 0; len < 80 && ok; ++len) {
+        for (unsigned pos = 0; pos <= len && ok; ++pos) {
+            std::string s(len, 'a');
+            if (pos < len)
+                s[pos] = char(0xC0);
+            ok = slave::ascii_prefix(s.data(), s.size()) == pos;
+        }
+    }
+    return report(ok, "ascii_prefix at every position");
+}
+
+bool check_single_byte(const char* charset)
+{
+    iconv_t cd = ::iconv_open("UTF8", charset);
+    if (cd == (iconv_t)-1)
+        return report(true, std::string(charset) + " (unknown to iconv, skipped)");
+
+    const slave::Transcoder t(charset, 1);
+
+    // every byte the charset has a character for, between ASCII runs of all lengths
+    bool ok = !t.identity();
+    for (unsigned b = 0; b < 256 && ok; ++b) {
+        const std::string one(1, char(b));
+        const std::string want = by_iconv(cd, one);
+        if (want.empty())
+            continue;
+
+        const std::string s = std::string(b % 40, 'x') + one + "tail of the string, long enough for SIMD";
+        ok = convert(t, s) == by_iconv(cd, s);
+        if (!ok)
+            std::cout << "     byte " << b << std::endl;
+    }
+    ::iconv_close(cd);
+    return report(ok, std::string(charset) + " table is iconv's");
+}
+
+bool check_others()
+{
+    bool ok = true;
+
+    {
+        const slave::Transcoder t("utf8", 3);
+        ok = report(t.identity() && convert(t, "\xD0\x96 x") == "\xD0\x96 x", "utf8 is copied") && ok;
+    }
+    {
+        const slave::Transcoder t("no-such-charset", 1);
+        ok = report(t.identity() && convert(t, "\xC0") == "\xC0", "unknown charset is copied") && ok;
+    }
+    {
+        // 0x98 is not a character of cp1251
+        const slave::Transcoder t("cp1251", 1);
+        ok = report(convert(t, "a\x98z") == "a\xEF\xBF\xBDz", "byte without a character") && ok;
+    }
+    {
+        // "Japan" in Shift_JIS: ASCII prefix, then iconv
+        const slave::Transcoder t("sjis", 2);
+        ok = report(convert(t, "ab \x93\xFA\x96\x7B") == "ab \xE6\x97\xA5\xE6\x9C\xAC", "sjis through iconv") && ok;
+    }
+    {
+        iconv_t cd = ::iconv_open("UTF8", "ucs2");
+        const slave::Transcoder t("ucs2", 2);
+        const std::string s("\0A\0B", 4);
+        ok = report(cd == (iconv_t)-1 || convert(t, s) == by_iconv(cd, s), "ucs2 is not taken for ASCII") && ok;
+        if (cd != (iconv_t)-1)
+            ::iconv_close(cd);
+    }
+
+    {
+        // the buffer is reused
+        const slave::Transcoder t("latin1", 1);
+        std::string out;
+        t.convert("caf\xE9 au lait", 12, out);
+        const char* buf = out.data();
+        t.convert("na\xEFve", 5, out);
+        ok = report(out == "na\xC3\xAFve" && out.data() == buf, "output buffer is kept") && ok;
+    }
+
+    return ok;
+}
+
+double now()
+{
+    struct timeval tv;
+    ::gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void bench(const char* what, const std::string& s)
+{
+    const int N = 1000000;
+    iconv_t cd = ::iconv_open("UTF8", "cp1251");
+    const slave::Transcoder t("cp1251", 1);
+    std::string out;
+    size_t sink = 0;
+
+    double start = now();
+    for (int i = 0; i < N; ++i)
+        sink += by_iconv(cd, s).size();
+    std::cout << what << " iconv:      " << (now() - start) * 1e9 / N << " ns" << std::endl;
+
+    start = now();
+    for (int i = 0; i < N; ++i) {
+        t.convert(s.data(), s.size(), out);
+        sink += out.size();
+    }
+    std::cout << what << " Transcoder: " << (now() - start) * 1e9 / N << " ns" << std::endl;
+
+    start = now();
+    for (int i = 0; i < N; ++i) {
+        out.assign(s);
+        sink += out.size();
+    }
+    std::cout << what << " copy:       " << (now() - start) * 1e9 / N << " ns" << std::endl;
+
+    ::iconv_close(cd);
+    if (sink == 0)
+        std::cout << std::endl;
+}
+
+}// anonymous-namespace
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        bench("64 bytes ASCII ", std::string(64, 'a'));
+        bench("64 bytes cp1251", std::string(64, '\xE0'));
+        bench("64 bytes mixed ", std::string(32, 'a') + std::string(8, '\xE0') + std::string(24, 'b'));
+        return 0;
+    }
+
+    Checks checks;
+    checks.add(check_ascii_prefix());
+    checks.add(check_single_byte("latin1"));
+    checks.add(check_single_byte("cp1251"));
+    checks.add(check_single_byte("koi8r"));
+    checks.add(check_others());
+
+    return checks.exit_code();
+}
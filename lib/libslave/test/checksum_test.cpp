@@ -0,0 +1,202 @@
+// Checks binlog checksums: the CRC32 against zlib, format description events
+// of 5.5 and 5.6 masters, stripping, verification and trust-the-network mode.
+// Also prints what verification costs compared to decoding the rows.
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#include <iostream>
+
+#include "Slave.h"
+#include "crc32.h"
+#include "binlog_events.h"
+#include "test_util.h"
+
+namespace
+{
+
+using namespace slave_test;
+
+const unsigned long TABLE_ID = 42;
+const unsigned ROWS = 100;
+const unsigned RUNS = 2000;
+
+unsigned long rows_seen = 0;
+
+void callback(const slave::RecordSet& rs)
+{
+    ++rows_seen;
+}
+
+double now()
+{
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Insert of (int, varchar(64)) rows
+std::string make_rows_event()
+{
+    std::string ev = rows_header(slave::WRITE_ROWS_EVENT, TABLE_ID);
+
+    ev += char(2);
+    ev += char(0x03);
+
+    for (unsigned i = 0; i < ROWS; ++i) {
+        const std::string name = "row name " + std::string(i % 20, 'x');
+        ev += '\0';
+        ev.append((const char*)&i, 4);
+        ev += char(name.size());
+        ev += name;
+    }
+
+    return ev;
+}
+
+bool check_crc32()
+{
+    std::string buf(1 << 16, '\0');
+    for (size_t i = 0; i < buf.size(); ++i)
+        buf[i] = ::rand();
+
+    bool ok = true;
+    for (unsigned i = 0; i < 10000 && ok; ++i) {
+        const size_t off = ::rand() % 64;
+        const size_t len = ::rand() % (i < 5000 ? 300 : buf.size() - 64);
+        ok = slave::binlog_crc32(0, buf.data() + off, len) == ::crc32(0, (const Bytef*)buf.data() + off, len);
+    }
+
+    // in pieces, like a running checksum
+    const uint32_t part = slave::binlog_crc32(0, buf.data(), 1000);
+    ok = ok && slave::binlog_crc32(part, buf.data() + 1000, 5000) == ::crc32(0, (const Bytef*)buf.data(), 6000);
+
+    return report(ok, "crc32 equals zlib crc32");
+}
+
+bool check_events()
+{
+    bool ok = true;
+    slave::Basic_event_info bei;
+
+    // 5.5: no algorithm in the FDE, rows events as they are
+    {
+        slave::Binlog_checksum checksum;
+        const std::string fde = make_fde("5.5.40-log", slave::BINLOG_CHECKSUM_ALG_OFF);
+        std::string rows = make_rows_event();
+        set_len(rows);
+
+        const bool r = slave::read_log_event(fde.data(), fde.size(), bei, checksum) &&
+            checksum.alg == slave::BINLOG_CHECKSUM_ALG_OFF &&
+            slave::read_log_event(rows.data(), rows.size(), bei, checksum) && bei.event_len == rows.size();
+        ok = report(r, "5.5 binlog without checksums") && ok;
+    }
+
+    // 5.6, binlog_checksum=NONE: the FDE still has the algorithm and a checksum field
+    {
+        slave::Binlog_checksum checksum;
+        const std::string fde = make_fde("5.6.30-log", slave::BINLOG_CHECKSUM_ALG_OFF);
+        std::string rows = make_rows_event();
+        set_len(rows);
+
+        const bool r = slave::read_log_event(fde.data(), fde.size(), bei, checksum) &&
+            checksum.alg == slave::BINLOG_CHECKSUM_ALG_OFF && bei.event_len == fde.size() - BINLOG_CHECKSUM_LEN &&
+            slave::read_log_event(rows.data(), rows.size(), bei, checksum) && bei.event_len == rows.size();
+        ok = report(r, "5.6 binlog, binlog_checksum=NONE") && ok;
+    }
+
+    // 5.6, CRC32: checksums are verified and stripped
+    std::string rows = make_rows_event();
+    add_checksum(rows);
+    {
+        slave::Binlog_checksum checksum;
+        const std::string fde = make_fde("5.6.30-log", slave::BINLOG_CHECKSUM_ALG_CRC32);
+
+        const bool r = slave::read_log_event(fde.data(), fde.size(), bei, checksum) &&
+            checksum.alg == slave::BINLOG_CHECKSUM_ALG_CRC32 &&
+            slave::read_log_event(rows.data(), rows.size(), bei, checksum) &&
+            bei.event_len == rows.size() - BINLOG_CHECKSUM_LEN;
+        ok = report(r, "5.6 binlog, binlog_checksum=CRC32") && ok;
+    }
+
+    // a flipped bit is noticed, unless checksums are not verified
+    std::string bad(rows);
+    bad[LOG_EVENT_HEADER_LEN + ROWS_HEADER_LEN + 10] ^= 0x10;
+    {
+        slave::Binlog_checksum checksum;
+        checksum.alg = slave::BINLOG_CHECKSUM_ALG_CRC32;
+
+        bool thrown = false;
+        try {
+            slave::read_log_event(bad.data(), bad.size(), bei, checksum);
+        } catch (const slave::Checksum_error&) {
+            thrown = true;
+        }
+        ok = report(thrown, "corrupted event is rejected") && ok;
+
+        checksum.verify = false;
+        const bool r = slave::read_log_event(bad.data(), bad.size(), bei, checksum) &&
+            bei.event_len == bad.size() - BINLOG_CHECKSUM_LEN;
+        ok = report(r, "trust the network: checksum stripped only") && ok;
+    }
+
+    return ok;
+}
+
+// Verification time against decoding the same events
+void measure()
+{
+    slave::collate_info ci;
+    ci.charset = "utf8";
+    ci.maxlen = 3;
+
+    slave::PtrTable table(new slave::Table("db", "t"));
+    table->fields.push_back(slave::PtrField(new slave::Field_long("id", "int(11)")));
+    table->fields.push_back(slave::PtrField(new slave::Field_varstring("name", "varchar(64)", ci)));
+    table->m_callback = callback;
+    table->set_callback_filter(std::vector<std::string>());
+
+    slave::RelayLogInfo rli;
+    rli.setTableName(TABLE_ID, "t", "db");
+    rli.setTable("t", "db", table);
+
+    slave::EmptyExtState ext_state;
+
+    std::string ev = make_rows_event();
+    add_checksum(ev);
+
+    slave::Binlog_checksum checksum;
+    checksum.alg = slave::BINLOG_CHECKSUM_ALG_CRC32;
+    slave::Basic_event_info bei;
+
+    double start = now();
+    for (unsigned i = 0; i < RUNS; ++i)
+        slave::read_log_event(ev.data(), ev.size(), bei, checksum);
+    const double verify = now() - start;
+
+    slave::Row_event_info roi(bei.buf, bei.event_len, false);
+
+    start = now();
+    for (unsigned i = 0; i < RUNS; ++i)
+        slave::apply_row_event(rli, bei, roi, ext_state);
+    const double decode = now() - start;
+
+    std::cout << "     " << ev.size() << " byte event, " << ROWS << " rows: verify "
+              << verify / RUNS * 1e9 << " ns, decode " << decode / RUNS * 1e9 << " ns ("
+              << 100 * verify / decode << "%)" << std::endl;
+}
+
+}// anonymous-namespace
+
+
+int main()
+{
+    Checks checks;
+    checks.add(check_crc32());
+    checks.add(check_events());
+
+    measure();
+
+    return checks.exit_code();
+}
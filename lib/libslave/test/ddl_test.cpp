@@ -0,0 +1,73 @@
+// Checks which tables parse_ddl() takes out of the statements a master
+// writes to the binlog, so that only these are read again.
+
+#include <iostream>
+#include <sstream>
+
+#include "ddl.h"
+#include "test_util.h"
+
+namespace
+{
+
+using namespace slave_test;
+
+// "db.t db.u- ..." where '-' marks a table that is gone
+std::string parse(const std::string& query, const std::string& default_db = "def")
+{
+    std::vector<slave::DdlTable> tables;
+    if (!slave::parse_ddl(query, default_db, tables))
+        return "-";
+
+    std::ostringstream s;
+    for (unsigned i = 0; i < tables.size(); ++i) {
+        s << (i ? " " : "") << tables[i].db << "." << tables[i].table << (tables[i].gone ? "-" : "");
+    }
+    return s.str();
+}
+
+bool check(const std::string& query, const std::string& expected)
+{
+    const std::string got = parse(query);
+    const bool ok = got == expected;
+    if (!ok)
+        std::cout << "     " << query << ": got '" << got << "', expected '" << expected << "'" << std::endl;
+    return report(ok, query);
+}
+
+}// anonymous-namespace
+
+
+int main()
+{
+    Checks checks;
+
+    checks.add(check("ALTER TABLE t ADD COLUMN x int", "def.t"));
+    checks.add(check("  alter online ignore table db.t drop index k", "db.t"));
+    checks.add(check("ALTER TABLE `my db`.`my``t` MODIFY v int", "my db.my`t"));
+    checks.add(check("ALTER TABLE t RENAME TO db.u", "def.t- db.u"));
+    checks.add(check("ALTER TABLE t ADD x int, RENAME AS u", "def.t- def.u"));
+    checks.add(check("ALTER TABLE t RENAME COLUMN a TO b", "def.t"));
+    checks.add(check("ALTER TABLE t RENAME INDEX a TO b", "def.t"));
+    checks.add(check("ALTER TABLE t ADD x varchar(10) DEFAULT 'rename to u'", "def.t"));
+
+    checks.add(check("CREATE TABLE t (id int)", "def.t"));
+    checks.add(check("create table if not exists db.t like db.u", "db.t"));
+    checks.add(check("CREATE OR REPLACE TABLE t (id int)", "def.t"));
+    checks.add(check("CREATE TEMPORARY TABLE t (id int)", "-"));
+
+    checks.add(check("RENAME TABLE t TO t_old, t_new TO t", "def.t- def.t_old def.t_new- def.t"));
+
+    checks.add(check("DROP TABLE `t` /* generated by server */", "def.t-"));
+    checks.add(check("DROP TABLE IF EXISTS a, db.b", "def.a- db.b-"));
+    checks.add(check("DROP TEMPORARY TABLE IF EXISTS t", "-"));
+
+    checks.add(check("/* comment */ ALTER TABLE t ADD x int", "def.t"));
+
+    checks.add(check("BEGIN", "-"));
+    checks.add(check("INSERT INTO t VALUES (1)", "-"));
+    checks.add(check("CREATE DATABASE db", "-"));
+    checks.add(check("ALTER USER u", "-"));
+
+    return checks.exit_code();
+}
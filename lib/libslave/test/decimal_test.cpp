@@ -0,0 +1,200 @@
+// Checks the DECIMAL decoders against bin2dec() + dec2dbl(): the double is
+// the same, the scaled integer and the text are exact.
+// "decimal_test bench" times them against the old path.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "dec_util.h"
+#include "test_util.h"
+
+namespace
+{
+
+using namespace slave_test;
+
+const int DIG2BYTES[] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 4};
+
+void put_group(std::string& buf, unsigned v, int bytes)
+{
+    for (int i = bytes; i-- > 0; )
+        buf += char(v >> (8 * i));
+}
+
+// The binary format of DECIMAL(precision, scale) for a text like "-12.50"
+std::string encode(const std::string& text, int precision, int scale)
+{
+    const bool neg = text[0] == '-';
+    std::string s = text.substr(neg ? 1 : 0);
+    const std::string::size_type point = s.find('.');
+    std::string ip = s.substr(0, point);
+    std::string fp = point == std::string::npos ? "" : s.substr(point + 1);
+
+    const int intg = precision - scale;
+    ip.erase(0, ip.find_first_not_of('0'));
+    ip.insert(0, intg - ip.size(), '0');
+    fp.resize(scale, '0');
+
+    std::string buf;
+    const int intg0x = intg % 9;
+    if (intg0x)
+        put_group(buf, atoi(ip.substr(0, intg0x).c_str()), DIG2BYTES[intg0x]);
+    for (int i = intg0x; i < intg; i += 9)
+        put_group(buf, atoi(ip.substr(i, 9).c_str()), 4);
+    for (int i = 0; i + 9 <= scale; i += 9)
+        put_group(buf, atoi(fp.substr(i, 9).c_str()), 4);
+    if (scale % 9)
+        put_group(buf, atoi(fp.substr(scale - scale % 9).c_str()), DIG2BYTES[scale % 9]);
+
+    if (neg) {
+        for (unsigned i = 0; i < buf.size(); ++i)
+            buf[i] = ~buf[i];
+    }
+    buf[0] ^= 0x80;
+    return buf;
+}
+
+double old_double(const std::string& bin, int precision, int scale)
+{
+    decimal_digit_t digits[16];
+    decimal_t val;
+    val.len = precision;
+    val.buf = digits;
+    memset(digits, 0, sizeof(digits));
+
+    slave::dec_util::bin2dec(bin.data(), &val, precision, scale);
+    double v = 0;
+    slave::dec_util::dec2dbl(&val, &v);
+    return v;
+}
+
+std::string text(const std::string& bin, int precision, int scale)
+{
+    char buf[slave::dec_util::DEC_TEXT_MAX];
+    return std::string(buf, slave::dec_util::bin2str(bin.data(), precision, scale, buf));
+}
+
+struct Case
+{
+    const char* in;
+    int precision;
+    int scale;
+    const char* out;
+    bool fits;
+    int64_t scaled;
+};
+
+const Case CASES[] = {
+    { "0", 10, 2, "0.00", true, 0 },
+    { "1234567890.1234", 14, 4, "1234567890.1234", true, 12345678901234LL },
+    { "-1234567890.1234", 14, 4, "-1234567890.1234", true, -12345678901234LL },
+    { "12.5", 10, 2, "12.50", true, 1250 },
+    { "-0.05", 10, 2, "-0.05", true, -5 },
+    { "0.000000001", 20, 10, "0.0000000010", true, 10 },
+    { "-7", 5, 0, "-7", true, -7 },
+    { "999999999999999999", 18, 0, "999999999999999999", true, 999999999999999999LL },
+    { "9223372036854775807", 19, 0, "9223372036854775807", true, 9223372036854775807LL },
+    { "-9223372036854775808", 19, 0, "-9223372036854775808", true, int64_t(-9223372036854775807LL - 1) },
+    { "9223372036854775808", 19, 0, "9223372036854775808", false, 0 },
+    { "123456789012345678901234567890.123456789", 40, 9, "123456789012345678901234567890.123456789", false, 0 },
+    { "-0.123456789012345678901234567890", 30, 30, "-0.123456789012345678901234567890", false, 0 },
+};
+
+bool check_cases()
+{
+    bool ok = true;
+    for (unsigned i = 0; i < sizeof(CASES) / sizeof(CASES[0]); ++i) {
+        const Case& c = CASES[i];
+        const std::string bin = encode(c.in, c.precision, c.scale);
+
+        int64_t scaled = 0;
+        const bool fits = slave::dec_util::bin2scaled(bin.data(), c.precision, c.scale, &scaled);
+        const bool r = text(bin, c.precision, c.scale) == c.out && fits == c.fits && (!fits || scaled == c.scaled) &&
+            slave::dec_util::bin2dbl(bin.data(), c.precision, c.scale) == old_double(bin, c.precision, c.scale);
+
+        if (!r)
+            std::cout << "     " << c.in << ": '" << text(bin, c.precision, c.scale) << "' " << scaled << std::endl;
+        ok = report(r, std::string(c.in) + " as text, scaled and double") && ok;
+    }
+    return ok;
+}
+
+bool check_doubles()
+{
+    bool ok = true;
+    unsigned long long x = 88172645463325252ULL;
+    for (int i = 0; i < 100000 && ok; ++i) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+
+        char buf[32];
+        const int scale = x % 7;
+        snprintf(buf, sizeof(buf), "%s%llu.%06llu", (x >> 40) & 1 ? "-" : "", (x >> 8) % 100000000000ULL, x % 1000000);
+        const std::string bin = encode(std::string(buf, strlen(buf) - (6 - scale) - (scale ? 0 : 1)), 11 + scale, scale);
+
+        ok = slave::dec_util::bin2dbl(bin.data(), 11 + scale, scale) == old_double(bin, 11 + scale, scale);
+        if (!ok)
+            std::cout << "     " << buf << std::endl;
+    }
+    return report(ok, "double of random decimal(11+s, s) values is bin2dec + dec2dbl's");
+}
+
+double now()
+{
+    struct timeval tv;
+    ::gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void bench()
+{
+    const int N = 5000000;
+    const std::string bin = encode("-1234567890.1234", 14, 4);
+    volatile double sink = 0;
+
+    double t = now();
+    for (int i = 0; i < N; ++i)
+        sink = sink + old_double(bin, 14, 4);
+    std::cout << "bin2dec + dec2dbl: " << (now() - t) * 1e9 / N << " ns" << std::endl;
+
+    t = now();
+    for (int i = 0; i < N; ++i)
+        sink = sink + slave::dec_util::bin2dbl(bin.data(), 14, 4);
+    std::cout << "bin2dbl:           " << (now() - t) * 1e9 / N << " ns" << std::endl;
+
+    t = now();
+    for (int i = 0; i < N; ++i) {
+        int64_t v;
+        slave::dec_util::bin2scaled(bin.data(), 14, 4, &v);
+        sink = sink + v;
+    }
+    std::cout << "bin2scaled:        " << (now() - t) * 1e9 / N << " ns" << std::endl;
+
+    t = now();
+    for (int i = 0; i < N; ++i) {
+        char buf[slave::dec_util::DEC_TEXT_MAX];
+        sink = sink + slave::dec_util::bin2str(bin.data(), 14, 4, buf);
+    }
+    std::cout << "bin2str:           " << (now() - t) * 1e9 / N << " ns" << std::endl;
+}
+
+}// anonymous-namespace
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "bench") {
+        bench();
+        return 0;
+    }
+
+    Checks checks;
+    checks.add(check_cases());
+    checks.add(check_doubles());
+
+    return checks.exit_code();
+}
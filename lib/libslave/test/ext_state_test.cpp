@@ -0,0 +1,104 @@
+// Checks DefaultExtState: readers racing a writer always get a log name and
+// a position that were set together, and the row counters add up.
+
+#include <stdio.h>
+#include <iostream>
+#include <thread>
+
+#include "DefaultExtState.h"
+#include "test_util.h"
+
+namespace
+{
+
+using namespace slave_test;
+
+std::string log_name(unsigned long pos)
+{
+    char buf[32];
+    ::snprintf(buf, sizeof(buf), "mysql-bin.%06lu", pos % 1000);
+    return std::string(buf) + std::string(pos % 7, 'x');
+}
+
+bool check_position()
+{
+    slave::DefaultExtState state;
+    state.setMasterLogNamePos(log_name(0), 0);
+
+    const unsigned long N = 200000;
+    std::thread writer([&state, N]() {
+        for (unsigned long pos = 1; pos <= N; ++pos) {
+            state.setMasterLogNamePos(log_name(pos), pos);
+        }
+    });
+
+    bool consistent = true;
+    unsigned long last = 0;
+    while (last < N) {
+        const slave::State s = state.getState();
+        if (s.master_log_name != log_name(s.master_log_pos) || s.intransaction_pos != s.master_log_pos ||
+            s.master_log_pos < last) {
+            consistent = false;
+            break;
+        }
+        last = s.master_log_pos;
+    }
+    writer.join();
+
+    bool ok = report(consistent, "log name and position read together");
+    ok = report(state.getMasterLogName() == log_name(N) && state.getMasterLogPos() == N, "last position") && ok;
+
+    state.setLastEventTimePos(1300000000, N + 5);
+    ok = report(state.getLastEventTime() == 1300000000 && state.getIntransactionPos() == N + 5 &&
+                state.getMasterLogPos() == N, "event time and in-transaction position") && ok;
+    return ok;
+}
+
+bool check_counts()
+{
+    slave::DefaultExtState state;
+    state.initTableCount("db.t");
+    const unsigned int id = state.getTableCountId("db.u");
+
+    const unsigned int N = 100000;
+    std::thread t1([&state, id, N]() {
+        for (unsigned int i = 0; i < N; ++i) {
+            state.addTableCount(id, "db.u", 1);
+        }
+    });
+    std::thread t2([&state, id, N]() {
+        for (unsigned int i = 0; i < N / 10; ++i) {
+            state.addTableCount(id, "db.u", 10);
+        }
+    });
+    t1.join();
+    t2.join();
+    state.incTableCount("db.t");
+
+    std::map<std::string, unsigned long> counts;
+    state.getTableCounts(counts);
+    bool ok = report(counts.size() == 2 && counts["db.t"] == 1 && counts["db.u"] == 2 * N, "row counters");
+
+    for (unsigned int i = 0; i < slave::DefaultExtState::MAX_TABLES; ++i) {
+        char buf[32];
+        ::snprintf(buf, sizeof(buf), "db.t%u", i);
+        state.getTableCountId(buf);
+    }
+    const unsigned int more = state.getTableCountId("db.more");
+    state.addTableCount(more, "db.more", 3);
+    state.getTableCounts(counts);
+    ok = report(more == slave::ExtStateIface::NO_TABLE_COUNT_ID && counts["db.more"] == 3, "tables past MAX_TABLES") && ok;
+    return ok;
+}
+
+}// anonymous-namespace
+
+
+int main()
+{
+    Checks checks;
+    checks.add(check_position());
+    checks.add(check_counts());
+
+    return checks.exit_code();
+}
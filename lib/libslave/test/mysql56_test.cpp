@@ -0,0 +1,167 @@
+// Checks the events of MySQL 5.6 masters: format description with the new
+// event types, v2 rows events, table maps with column metadata and the
+// datetime2/timestamp2/time2 column formats. GTID events are skipped.
+// Builds the events in memory, no MySQL server is needed.
+
+#include <string.h>
+#include <iostream>
+
+#include "Slave.h"
+#include "binlog_events.h"
+#include "test_util.h"
+
+namespace
+{
+
+using namespace slave_test;
+
+const unsigned long TABLE_ID = 42;
+
+slave::RecordSetBatch seen;
+
+void batch_callback(const slave::RecordSetBatch& batch)
+{
+    seen = batch;
+}
+
+// Columns: id int, created datetime, updated timestamp(3), t time, d time(4)
+const unsigned char TYPES[] = {
+    slave::BINLOG_TYPE_LONG, slave::BINLOG_TYPE_DATETIME2, slave::BINLOG_TYPE_TIMESTAMP2,
+    slave::BINLOG_TYPE_TIME2, slave::BINLOG_TYPE_TIME2
+};
+const unsigned char META[] = { 0, 3, 0, 4 };
+
+std::string make_table_map()
+{
+    return table_map(TABLE_ID, "db", "t", std::string((const char*)TYPES, sizeof(TYPES)),
+                     std::string((const char*)META, sizeof(META)));
+}
+
+void put_datetime2(std::string& buf, unsigned y, unsigned mo, unsigned d, unsigned h, unsigned mi, unsigned s)
+{
+    const unsigned long long ymd = ((y * 13ULL + mo) << 5) | d;
+    const unsigned long long hms = (h << 12) | (mi << 6) | s;
+    put_be(buf, ((ymd << 17) | hms) + 0x8000000000ULL, 5);
+}
+
+// As MySQL writes it: the packed value is (hms << 24) + microseconds, negated
+// for negative times; the integer part is its floor
+void put_time2(std::string& buf, bool neg, unsigned h, unsigned mi, unsigned s, unsigned usec, unsigned fsp)
+{
+    long long nr = ((long long)((h << 12) | (mi << 6) | s) << 24) + usec;
+    if (neg)
+        nr = -nr;
+
+    const long long intpart = nr >> 24;
+    put_be(buf, 0x800000 + intpart, 3);
+
+    if (fsp == 3 || fsp == 4)
+        put_be(buf, (unsigned short)(short)((nr % (1LL << 24)) / 100), 2);
+}
+
+std::string make_rows_event(slave::Log_event_type type, unsigned extra)
+{
+    std::string ev = header(type);
+    ev.append((const char*)&TABLE_ID, 6);
+    ev.append(2, '\0');
+    const unsigned short extra_len = 2 + extra;
+    ev.append((const char*)&extra_len, 2);
+    ev.append(extra, 'x');
+
+    ev += char(sizeof(TYPES));
+    ev += char(0x1f);
+
+    ev += '\0';
+    const unsigned id = 7;
+    ev.append((const char*)&id, 4);
+    put_datetime2(ev, 2011, 3, 13, 9, 49, 9);
+    put_be(ev, 1300000000, 4);
+    put_be(ev, 123, 2);
+    put_time2(ev, false, 12, 34, 56, 0, 0);
+    put_time2(ev, true, 1, 2, 3, 500000, 4);
+
+    set_len(ev);
+    return ev;
+}
+
+bool check_events()
+{
+    bool ok = true;
+    slave::Basic_event_info bei;
+    slave::Binlog_checksum checksum;
+
+    const std::string fde = make_fde("5.6.30-log", slave::BINLOG_CHECKSUM_ALG_OFF);
+    ok = report(slave::read_log_event(fde.data(), fde.size(), bei, checksum), "5.6 format description") && ok;
+
+    std::string gtid = header(slave::GTID_LOG_EVENT);
+    gtid.append(25, '\0');
+    set_len(gtid);
+    ok = report(!slave::read_log_event(gtid.data(), gtid.size(), bei, checksum), "GTID event is skipped") && ok;
+
+    const std::string map = make_table_map();
+    bool r = slave::read_log_event(map.data(), map.size(), bei, checksum);
+    const slave::Table_map_event_info tmi(bei.buf, bei.event_len);
+    r = r && tmi.m_dbnam == "db" && tmi.m_tblnam == "t" &&
+        tmi.m_column_types == std::vector<unsigned char>(TYPES, TYPES + sizeof(TYPES)) &&
+        tmi.m_column_meta.size() == 5 && tmi.m_column_meta[1] == 0 && tmi.m_column_meta[2] == 3 &&
+        tmi.m_column_meta[4] == 4;
+    ok = report(r, "table map column types and metadata") && ok;
+
+    return ok;
+}
+
+bool check_rows(slave::Log_event_type type, unsigned extra, const std::string& what)
+{
+    slave::PtrTable table(new slave::Table("db", "t"));
+    table->fields.push_back(slave::PtrField(new slave::Field_long("id", "int(11)")));
+    table->fields.push_back(slave::PtrField(new slave::Field_datetime("created", "datetime")));
+    table->fields.push_back(slave::PtrField(new slave::Field_timestamp("updated", "timestamp(3)")));
+    table->fields.push_back(slave::PtrField(new slave::Field_time("t", "time")));
+    table->fields.push_back(slave::PtrField(new slave::Field_time("d", "time(4)")));
+    table->m_batch_callback = batch_callback;
+    table->set_callback_filter(std::vector<std::string>());
+
+    slave::RelayLogInfo rli;
+    rli.setTable("t", "db", table);
+
+    slave::EmptyExtState ext_state;
+    slave::Basic_event_info bei;
+    slave::Binlog_checksum checksum;
+
+    const std::string map = make_table_map();
+    slave::read_log_event(map.data(), map.size(), bei, checksum);
+    const slave::Table_map_event_info tmi(bei.buf, bei.event_len);
+    rli.setTableName(tmi.m_table_id, tmi.m_tblnam, tmi.m_dbnam);
+    table->decoder.set_binlog_types(tmi.m_column_types, tmi.m_column_meta);
+
+    const std::string ev = make_rows_event(type, extra);
+    bool r = slave::read_log_event(ev.data(), ev.size(), bei, checksum);
+    const slave::Row_event_info roi(bei.buf, bei.event_len, false);
+
+    seen.clear();
+    slave::apply_row_event(rli, bei, roi, ext_state);
+
+    // -01:02:03 as the old time format has it: a 3 byte integer
+    r = r && seen.size() == 1 &&
+        seen[0].type_event == (roi.m_type == slave::WRITE_ROWS_EVENT ? slave::RecordSet::Write : slave::RecordSet::Delete) &&
+        seen[0].m_row[0].u == 7 &&
+        seen[0].m_row[1].type == slave::FieldValue::ULongLong && seen[0].m_row[1].ull == 20110313094909ULL &&
+        seen[0].m_row[2].type == slave::FieldValue::UInt && seen[0].m_row[2].u == 1300000000 &&
+        seen[0].m_row[3].u == 123456 &&
+        seen[0].m_row[4].u == (uint32_t(-10203) & 0xFFFFFF);
+
+    return report(r, what);
+}
+
+}// anonymous-namespace
+
+
+int main()
+{
+    Checks checks;
+    checks.add(check_events());
+    checks.add(check_rows(slave::WRITE_ROWS_EVENT_V2, 0, "v2 write rows, temporal2 columns"));
+    checks.add(check_rows(slave::DELETE_ROWS_EVENT_V2, 6, "v2 delete rows with extra data"));
+
+    return checks.exit_code();
+}
@@ -0,0 +1,136 @@
+// Checks the row filter on both images of an UPDATE: a row moving out of the
+// filtered set is sent as a Delete of its before image, a row moving in as a
+// Write of its after image, and a before image without the filter column
+// leaves the after image to decide.
+// Builds the table and the events in memory, no MySQL server is needed.
+
+#include <string.h>
+#include <iostream>
+
+#include "Slave.h"
+#include "binlog_events.h"
+#include "test_util.h"
+
+namespace
+{
+
+using namespace slave_test;
+
+const unsigned long TABLE_ID = 42;
+
+// Columns: id int, name varchar(64)
+const unsigned char ID = 0x01;
+const unsigned char NAME = 0x02;
+
+slave::RecordSetBatch seen;
+
+void batch_callback(const slave::RecordSetBatch& batch)
+{
+    seen = batch;
+}
+
+bool keep_name(const slave::RowBuffer& row)
+{
+    return !row[1].isNull() && row[1].s == "keep";
+}
+
+void put_image(std::string& buf, unsigned char cols, unsigned id, const std::string& name)
+{
+    buf += '\0';
+    if (cols & ID)
+        buf.append((const char*)&id, 4);
+    if (cols & NAME) {
+        buf += char(name.size());
+        buf += name;
+    }
+}
+
+// Update of row 7 from 'before' to 'after', the before image has the columns in 'cols'
+std::string make_update(unsigned char cols, const std::string& before, const std::string& after)
+{
+    std::string buf = rows_header(slave::UPDATE_ROWS_EVENT, TABLE_ID);
+
+    buf += char(2);
+    buf += char(cols);
+    buf += char(ID | NAME);
+
+    put_image(buf, cols, 7, before);
+    put_image(buf, ID | NAME, 7, after);
+
+    set_len(buf);
+    return buf;
+}
+
+// Applies the update, returns the number of rows the callback got
+unsigned apply(unsigned char cols, const std::string& before, const std::string& after)
+{
+    slave::collate_info ci;
+    ci.charset = "utf8";
+    ci.maxlen = 3;
+
+    slave::PtrTable table(new slave::Table("db", "t"));
+    table->fields.push_back(slave::PtrField(new slave::Field_long("id", "int(11)")));
+    table->fields.push_back(slave::PtrField(new slave::Field_varstring("name", "varchar(64)", ci)));
+    table->m_batch_callback = batch_callback;
+    table->set_row_filter(std::vector<unsigned>(1, 1), keep_name);
+    table->set_callback_filter(std::vector<std::string>());
+
+    slave::RelayLogInfo rli;
+    rli.setTableName(TABLE_ID, "t", "db");
+    rli.setTable("t", "db", table);
+
+    slave::EmptyExtState ext_state;
+
+    const std::string ev = make_update(cols, before, after);
+
+    slave::Basic_event_info bei;
+    bei.parse(ev.data(), ev.size());
+    slave::Row_event_info roi(ev.data(), ev.size(), true);
+
+    seen.clear();
+    slave::apply_row_event(rli, bei, roi, ext_state);
+    return seen.size();
+}
+
+bool check_transitions()
+{
+    Checks checks;
+
+    checks.add(report(apply(ID | NAME, "keep", "keep") == 1 && seen[0].type_event == slave::RecordSet::Update &&
+                      seen[0].m_old_row[1].s == "keep", "row stays in: Update"));
+
+    checks.add(report(apply(ID | NAME, "drop", "drop") == 0, "row stays out: skipped"));
+
+    checks.add(report(apply(ID | NAME, "keep", "drop") == 1 && seen[0].type_event == slave::RecordSet::Delete &&
+                      seen[0].m_row[0].u == 7 && seen[0].m_row[1].s == "keep", "row moves out: Delete of the before image"));
+
+    checks.add(report(apply(ID | NAME, "drop", "keep") == 1 && seen[0].type_event == slave::RecordSet::Write &&
+                      seen[0].m_row[0].u == 7 && seen[0].m_row[1].s == "keep", "row moves in: Write of the after image"));
+
+    return checks.ok();
+}
+
+// binlog_row_image=MINIMAL: the before image has the key only
+bool check_before_without_filter_column()
+{
+    Checks checks;
+
+    checks.add(report(apply(ID, "", "keep") == 1 && seen[0].type_event == slave::RecordSet::Update,
+                      "before image without the filter column, after passes: Update"));
+
+    checks.add(report(apply(ID, "", "drop") == 0, "before image without the filter column, after fails: skipped"));
+
+    return checks.ok();
+}
+
+}// anonymous-namespace
+
+
+int main()
+{
+    Checks checks;
+    checks.add(check_transitions());
+    checks.add(check_before_without_filter_column());
+
+    return checks.exit_code();
+}
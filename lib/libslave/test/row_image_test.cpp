@@ -0,0 +1,239 @@
+// Checks partial row images (binlog_row_image=MINIMAL or NOBLOB): the record
+// sets mark the columns the images carry, inserts get the defaults of the
+// columns they leave out, and the row filter looks at the before image for
+// the columns an update did not change.
+// Builds the table and the events in memory, no MySQL server is needed.
+
+#include <string.h>
+#include <iostream>
+
+#include "Slave.h"
+#include "binlog_events.h"
+#include "test_util.h"
+
+namespace
+{
+
+using namespace slave_test;
+
+const unsigned long TABLE_ID = 42;
+
+// Columns: id int, name varchar(64), v int
+const unsigned char ID = 0x01;
+const unsigned char NAME = 0x02;
+const unsigned char V = 0x04;
+
+slave::RecordSetBatch seen;
+
+void batch_callback(const slave::RecordSetBatch& batch)
+{
+    seen = batch;
+}
+
+bool keep_name(const slave::RowBuffer& row)
+{
+    return !row[1].isNull() && row[1].s == "keep";
+}
+
+// One row image with the columns in 'cols', no NULLs
+void put_image(std::string& buf, unsigned char cols, unsigned id, const std::string& name, unsigned v)
+{
+    buf += '\0';
+    if (cols & ID)
+        buf.append((const char*)&id, 4);
+    if (cols & NAME) {
+        buf += char(name.size());
+        buf += name;
+    }
+    if (cols & V)
+        buf.append((const char*)&v, 4);
+}
+
+// Rows event with one row
+std::string make_event(slave::Log_event_type type, unsigned char cols, unsigned char cols_ai, const std::string& name)
+{
+    std::string buf = rows_header(type, TABLE_ID);
+
+    buf += char(3);
+    buf += char(cols);
+    if (type == slave::UPDATE_ROWS_EVENT)
+        buf += char(cols_ai);
+
+    put_image(buf, cols, 7, name, 1);
+    if (type == slave::UPDATE_ROWS_EVENT)
+        put_image(buf, cols_ai, 7, name, 5);
+
+    set_len(buf);
+    return buf;
+}
+
+std::string bits(const std::vector<bool>& v)
+{
+    std::string s;
+    for (unsigned i = 0; i < v.size(); ++i)
+        s += v[i] ? '1' : '0';
+    return s;
+}
+
+bool apply(slave::Log_event_type type, unsigned char cols, unsigned char cols_ai, const std::string& name, bool filter,
+           const std::vector<slave::ColumnDefault>& defaults = std::vector<slave::ColumnDefault>())
+{
+    slave::collate_info ci;
+    ci.charset = "utf8";
+    ci.maxlen = 3;
+
+    slave::PtrTable table(new slave::Table("db", "t"));
+    table->fields.push_back(slave::PtrField(new slave::Field_long("id", "int(11)")));
+    table->fields.push_back(slave::PtrField(new slave::Field_varstring("name", "varchar(64)", ci)));
+    table->fields.push_back(slave::PtrField(new slave::Field_long("v", "int(11)")));
+    table->m_batch_callback = batch_callback;
+    if (filter)
+        table->set_row_filter(std::vector<unsigned>(1, 1), keep_name);
+    table->set_callback_filter(std::vector<std::string>());
+    for (unsigned i = 0; i < defaults.size(); ++i)
+        table->set_default(i, defaults[i]);
+
+    slave::RelayLogInfo rli;
+    rli.setTableName(TABLE_ID, "t", "db");
+    rli.setTable("t", "db", table);
+
+    slave::EmptyExtState ext_state;
+
+    const std::string ev = make_event(type, cols, cols_ai, name);
+
+    slave::Basic_event_info bei;
+    bei.parse(ev.data(), ev.size());
+    slave::Row_event_info roi(ev.data(), ev.size(), type == slave::UPDATE_ROWS_EVENT);
+
+    seen.clear();
+    slave::apply_row_event(rli, bei, roi, ext_state);
+    return !seen.empty();
+}
+
+bool check_images()
+{
+    bool ok = true;
+
+    {
+        const bool r = apply(slave::WRITE_ROWS_EVENT, ID | NAME | V, 0, "x", false) &&
+            !seen[0].partial() && seen[0].has(2);
+        ok = report(r, "full image: no bitmap") && ok;
+    }
+
+    {
+        const bool r = apply(slave::DELETE_ROWS_EVENT, ID, 0, "x", false) &&
+            seen[0].partial() && bits(seen[0].m_present) == "100" &&
+            seen[0].m_row[0].u == 7 && seen[0].m_row[1].isNull();
+        ok = report(r, "minimal delete: key only") && ok;
+    }
+
+    // no defaults known: the writer refuses to insert the row
+    {
+        const bool r = apply(slave::WRITE_ROWS_EVENT, ID | V, 0, "x", false) &&
+            seen[0].type_event == slave::RecordSet::Write &&
+            seen[0].partial() && bits(seen[0].m_present) == "101" &&
+            !seen[0].has(1) && seen[0].m_row[2].u == 1;
+        ok = report(r, "partial insert: missing columns marked") && ok;
+    }
+
+    {
+        const bool r = apply(slave::UPDATE_ROWS_EVENT, ID, V, "x", false) &&
+            seen[0].type_event == slave::RecordSet::Update &&
+            bits(seen[0].m_old_present) == "100" && bits(seen[0].m_present) == "001" &&
+            seen[0].m_old_row[0].u == 7 && seen[0].m_row[2].u == 5 && !seen[0].has(0);
+        ok = report(r, "minimal update: key before, changed columns after") && ok;
+    }
+
+    {
+        const bool r = apply(slave::UPDATE_ROWS_EVENT, ID | NAME | V, ID | NAME | V, "x", false) &&
+            seen[0].m_old_present.empty() && seen[0].m_present.empty();
+        ok = report(r, "full update: no bitmaps") && ok;
+    }
+
+    return ok;
+}
+
+bool check_defaults()
+{
+    bool ok = true;
+
+    std::vector<slave::ColumnDefault> defaults(3);
+    defaults[1] = slave::ColumnDefault(slave::ColumnDefault::Value, "none");
+    defaults[2] = slave::ColumnDefault(slave::ColumnDefault::Value, "3");
+
+    {
+        const bool r = apply(slave::WRITE_ROWS_EVENT, ID, 0, "x", false, defaults) &&
+            seen[0].type_event == slave::RecordSet::Write && bits(seen[0].m_present) == "111" &&
+            seen[0].m_row[0].u == 7 && seen[0].m_row[1].s == "none" && seen[0].m_row[2].u == 3;
+        ok = report(r, "partial insert: missing columns get their defaults") && ok;
+    }
+
+    {
+        const bool r = apply(slave::WRITE_ROWS_EVENT, ID | NAME | V, 0, "x", false, defaults) &&
+            seen[0].m_present.empty() && seen[0].m_row[1].s == "x" && seen[0].m_row[2].u == 1;
+        ok = report(r, "full insert: defaults not used") && ok;
+    }
+
+    // DEFAULT NULL, and a NOT NULL column without DEFAULT
+    defaults[1] = slave::ColumnDefault(slave::ColumnDefault::Null);
+    defaults[2] = slave::ColumnDefault();
+    {
+        const bool r = apply(slave::WRITE_ROWS_EVENT, ID, 0, "x", false, defaults) &&
+            bits(seen[0].m_present) == "110" && seen[0].m_row[1].isNull() && !seen[0].has(2);
+        ok = report(r, "partial insert: NULL default, no default") && ok;
+    }
+
+    defaults[2] = slave::ColumnDefault(slave::ColumnDefault::Value, "3");
+    {
+        const bool r = apply(slave::DELETE_ROWS_EVENT, ID, 0, "x", false, defaults) &&
+            bits(seen[0].m_present) == "100";
+        ok = report(r, "minimal delete: defaults not used") && ok;
+    }
+
+    {
+        const bool r = apply(slave::UPDATE_ROWS_EVENT, ID, V, "x", false, defaults) &&
+            bits(seen[0].m_present) == "001" && seen[0].m_row[2].u == 5;
+        ok = report(r, "minimal update: unchanged columns are not defaults") && ok;
+    }
+
+    return ok;
+}
+
+bool check_filter()
+{
+    bool ok = true;
+
+    // the filter column is not in the after image: the update did not change it
+    {
+        const bool r = apply(slave::UPDATE_ROWS_EVENT, ID | NAME, V, "keep", true) &&
+            seen[0].type_event == slave::RecordSet::Update;
+        ok = report(r, "filter column taken from the before image") && ok;
+    }
+
+    ok = report(!apply(slave::UPDATE_ROWS_EVENT, ID | NAME, V, "drop", true), "update of a filtered out row is skipped") && ok;
+
+    // neither image has it: nothing to tell, the row goes through
+    {
+        const bool r = apply(slave::UPDATE_ROWS_EVENT, ID, V, "drop", true) &&
+            seen[0].type_event == slave::RecordSet::Update;
+        ok = report(r, "filter column in neither image passes") && ok;
+    }
+
+    ok = report(apply(slave::DELETE_ROWS_EVENT, ID, 0, "drop", true), "minimal delete passes the filter") && ok;
+    ok = report(!apply(slave::DELETE_ROWS_EVENT, ID | NAME | V, 0, "drop", true), "full delete is filtered") && ok;
+
+    return ok;
+}
+
+}// anonymous-namespace
+
+
+int main()
+{
+    Checks checks;
+    checks.add(check_images());
+    checks.add(check_defaults());
+    checks.add(check_filter());
+
+    return checks.exit_code();
+}
@@ -67,19 +67,22 @@ void callback(const slave::RecordSet& event) {
 
     std::cout << " " << event.db_name << "." << event.tbl_name << "\n";
 
-    for (slave::Row::const_iterator i = event.m_row.begin(); i != event.m_row.end(); ++i) {
+    const slave::AnyRow row = event.anyRow();
+    const slave::AnyRow old_row = event.anyOldRow();
+
+    for (slave::AnyRow::const_iterator i = row.begin(); i != row.end(); ++i) {
 
         std::string value = print((*i).first, (*i).second);
 
-        unsigned index = i - event.m_row.begin();
+        unsigned index = i - row.begin();
         std::cout << "  " << index << " : " << (*i).first << " -> " << value;
 
         if (event.type_event == slave::RecordSet::Update) {
 
             std::string old_value("NULL");
 
-            if (index < event.m_old_row.size())
-                old_value = print(event.m_old_row[index].first, event.m_old_row[index].second);
+            if (index < old_row.size())
+                old_value = print(old_row[index].first, old_row[index].second);
 
             if (value != old_value)
                 std::cout << "    (was: " << old_value << ")";
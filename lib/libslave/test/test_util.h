@@ -0,0 +1,40 @@
+// What the tests share: the result lines and the exit code of main()
+
+#ifndef __SLAVE_TEST_TEST_UTIL_H_
+#define __SLAVE_TEST_TEST_UTIL_H_
+
+#include <iostream>
+#include <string>
+
+namespace slave_test
+{
+
+// Prints the "OK" or "FAIL" line of a check
+inline bool report(bool ok, const std::string& what)
+{
+    std::cout << (ok ? "OK   " : "FAIL ") << what << std::endl;
+    return ok;
+}
+
+// Checks run one after another, a failed one does not stop the others:
+//
+//     Checks checks;
+//     checks.add(check_a());
+//     checks.add(check_b());
+//     return checks.exit_code();
+class Checks
+{
+public:
+    Checks() : m_ok(true) {}
+
+    void add(bool ok) { m_ok = ok && m_ok; }
+    bool ok() const { return m_ok; }
+    int exit_code() const { return m_ok ? 0 : 1; }
+
+private:
+    bool m_ok;
+};
+
+}// slave_test
+
+#endif
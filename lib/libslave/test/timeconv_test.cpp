@@ -0,0 +1,146 @@
+// Checks the calendar arithmetic and the UTC offset table of TimeZone
+// against the C library, in a few zones with DST and historical changes.
+// Zones missing on the host fall back to UTC and still have to agree.
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <iostream>
+
+#include "field.h"
+#include "timeconv.h"
+#include "types.h"
+#include "test_util.h"
+
+namespace
+{
+
+using namespace slave_test;
+
+int64_t wall_clock(const struct tm& tm)
+{
+    return slave::days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday) * 86400 +
+        tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+}
+
+bool check_civil()
+{
+    bool ok = true;
+    for (int y = 1600; y < 2400 && ok; ++y) {
+        for (int m = 1; m <= 12; ++m) {
+            struct tm tm;
+            ::memset(&tm, 0, sizeof(tm));
+            tm.tm_year = y - 1900;
+            tm.tm_mon = m - 1;
+            tm.tm_mday = 28;
+            if (slave::days_from_civil(y, m, 28) * 86400 != ::timegm(&tm)) {
+                std::cout << "     " << y << "-" << m << "-28" << std::endl;
+                ok = false;
+            }
+        }
+    }
+    return report(ok, "days_from_civil agrees with timegm");
+}
+
+// Every wall clock time maps back to itself; where two moments share it the
+// earlier one is taken
+bool check_zone(const char* tz)
+{
+    ::setenv("TZ", tz, 1);
+    ::tzset();
+    const slave::TimeZone zone;
+
+    bool ok = true;
+    for (time_t t = -2000000000; t < 4000000000LL && ok; t += 25117) {
+        struct tm tm;
+        ::localtime_r(&t, &tm);
+        const time_t got = zone.toUtc(wall_clock(tm));
+
+        struct tm back;
+        ::localtime_r(&got, &back);
+        if (got > t || wall_clock(back) != wall_clock(tm) || zone.offsetAt(t) != tm.tm_gmtoff) {
+            std::cout << "     " << tz << ": " << t << " came back as " << got << std::endl;
+            ok = false;
+        }
+    }
+    return report(ok, std::string("round trip in ") + tz);
+}
+
+time_t to_utc(const slave::TimeZone& zone, int y, unsigned m, unsigned d, unsigned h, unsigned mi)
+{
+    return zone.toUtc(slave::days_from_civil(y, m, d) * 86400 + h * 3600 + mi * 60);
+}
+
+bool check_transitions()
+{
+    ::setenv("TZ", "America/New_York", 1);
+    ::tzset();
+    const slave::TimeZone zone;
+    if (zone.transitions() == 0)
+        return report(true, "DST transitions (no zone data, skipped)");
+
+    bool ok = true;
+    // 2011-03-13 02:30 does not exist: taken as EST, that is 03:30 EDT
+    ok = to_utc(zone, 2011, 3, 13, 2, 30) == 1300001400 && ok;
+    ok = to_utc(zone, 2011, 3, 13, 3, 0) == 1299999600 && ok;
+    // 2011-11-06 01:30 happens twice: the EDT one
+    ok = to_utc(zone, 2011, 11, 6, 1, 30) == 1320557400 && ok;
+    ok = to_utc(zone, 2011, 11, 6, 2, 0) == 1320562800 && ok;
+    return report(ok, "DST transitions");
+}
+
+bool check_types()
+{
+    ::setenv("TZ", "UTC", 1);
+    ::tzset();
+
+    bool ok = true;
+    ok = slave::types::date2time((2011 << 9) | (3 << 5) | 13) == 1299974400 && ok;
+    ok = slave::types::datetime2time(20110313094909ULL) == 1300009749 && ok;
+    ok = slave::types::date2time(0) == 0 && slave::types::datetime2time(0) == 0 && ok;
+    // before 1970 and before 1901, out of 32 bits
+    ok = slave::types::date2time((1960 << 9) | (1 << 5) | 1) == -315619200 && ok;
+    ok = slave::types::date2time((1000 << 9) | (1 << 5) | 1) == -30610224000LL && ok;
+    ok = slave::types::datetime2time(19600101000000ULL) == -315619200 && ok;
+    ok = slave::types::datetime2time(10000101000000ULL) == -30610224000LL && ok;
+
+    slave::Field_datetime dt("d", "datetime");
+    dt.unpacka("2011-03-13 09:49:09");
+    ok = boost::any_cast<unsigned long long>(dt.getFieldData()) == 20110313094909ULL && ok;
+
+    return report(ok, "date2time, datetime2time and dumped values");
+}
+
+// The dump reads TIMESTAMP columns as UTC text, whatever the local zone is
+bool check_dumped_timestamp()
+{
+    ::setenv("TZ", "America/New_York", 1);
+    ::tzset();
+
+    slave::Field_timestamp ts("t", "timestamp");
+    ts.unpacka("2011-03-13 09:49:09");
+    bool ok = boost::any_cast<unsigned int>(ts.getFieldData()) == 1300009749;
+    ts.unpacka("0000-00-00 00:00:00");
+    ok = boost::any_cast<unsigned int>(ts.getFieldData()) == 0 && ok;
+
+    return report(ok, "dumped TIMESTAMP is UTC");
+}
+
+}// anonymous-namespace
+
+
+int main()
+{
+    Checks checks;
+    checks.add(check_civil());
+    // TimeZone::local() is built once: types:: conversions run in UTC
+    checks.add(check_types());
+    checks.add(check_zone("UTC"));
+    checks.add(check_zone("Europe/Moscow"));
+    checks.add(check_zone("America/New_York"));
+    checks.add(check_zone("Australia/Lord_Howe"));
+    checks.add(check_transitions());
+    checks.add(check_dumped_timestamp());
+
+    return checks.exit_code();
+}
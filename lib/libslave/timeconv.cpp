@@ -0,0 +1,104 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "timeconv.h"
+
+namespace
+{
+
+long gmtoff(time_t t)
+{
+    struct tm tm;
+    ::localtime_r(&t, &tm);
+    return tm.tm_gmtoff;
+}
+
+struct LocalLess
+{
+    template <typename T>
+    bool operator()(int64_t local, const T& t) const { return local < t.local; }
+};
+
+struct UtcLess
+{
+    template <typename T>
+    bool operator()(time_t utc, const T& t) const { return utc < t.utc; }
+};
+
+}// anonymous-namespace
+
+
+namespace slave
+{
+
+const TimeZone& TimeZone::local()
+{
+    static const TimeZone zone;
+    return zone;
+}
+
+TimeZone::TimeZone(int from_year, int to_year)
+{
+    ::tzset();
+
+    // zones don't change their offset twice a day: a day step finds every
+    // transition, bisection finds its second
+    const time_t day = 86400;
+    const time_t from = days_from_civil(from_year, 1, 1) * day - day;
+    const time_t to = days_from_civil(to_year, 1, 1) * day + day;
+
+    m_first_offset = gmtoff(from);
+    long offset = m_first_offset;
+
+    for (time_t t = from + day; t <= to; t += day) {
+        const long next = gmtoff(t);
+        if (next == offset)
+            continue;
+
+        time_t lo = t - day, hi = t;
+        while (hi - lo > 1) {
+            const time_t mid = lo + (hi - lo) / 2;
+            if (gmtoff(mid) == offset)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        Transition tr;
+        tr.utc = hi;
+        tr.local = int64_t(hi) + std::max(offset, next);
+        tr.offset = next;
+        m_transitions.push_back(tr);
+
+        offset = next;
+    }
+}
+
+time_t TimeZone::toUtc(int64_t local) const
+{
+    std::vector<Transition>::const_iterator i =
+        std::upper_bound(m_transitions.begin(), m_transitions.end(), local, LocalLess());
+    return time_t(local - (i == m_transitions.begin() ? m_first_offset : (i - 1)->offset));
+}
+
+long TimeZone::offsetAt(time_t utc) const
+{
+    std::vector<Transition>::const_iterator i =
+        std::upper_bound(m_transitions.begin(), m_transitions.end(), utc, UtcLess());
+    return i == m_transitions.begin() ? m_first_offset : (i - 1)->offset;
+}
+
+}// slave
@@ -0,0 +1,74 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_TIMECONV_H_
+#define __SLAVE_TIMECONV_H_
+
+#include <inttypes.h>
+#include <time.h>
+#include <vector>
+
+namespace slave
+{
+
+// Days since 1970-01-01 of a date of the proleptic Gregorian calendar,
+// month 1..12, day 1..31. Integer math only.
+inline int64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = unsigned(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + int64_t(doe) - 719468;
+}
+
+// UTC offsets of a time zone, read once with localtime_r() and looked up by
+// binary search afterwards: no libc call and no lock per value.
+class TimeZone
+{
+public:
+    // The zone of the process (TZ), built on first use
+    static const TimeZone& local();
+
+    // Table of the current zone for the years [from_year, to_year);
+    // outside of them the first and the last offset hold
+    TimeZone(int from_year = 1900, int to_year = 2100);
+
+    // Seconds since the epoch of a wall clock time of this zone, given as
+    // seconds since 1970-01-01 00:00:00 of the same wall clock. A time skipped
+    // by a forward transition is taken with the offset before it, a repeated
+    // one with the earlier of its two offsets.
+    time_t toUtc(int64_t local) const;
+
+    // Offset (seconds east of UTC) at a moment
+    long offsetAt(time_t utc) const;
+
+    size_t transitions() const { return m_transitions.size(); }
+
+private:
+    struct Transition
+    {
+        time_t utc;     // first second of the new offset
+        int64_t local;  // first wall clock second taken with the new offset
+        long offset;
+    };
+
+    std::vector<Transition> m_transitions;
+    long m_first_offset;
+};
+
+}// slave
+
+#endif
@@ -5,6 +5,8 @@
 #include <string>
 #include <time.h>
 
+#include "timeconv.h"
+
 namespace slave {
 namespace types
 {
@@ -28,8 +30,8 @@ namespace types
     typedef std::string         MY_TEXT;
     typedef std::string         MY_BLOB;
 
-    // NOTE you should call tzset directly or indirectly before using any of these functions
-    // for proper initialization of daylight variable
+    // DATE and DATETIME values are wall clock times of the local zone (TZ):
+    // the conversions below use slave::TimeZone::local(), read once.
 
     // Converts date from slave to timestamp assuming date is specified in local timezone.
     inline time_t date2time(MY_DATE date)
@@ -40,14 +42,12 @@ namespace types
         if (0 == date)
             return 0;
 
-        struct tm t;
-        memset(&t, 0, sizeof(tm));
-        t.tm_year = (date >> 9) - 1900;
-        t.tm_mon = (date >> 5) % (1 << 4) - 1;
-        t.tm_mday = date % (1 << 5);
-        t.tm_isdst = daylight;
+        // zero month or day ('2011-00-00') is taken as the first one
+        const unsigned m = (date >> 5) % (1 << 4);
+        const unsigned d = date % (1 << 5);
+        const int64_t days = days_from_civil(date >> 9, m ? m : 1, d ? d : 1);
 
-        return mktime(&t);
+        return TimeZone::local().toUtc(days * 86400);
     }
 
     // Converts date and time from slave to timestamp assuming date is specified in local timezone.
@@ -58,17 +58,13 @@ namespace types
         if (0 == datetime)
             return 0;
 
-        struct tm t;
-        memset(&t, 0, sizeof(tm));
-        t.tm_year = (datetime / 10000000000) - 1900;
-        t.tm_mon =  (datetime / 100000000) % 100 - 1;
-        t.tm_mday = (datetime / 1000000) % 100;
-        t.tm_hour = (datetime / 10000) % 100;
-        t.tm_min =  (datetime / 100) % 100;
-        t.tm_sec =   datetime % 100;
-        t.tm_isdst = daylight;
+        const unsigned ymd = datetime / 1000000;
+        const unsigned hms = datetime % 1000000;
+        const unsigned m = (ymd / 100) % 100;
+        const unsigned d = ymd % 100;
+        const int64_t days = days_from_civil(ymd / 10000, m ? m : 1, d ? d : 1);
 
-        return mktime(&t);
+        return TimeZone::local().toUtc(days * 86400 + (hms / 10000) * 3600 + (hms / 100) % 100 * 60 + hms % 100);
     }
 }// types
 }// slave
@@ -0,0 +1,348 @@
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#include "logger.h"
+
+namespace replicator {
+
+const unsigned AsyncLog::RING_SIZE;
+const unsigned AsyncLog::MAX_LINE;
+const unsigned AsyncLog::FLUSH_INTERVAL_MS;
+
+namespace {
+
+std::atomic<unsigned long> last_log_id(0);
+
+// Header of a line in a ring
+struct Record
+{
+	uint32_t len;
+	uint32_t line_no;	// 0 for a "repeated N times" summary
+	time_t t;
+	char level;
+};
+
+void copy_in(char *ring, size_t pos, const void *data, size_t len)
+{
+	const size_t at = pos % AsyncLog::RING_SIZE;
+	const size_t first = std::min(len, AsyncLog::RING_SIZE - at);
+	::memcpy(ring + at, data, first);
+	::memcpy(ring, (const char *)data + first, len - first);
+}
+
+void copy_out(void *data, const char *ring, size_t pos, size_t len)
+{
+	const size_t at = pos % AsyncLog::RING_SIZE;
+	const size_t first = std::min(len, AsyncLog::RING_SIZE - at);
+	::memcpy(data, ring + at, first);
+	::memcpy((char *)data + first, ring, len - first);
+}
+
+// Lines of several threads come in between, so the line is repeated too
+std::string Repeated(unsigned repeats, const std::string &line)
+{
+	char buf[64];
+	::snprintf(buf, sizeof(buf), "repeated %u times: ", repeats);
+	return buf + line;
+}
+
+} // anonymous-namespace
+
+// Lines of one thread. The owner thread moves head, the flusher moves tail
+struct AsyncLog::Stage
+{
+	// A thread writes to the stage; the thread is gone; the thread is gone
+	// and the flusher has written out all it left, another thread may take it
+	enum Owner { Taken, Released, Free };
+
+	Stage() : head(0), tail(0), state(0), dropped(0), owner(Taken), line_no(0), last_level(0),
+		drained_line_no(0), drained_level(0) {}
+
+	char ring[RING_SIZE];
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+	// number of the last line << 32 | its repeats not reported yet
+	std::atomic<unsigned long long> state;
+	std::atomic<unsigned long> dropped;
+	std::atomic<int> owner;
+
+	// owner thread only
+	std::vector<std::pair<char, std::string> > partial;
+	unsigned line_no;
+	char last_level;
+	std::string last_line;
+
+	// flusher thread only
+	unsigned drained_line_no;
+	char drained_level;
+	std::string drained_line;
+};
+
+struct AsyncLog::LocalHolder
+{
+	LocalHolder() : log_id(0) {}
+	~LocalHolder()
+	{
+		if (stage) {
+			stage->owner = Stage::Released;
+		}
+	}
+
+	unsigned long log_id;
+	PtrStage stage;
+};
+
+AsyncLog::AsyncLog(const std::string &filename) :
+	filename(filename), id(++last_log_id), file(::fopen(filename.c_str(), "a")),
+	wake(false), reopen(false), stop(false), rounds_started(0), rounds_done(0), prefix_time(0)
+{
+	prefix[0] = '\0';
+	flusher = std::thread(&AsyncLog::Run, this);
+}
+
+AsyncLog::~AsyncLog()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	cond.notify_one();
+	flusher.join();
+
+	if (file) {
+		::fclose(file);
+	}
+}
+
+void AsyncLog::Write(char level, const char *data, size_t len)
+{
+	Stage &stage = LocalStage();
+
+	std::string *line = NULL;
+	for (size_t i = 0; i < stage.partial.size(); ++i) {
+		if (stage.partial[i].first == level) {
+			line = &stage.partial[i].second;
+			break;
+		}
+	}
+	if (!line) {
+		stage.partial.push_back(std::make_pair(level, std::string()));
+		line = &stage.partial.back().second;
+	}
+
+	while (len) {
+		const char *nl = (const char *)::memchr(data, '\n', len);
+		const size_t n = nl ? nl - data : len;
+		if (line->size() < MAX_LINE) {
+			line->append(data, std::min(n, MAX_LINE - line->size()));
+		}
+		if (!nl) {
+			break;
+		}
+		Submit(stage, level, *line);
+		line->clear();
+		len -= n + 1;
+		data = nl + 1;
+	}
+}
+
+void AsyncLog::Flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	// the next round to start sees all that was written before
+	const unsigned long target = rounds_started + 1;
+	wake = true;
+	cond.notify_one();
+	flushed.wait_for(lock, std::chrono::seconds(2), [this, target]() { return stop || rounds_done >= target; });
+}
+
+AsyncLog::Stage &AsyncLog::LocalStage()
+{
+	static thread_local LocalHolder local;
+
+	if (local.log_id != id) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		PtrStage stage;
+		for (size_t i = 0; i < stages.size() && !stage; ++i) {
+			if (stages[i]->owner == Stage::Free) {
+				// nothing of the previous thread is left, its last line
+				// is not a line this thread repeats
+				stage = stages[i];
+				stage->partial.clear();
+				stage->line_no = 0;
+				stage->last_level = 0;
+				stage->last_line.clear();
+				stage->state = 0;
+				stage->owner = Stage::Taken;
+			}
+		}
+		if (!stage) {
+			stage.reset(new Stage);
+			stages.push_back(stage);
+		}
+
+		if (local.stage) {
+			local.stage->owner = Stage::Released;
+		}
+		local.log_id = id;
+		local.stage = stage;
+	}
+
+	return *local.stage;
+}
+
+void AsyncLog::Submit(Stage &stage, char level, const std::string &line)
+{
+	if (level == stage.last_level && line == stage.last_line) {
+		stage.state.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	const unsigned long long prev = stage.state.exchange((unsigned long long)++stage.line_no << 32);
+	const unsigned repeats = prev & 0xFFFFFFFF;
+	if (repeats) {
+		const std::string summary = Repeated(repeats, stage.last_line);
+		Put(stage, stage.last_level, 0, summary.data(), summary.size());
+	}
+
+	if (Put(stage, level, stage.line_no, line.data(), line.size())) {
+		stage.last_level = level;
+		stage.last_line = line;
+	} else {
+		// repeats of a dropped line would be reported after another one
+		stage.last_level = 0;
+		stage.last_line.clear();
+	}
+}
+
+bool AsyncLog::Put(Stage &stage, char level, unsigned line_no, const char *data, size_t len)
+{
+	const size_t head = stage.head.load(std::memory_order_relaxed);
+	const size_t tail = stage.tail.load(std::memory_order_acquire);
+	const size_t need = sizeof(Record) + len;
+
+	if (RING_SIZE - (head - tail) < need) {
+		stage.dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	Record r;
+	r.len = len;
+	r.line_no = line_no;
+	r.t = ::time(NULL);
+	r.level = level;
+	copy_in(stage.ring, head, &r, sizeof(r));
+	copy_in(stage.ring, head + sizeof(r), data, len);
+	stage.head.store(head + need, std::memory_order_release);
+
+	// don't wait for the interval when the ring is filling up
+	if (head - tail < RING_SIZE / 2 && head + need - tail >= RING_SIZE / 2) {
+		wake = true;
+		cond.notify_one();
+	}
+	return true;
+}
+
+void AsyncLog::Run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true) {
+		cond.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this]() { return stop || wake; });
+		wake = false;
+		const bool last = stop;
+		const std::vector<PtrStage> current(stages);
+		rounds_started++;
+		lock.unlock();
+
+		if (reopen.exchange(false)) {
+			if (file) {
+				::fclose(file);
+			}
+			file = ::fopen(filename.c_str(), "a");
+			static const char reopened[] = "Log file reopened";
+			Print('I', ::time(NULL), reopened, sizeof(reopened) - 1);
+		}
+
+		for (size_t i = 0; i < current.size(); ++i) {
+			Drain(*current[i]);
+		}
+		::fflush(file ? file : stderr);
+
+		lock.lock();
+		rounds_done++;
+		flushed.notify_all();
+		if (last) {
+			break;
+		}
+	}
+}
+
+void AsyncLog::Drain(Stage &stage)
+{
+	const size_t head = stage.head.load(std::memory_order_acquire);
+	size_t tail = stage.tail.load(std::memory_order_relaxed);
+
+	while (tail != head) {
+		Record r;
+		copy_out(&r, stage.ring, tail, sizeof(r));
+		record.resize(r.len + 1);
+		copy_out(&record[0], stage.ring, tail + sizeof(r), r.len);
+		tail += sizeof(r) + r.len;
+
+		Print(r.level, r.t, &record[0], r.len);
+		if (r.line_no) {
+			stage.drained_line_no = r.line_no;
+			stage.drained_level = r.level;
+			stage.drained_line.assign(&record[0], r.len);
+		}
+	}
+	stage.tail.store(tail, std::memory_order_release);
+
+	// repeats of the line just written, unless the owner has moved on and
+	// reports them itself before its next line
+	unsigned long long s = stage.state.load(std::memory_order_relaxed);
+	if ((s & 0xFFFFFFFF) && (s >> 32) == stage.drained_line_no &&
+		stage.state.compare_exchange_strong(s, s & ~0xFFFFFFFFULL)) {
+		const std::string summary = Repeated(s & 0xFFFFFFFF, stage.drained_line);
+		Print(stage.drained_level, ::time(NULL), summary.data(), summary.size());
+	}
+
+	const unsigned long dropped = stage.dropped.exchange(0, std::memory_order_relaxed);
+	if (dropped) {
+		char buf[64];
+		const int n = ::snprintf(buf, sizeof(buf), "%lu log lines dropped", dropped);
+		Print('E', ::time(NULL), buf, n);
+	}
+
+	// the thread is gone and all it wrote is out: the next one starts afresh
+	if (stage.owner == Stage::Released && stage.head.load(std::memory_order_acquire) == tail &&
+		!(stage.state.load(std::memory_order_relaxed) & 0xFFFFFFFF)) {
+		stage.drained_line_no = 0;
+		stage.drained_level = 0;
+		stage.drained_line.clear();
+		stage.owner = Stage::Free;
+	}
+}
+
+void AsyncLog::Print(char level, time_t t, const char *data, size_t len)
+{
+	if (t != prefix_time) {
+		struct ::tm bdtime;
+		::localtime_r(&t, &bdtime);
+		::strftime(prefix, sizeof(prefix), "[%Y-%m-%d %H:%M:%S] ", &bdtime);
+		prefix_time = t;
+	}
+
+	FILE *out = file ? file : stderr;
+	::fputs(prefix, out);
+	::fputc(level, out);
+	::fputc(' ', out);
+	::fwrite(data, 1, len, out);
+	::fputc('\n', out);
+}
+
+} // replicator
@@ -1,19 +1,92 @@
 #ifndef REPLICATOR_LOGGER_H
 #define REPLICATOR_LOGGER_H
 
-#include <unistd.h>
+#include <stdio.h>
 #include <time.h>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
-#include <sstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace replicator {
 
-// originally found on stackoverflow
+// Log file written by a thread of its own. Logging threads only copy
+// complete lines into a ring buffer of their own and never wait for the
+// disk: the flusher thread picks the lines up, puts the timestamp and the
+// level in front of them and writes them out every FLUSH_INTERVAL_MS.
+// A line repeated by the same thread is written once, the repeats are
+// counted and reported as "repeated N times: <line>". When a ring is full
+// the line is dropped and the drop is reported.
+class AsyncLog
+{
+public:
+	static const unsigned RING_SIZE = 256 * 1024;
+	static const unsigned MAX_LINE = 4096;
+	static const unsigned FLUSH_INTERVAL_MS = 100;
+
+	explicit AsyncLog(const std::string &filename);
+	~AsyncLog();
+
+	// Data of a stream with the given level, lines end with '\n'
+	void Write(char level, const char *data, size_t len);
+
+	// Waits until what was written so far is in the file
+	void Flush();
+
+	// Opens the file again, e.g. after logrotate moved it. Only sets a
+	// flag, so it is safe to call from a signal handler
+	void Reopen() { reopen = true; }
+
+private:
+	struct Stage;
+	struct LocalHolder;
+	typedef std::shared_ptr<Stage> PtrStage;
+
+	AsyncLog(const AsyncLog &);
+	AsyncLog &operator=(const AsyncLog &); // not copyable
+
+	Stage &LocalStage();
+	void Submit(Stage &stage, char level, const std::string &line);
+	bool Put(Stage &stage, char level, unsigned line_no, const char *data, size_t len);
+	void Run();
+	void Drain(Stage &stage);
+	void Print(char level, time_t t, const char *data, size_t len);
+
+	const std::string filename;
+	const unsigned long id;
+	FILE *file;
+
+	std::mutex mutex;
+	std::condition_variable cond;		// wakes the flusher
+	std::condition_variable flushed;	// a flusher round is over
+	std::vector<PtrStage> stages;
+	std::atomic<bool> wake;
+	std::atomic<bool> reopen;
+	bool stop;
+	unsigned long rounds_started;
+	unsigned long rounds_done;
+
+	// flusher thread only
+	time_t prefix_time;
+	char prefix[32];
+	std::vector<char> record;
 
+	std::thread flusher;
+};
+
+// Log file of the process, NULL while the standard streams are not redirected
+extern AsyncLog *logfile;
+
+// Redirects a standard stream to the log with the given level, for the
+// whole life time of the object
 class Logger : public std::streambuf
 {
 public:
-	Logger( std::basic_ios< char >& out, char level ) : out(out), sink(), newline(true), level(level)
+	Logger( std::basic_ios< char >& out, char level, AsyncLog& log ) : out(out), sink(), level(level), log(log)
 	{
 		sink = out.rdbuf(this);
 	}
@@ -21,42 +94,28 @@ public:
 	{
 		out.rdbuf(sink);
 	}
-	std::streambuf *rdsink() const {
-		return sink;
-	}
-	void rdsink(std::streambuf *sink) {
-		this->sink = sink;
-	}
 
 protected:
 	int_type overflow( int_type m = traits_type::eof() )
 	{
 		if( traits_type::eq_int_type( m, traits_type::eof() ) )
-			return sink->pubsync() == -1 ? m: traits_type::not_eof(m);
-
-		if( newline )
-		{
-			std::ostream str( sink );
-
-			char timestr[64];
-			::time_t t;
-			struct ::tm bdtime;
-			t = ::time(NULL);
-			localtime_r(&t, &bdtime);
-			::strftime(timestr, sizeof(timestr), "%Y-%m-%d %H:%M:%S", &bdtime);
-
-			if( !(str << "[" << timestr << "] " << level << " " ) ) {
-				return traits_type::eof(); // error
-			}
-		}
-
-		newline = traits_type::to_char_type( m ) == '\n';
-
-		int_type res = sink->sputc( m );
-		if (newline) {
-			sink->pubsync();
-		}
-		return res;
+			return traits_type::not_eof(m);
+
+		const char c = traits_type::to_char_type( m );
+		log.Write(level, &c, 1);
+		return m;
+	}
+
+	std::streamsize xsputn( const char* s, std::streamsize n )
+	{
+		log.Write(level, s, n);
+		return n;
+	}
+
+	// std::endl ends up here: the flusher writes the line soon enough
+	int sync()
+	{
+		return 0;
 	}
 
 private:
@@ -65,8 +124,8 @@ private:
 
 	std::basic_ios< char >& out;
 	std::streambuf* sink;
-	bool newline;
 	char level;
+	AsyncLog& log;
 };
 
 } // replicator
@@ -0,0 +1,220 @@
+// Checks the log file AsyncLog writes: lines wrapping around the end of a
+// ring, dropped lines when a ring is full, "repeated N times" summaries and
+// a thread taking the stage of a thread that is gone.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+using namespace replicator;
+
+static bool report(bool ok, const std::string &what)
+{
+	printf("%s%s\n", ok ? "OK   " : "FAIL ", what.c_str());
+	return ok;
+}
+
+// A log in a file of its own, removed with the object
+class TestLog
+{
+public:
+	TestLog() : name(TempName()), log(new AsyncLog(name)) {}
+	~TestLog()
+	{
+		log.reset();
+		::unlink(name.c_str());
+	}
+
+	void Line(char level, const std::string &line)
+	{
+		const std::string s = line + "\n";
+		log->Write(level, s.data(), s.size());
+	}
+
+	// Lines of the file without the time, as "L text"
+	std::vector<std::string> Read()
+	{
+		log->Flush();
+
+		std::vector<std::string> lines;
+		std::ifstream in(name.c_str());
+		std::string line;
+		while (std::getline(in, line)) {
+			const size_t at = line.find("] ");
+			lines.push_back(at == std::string::npos ? line : line.substr(at + 2));
+		}
+		return lines;
+	}
+
+	AsyncLog &Log() { return *log; }
+
+private:
+	static std::string TempName()
+	{
+		char name[] = "/tmp/logger_test.XXXXXX";
+		const int fd = ::mkstemp(name);
+		if (fd >= 0) {
+			::close(fd);
+		}
+		return name;
+	}
+
+	const std::string name;
+	std::unique_ptr<AsyncLog> log;
+};
+
+// Line i, long enough for a few hundred of them to wrap around the ring
+static std::string long_line(unsigned i)
+{
+	std::string s = std::to_string(i) + ":";
+	s.append(1000 + i * 37 % 3000, char('a' + i % 26));
+	return s;
+}
+
+static bool check_wraparound()
+{
+	TestLog log;
+	std::vector<std::string> expected;
+
+	// the flusher empties the ring before it is full
+	for (unsigned i = 0; i < 1000; ++i) {
+		log.Line('I', long_line(i));
+		expected.push_back("I " + long_line(i));
+		if (i % 50 == 49) {
+			log.Log().Flush();
+		}
+	}
+
+	return report(log.Read() == expected, "lines wrapping around the end of the ring are written whole");
+}
+
+// Every line is written or counted in a "log lines dropped" line
+static bool check_dropped()
+{
+	TestLog log;
+
+	const unsigned count = 1000;
+	for (unsigned i = 0; i < count; ++i) {
+		log.Line('I', long_line(i));
+	}
+	const std::vector<std::string> lines = log.Read();
+
+	unsigned written = 0;
+	unsigned long dropped = 0;
+	bool in_order = true;
+	unsigned next = 0;
+	for (size_t i = 0; i < lines.size(); ++i) {
+		unsigned long n = 0;
+		if (::sscanf(lines[i].c_str(), "E %lu log lines dropped", &n) == 1) {
+			dropped += n;
+			continue;
+		}
+		const unsigned at = ::atoi(lines[i].c_str() + 2);
+		in_order = in_order && at >= next && lines[i] == "I " + long_line(at);
+		next = at + 1;
+		++written;
+	}
+
+	return report(dropped > 0 && written + dropped == count && in_order,
+		"lines of a full ring are dropped and counted (" + std::to_string(dropped) + " of " +
+		std::to_string(count) + ")");
+}
+
+// Repeats of a line, with their count from the summaries
+static unsigned repeats(const std::vector<std::string> &lines, const std::string &line, unsigned &written)
+{
+	unsigned n = 0;
+	written = 0;
+	for (size_t i = 0; i < lines.size(); ++i) {
+		unsigned r = 0;
+		char rest[256];
+		if (::sscanf(lines[i].c_str(), "%*c repeated %u times: %255[^\n]", &r, rest) == 2 && line.substr(2) == rest &&
+			lines[i][0] == line[0]) {
+			n += r;
+		} else if (lines[i] == line) {
+			++written;
+		}
+	}
+	return n;
+}
+
+static bool check_repeated()
+{
+	bool ok = true;
+
+	{
+		TestLog log;
+		for (unsigned i = 0; i < 5; ++i) {
+			log.Line('E', "connection refused");
+		}
+		log.Line('E', "connected");
+		const std::vector<std::string> lines = log.Read();
+
+		unsigned written = 0;
+		const unsigned n = repeats(lines, "E connection refused", written);
+		ok = report(written == 1 && n == 4 && lines.back() == "E connected",
+			"a repeated line is written once, then the number of repeats") && ok;
+	}
+
+	{
+		// the summary comes with the next flush even if no other line follows
+		TestLog log;
+		log.Line('I', "idle");
+		log.Line('I', "idle");
+		log.Line('I', "idle");
+		const std::vector<std::string> lines = log.Read();
+
+		unsigned written = 0;
+		const unsigned n = repeats(lines, "I idle", written);
+		ok = report(written == 1 && n == 2, "repeats of the last line are reported by the flusher") && ok;
+	}
+
+	{
+		// another level is another line
+		TestLog log;
+		log.Line('I', "same");
+		log.Line('E', "same");
+		ok = report(log.Read() == std::vector<std::string>({"I same", "E same"}), "same text at another level") && ok;
+	}
+
+	return ok;
+}
+
+// A thread taking the stage of a thread that is gone does not repeat its lines
+static bool check_stage_reuse()
+{
+	TestLog log;
+
+	for (unsigned i = 0; i < 3; ++i) {
+		std::thread([&log]() {
+			log.Line('I', "thread started");
+			log.Line('I', "thread started");
+		}).join();
+		// the flusher writes out what the thread left and frees its stage
+		log.Log().Flush();
+	}
+	const std::vector<std::string> lines = log.Read();
+
+	unsigned written = 0;
+	const unsigned n = repeats(lines, "I thread started", written);
+	return report(written == 3 && n == 3, "a thread taking a stage starts afresh");
+}
+
+int main()
+{
+	bool ok = true;
+	ok = check_wraparound() && ok;
+	ok = check_dropped() && ok;
+	ok = check_repeated() && ok;
+	ok = check_stage_reuse() && ok;
+
+	return ok ? 0 : 1;
+}
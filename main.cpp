@@ -1,23 +1,22 @@
 #include <time.h>
+#include <string.h>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 #include <signal.h>
+#include <set>
 #include <lib/tp.1.5.h>
 #include <lib/session.h>
 
-#include <boost/bind.hpp>
-#include <boost/archive/binary_oarchive.hpp>
-#include <boost/archive/binary_iarchive.hpp>
-
 #include <zmq.h>
-#include <zmq_utils.h>
 
 #include <libconfig.h++>
 
 #include "dbreader.h"
+#include "filter.h"
 #include "tpwriter.h"
 #include "serializable.h"
+#include "channel.h"
 #include "logger.h"
 #include "remotemon.h"
 
@@ -31,480 +30,301 @@ static const char *default_config_filename = "/usr/local/etc/replicatord.cfg";
 
 static volatile bool is_halted = false;
 static volatile bool is_term = false;
-static TPWriter *tpwriter = NULL;
-static DBReader *dbreader = NULL;
 static Graphite *graphite = NULL;
-
 static void *ZMQContext = NULL;
-static void *ZMQTpSocket = NULL;
-static void *ZMQTpThread = NULL;
-
-static void *ZMQWdSocket = NULL;
-static void *ZMQWdThread = NULL;
-
-static void tpwrite_main(void *arg);
-static void watchdog_main(void *arg);
-static void halt(void);
-
-static bool start_zmq(unsigned watchdog_timeout)
-{
-	int opti;
-	int rc;
 
-	ZMQContext = zmq_ctx_new();
-	if (ZMQContext == NULL) {
-		return false;
-	}
-
-	// tarantool
-	//
-	ZMQTpSocket = zmq_socket(ZMQContext, ZMQ_PAIR);
+// Filled before the signal handlers may look at it
+static std::vector<Channel *> channels;
+static volatile bool channels_ready = false;
 
-	// set high water mark
-	opti = 10000;
-	zmq_setsockopt(ZMQTpSocket, ZMQ_SNDHWM, &opti, sizeof(opti));
-	rc = zmq_bind(ZMQTpSocket, "inproc://tp");
-	if (rc) {
-		return false;
-	}
-
-	// spawn tp thread
-	ZMQTpThread = zmq_threadstart(tpwrite_main, NULL);
-	if (ZMQTpThread == NULL) {
-		return false;
-	}
+AsyncLog *logfile = NULL;
 
-	// watchdog
-	//
-	ZMQWdSocket = zmq_socket(ZMQContext, ZMQ_PAIR);
-	rc = zmq_bind(ZMQWdSocket, "inproc://wd");
-	if (rc) {
-		return false;
-	}
-	ZMQWdThread = zmq_threadstart(watchdog_main, ((void*)((intptr_t)watchdog_timeout)));
-
-	return true;
-}
+static void halt(void);
 
-static void send_zmq_event(void *socket, const SerializableBinlogEvent &ev)
-{
-	std::ostringstream oss;
-	boost::archive::binary_oarchive oa(oss);
-	oa << ev;
-	zmq_send(socket, oss.str().c_str(), oss.str().length()+1, 0);
-}
+// ====================
 
-static bool poll_zmq_event(void *socket, unsigned timeout, BinlogEventCallback f)
+static unsigned filter_column(const libconfig::Setting &columns, const char *column)
 {
-	zmq_pollitem_t items [] = {
-		{ socket, 0, ZMQ_POLLIN, 0 },
-	};
-
-	int polled = zmq_poll(items, 1, timeout);
-	if (polled < 0) {
-		// error polling
-		return false;
-	}
-
-	bool done = false;
-
-	if (polled > 0 && (items[0].revents & ZMQ_POLLIN)) {
-		while (polled-- > 0) {
-			// restart binlog
-			zmq_msg_t msg;
-			zmq_msg_init(&msg);
-
-			if (zmq_msg_recv(&msg, socket, 0) < 0) {
-				zmq_msg_close(&msg);
-				return false;
-			}
-
-			std::string buf;
-			buf.append((char *)zmq_msg_data(&msg), zmq_msg_size(&msg));
-			zmq_msg_close(&msg);
-
-			SerializableBinlogEvent ev;
-			std::istringstream iss(buf);
-			boost::archive::binary_iarchive ia(iss);
-			ia >> ev;
-			done = done || f(ev);
-			if (done) break;
+	for (int i = 0; i < columns.getLength(); i++) {
+		if (::strcmp(column, (const char *)columns[i]) == 0) {
+			return i;
 		}
 	}
 
-	return done;
+	std::cerr << "Bad filter field: " << column << std::endl;
+	exit(EXIT_FAILURE);
 }
 
-static void close_zmq()
+static void parse_filter_values(const libconfig::Setting &values_, std::vector<int64_t> &values)
 {
-	if (ZMQTpThread != NULL) {
-		zmq_threadclose(ZMQTpThread);
-		ZMQTpThread = NULL;
-	}
-	if (ZMQWdThread != NULL) {
-		zmq_threadclose(ZMQWdThread);
-		ZMQWdThread = NULL;
-	}
-
-
-	if (ZMQTpSocket != NULL) {
-		zmq_close(ZMQTpSocket);
-		ZMQTpSocket = NULL;
-	}
-	if (ZMQWdSocket != NULL) {
-		zmq_close(ZMQWdSocket);
-		ZMQWdSocket = NULL;
-	}
-
-	if (ZMQContext != NULL) {
-		zmq_ctx_term(ZMQContext);
-		ZMQContext = NULL;
+	for (int i = 0; i < values_.getLength(); i++) {
+		values.push_back((long long)values_[i]);
 	}
 }
 
-// ===============
-
-static void tpwrite_run(void *ZMQTpSocket)
+static void parse_filter_pair(const libconfig::Setting &node, const char *name, long long &a, long long &b)
 {
-	SerializableBinlogEvent ev_connect;
-	SerializableBinlogEvent ev_disconnect;
-
-	ev_connect.event = "CONNECT";
-	ev_disconnect.event = "DISCONNECT";
-
-	bool connected = true;
-
-	while (!is_term && connected) {
-		if (!tpwriter->Connect()) {
-			continue;
-		}
-
-		// send initial binlog position to the main thread
-
-		try {
-			if (!tpwriter->ReadBinlogPos(ev_connect.binlog_name, ev_connect.binlog_pos)) {
-				tpwriter->Disconnect();
-				continue;
-			}
-
-			send_zmq_event(ZMQTpSocket, ev_connect);
-
-			while(true) {
-				if (is_term || !connected) {
-					break;
-				}
-
-				connected = poll_zmq_event(ZMQTpSocket, 100, boost::bind(&TPWriter::BinlogEventCallback, boost::ref(*tpwriter), _1)) == false;
-				if (connected) {
-					connected = tpwriter->Sync();
-				}
-
-				while (!is_term && connected) {
-					int r = tpwriter->ReadReply();
-					if (r == 0) {
-						break;
-					}
-					if (r < 0) {
-						connected = false;
-						break;
-					}
-					int code = tpwriter->GetReplyCode();
-					if (code) {
-						std::cerr << "Tarantool error: " << tpwriter->GetReplyErrorMessage() << " (code: " << code << ")" << std::endl;
-						connected = !tpwriter->DisconnectOnError();
-					}
-				}
-			}
-		}
-		catch (std::range_error& ex) {
-			connected = false;
-			std::cout << ex.what() << std::endl;
-			// loop exit
-		}
-		catch (std::exception& ex) {
-			std::cout << ex.what() << std::endl;
-			tpwriter->Disconnect();
-			send_zmq_event(ZMQTpSocket, ev_disconnect);
-			// reconnect
-		}
+	const libconfig::Setting &pair = node[name];
+	if (pair.getLength() != 2) {
+		std::cerr << "Bad filter '" << name << "': two values expected" << std::endl;
+		exit(EXIT_FAILURE);
 	}
-
-	tpwriter->Disconnect();
-	send_zmq_event(ZMQTpSocket, ev_disconnect);
+	a = pair[0];
+	b = pair[1];
 }
 
-static void tpwrite_main(void *arg)
+// filter node is one of:
+//   { and = ( <node>, ... ); }  { or = ( <node>, ... ); }  { not = <node>; }
+//   { column = "name"; in = [ 1, 2, 3 ]; }
+//   { column = "name"; range = [ lo, hi ]; }
+//   { column = "name"; hash_mod = [ mod, rem ]; }
+//   { column = "name"; eq = "string"; }  { column = "name"; eq = 5; }
+//   { column = "name"; prefix = "string"; }
+static void parse_filter(const libconfig::Setting &node, const libconfig::Setting &columns, FilterExpr &expr)
 {
-	void *ZMQTpSocket = zmq_socket(ZMQContext, ZMQ_PAIR);
-
-	if (!ZMQTpSocket) {
-		kill(getpid(), SIGTERM);
+	if (node.exists("and") || node.exists("or")) {
+		const bool is_and = node.exists("and");
+		const libconfig::Setting &args = node[is_and ? "and" : "or"];
+
+		expr.op = is_and ? FilterExpr::And : FilterExpr::Or;
+		if (args.getLength() == 0) {
+			std::cerr << "Bad filter: empty '" << (is_and ? "and" : "or") << "' list" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		for (int i = 0; i < args.getLength(); i++) {
+			expr.args.push_back(FilterExpr());
+			parse_filter(args[i], columns, expr.args.back());
+		}
 		return;
 	}
 
-	// set high water mark
-	int opti = 10000;
-	zmq_setsockopt(ZMQTpSocket, ZMQ_RCVHWM, &opti, sizeof(opti));
-
-	if (zmq_connect(ZMQTpSocket, "inproc://tp")) {
-		kill(getpid(), SIGTERM);
+	if (node.exists("not")) {
+		expr.op = FilterExpr::Not;
+		expr.args.push_back(FilterExpr());
+		parse_filter(node["not"], columns, expr.args.back());
 		return;
 	}
 
-	tpwrite_run(ZMQTpSocket);
-
-	zmq_close(ZMQTpSocket);
-}
-
-// ====================
-
-static unsigned seconds_behind_master;
-static unsigned max_seconds_behind_master;
-
-#ifdef ZMQ_ENABLE_RB
-static unsigned zalloc_count;
-static unsigned max_zalloc_count;
-#endif
-
-static void ping_watchdog()
-{
-	SerializableBinlogEvent ev;
-	ev.event = "PING";
-	send_zmq_event(ZMQWdSocket, ev);
-}
-
-static void update_stats()
-{
-	time_t now;
-
-	if (!dbreader) {
-		return;
+	if (!node.exists("column")) {
+		std::cerr << "Bad filter: 'and', 'or', 'not' or 'column' expected" << std::endl;
+		exit(EXIT_FAILURE);
 	}
-
-	ping_watchdog();
-
-	now = ::time(NULL);
-
-	seconds_behind_master = dbreader->GetSecondsBehindMaster();
-	if (seconds_behind_master > max_seconds_behind_master) max_seconds_behind_master = seconds_behind_master; 
-
-#ifdef ZMQ_ENABLE_RB
-	zalloc_count = zmq_get_alloc_count();
-	if (zalloc_count > max_zalloc_count) max_zalloc_count = zalloc_count;
-#endif
-
-	if (graphite) {
-		if (now > graphite->GetLastPacketTime() + graphite->GetInterval()) {
-			graphite->SendStat("seconds_behind_master", seconds_behind_master);
-			graphite->SendStat("max_seconds_behind_master", max_seconds_behind_master);
-			max_seconds_behind_master = seconds_behind_master;
-
-#ifdef ZMQ_ENABLE_RB
-			graphite->SendStat("zmq_allocs_total", zalloc_count);
-			graphite->SendStat("zmq_allocs_total_max", max_zalloc_count);
-			max_zalloc_count = zalloc_count;
-#endif
+	expr.column = filter_column(columns, node["column"]);
+
+	if (node.exists("in")) {
+		expr.op = FilterExpr::In;
+		parse_filter_values(node["in"], expr.values);
+	}
+	else if (node.exists("range")) {
+		long long lo, hi;
+		parse_filter_pair(node, "range", lo, hi);
+		expr.op = FilterExpr::Range;
+		expr.lo = lo;
+		expr.hi = hi;
+	}
+	else if (node.exists("hash_mod")) {
+		long long mod, rem;
+		parse_filter_pair(node, "hash_mod", mod, rem);
+		if (mod <= 0 || rem < 0 || rem >= mod) {
+			std::cerr << "Bad filter 'hash_mod': 0 <= rem < mod expected" << std::endl;
+			exit(EXIT_FAILURE);
 		}
-	}
-}
-
-// ====================
-// watchdog
-
-static time_t last_event_timestamp;
-
-static bool watchdog_ev_callback(const SerializableBinlogEvent &ev)
-{
-	last_event_timestamp = ::time(NULL);
-	return false;
-}
-
-static void watchdog_main(void *arg)
-{
-	unsigned timeout = (intptr_t)arg;
-	void *ZMQWdSocket = zmq_socket(ZMQContext, ZMQ_PAIR);
-
-	if (!ZMQWdSocket || zmq_connect(ZMQWdSocket, "inproc://wd")) {
-		kill(getpid(), SIGTERM);
-		return;
-	}
-
-	last_event_timestamp = ::time(NULL);
-
-	while (!is_term) {
-		poll_zmq_event(ZMQWdSocket, 1000, watchdog_ev_callback);
-
-		if (last_event_timestamp + timeout < ::time(NULL)) {
-			std::cerr << "Ping timeout detected by watchdog: committing suicide now. Restarting." << std::endl;
-			kill(getpid(), SIGKILL);
-			break;
+		expr.op = FilterExpr::HashMod;
+		expr.mod = mod;
+		expr.rem = rem;
+	}
+	else if (node.exists("eq")) {
+		const libconfig::Setting &eq = node["eq"];
+		if (eq.getType() == libconfig::Setting::TypeString) {
+			expr.op = FilterExpr::StrEq;
+			expr.str = (const char *)eq;
+		} else {
+			expr.op = FilterExpr::In;
+			expr.values.push_back((long long)eq);
 		}
 	}
-
-	zmq_close(ZMQWdSocket);
-}
-
-// ====================
-
-static bool tpread_zmq_callback(const SerializableBinlogEvent &ev, std::string &TpBinlogName, unsigned long &TpBinlogPos, 
-	bool &disconnect, bool &read)
-{
-	read = true;
-	disconnect = ev.event == "DISCONNECT";
-	TpBinlogName = ev.binlog_name;
-	TpBinlogPos = ev.binlog_pos;
-	return false;
-}
-
-static bool tpread_get_binlogpos(unsigned timeout, std::string &TpBinlogName, unsigned long &TpBinlogPos, bool &disconnect)
-{
-	bool read = false;
-	poll_zmq_event(ZMQTpSocket, timeout, boost::bind(tpread_zmq_callback, _1, boost::ref(TpBinlogName), boost::ref(TpBinlogPos), 
-		boost::ref(disconnect), boost::ref(read))); 
-	return read;
-}
-
-static bool dbread_callback(const SerializableBinlogEvent &ev, std::string &TpBinlogName, unsigned long &TpBinlogPos, bool &disconnect)
-{
-	if (is_term) {
-		return true;
+	else if (node.exists("prefix")) {
+		expr.op = FilterExpr::StrPrefix;
+		expr.str = (const char *)node["prefix"];
 	}
-
-	update_stats();
-
-	if (tpread_get_binlogpos(0, TpBinlogName, TpBinlogPos, disconnect)) {
-		return true;
+	else {
+		std::cerr << "Bad filter on column " << (const char *)node["column"] << ": 'in', 'range', 'hash_mod', 'eq' or 'prefix' expected" << std::endl;
+		exit(EXIT_FAILURE);
 	}
-	send_zmq_event(ZMQTpSocket, ev);
-	return false;
 }
 
-static void init(libconfig::Config &cfg)
+// Reads a pipeline: the mysql, tarantool and mappings of the group
+static Channel *init_channel(const libconfig::Setting &group, const std::string &name)
 {
 	unsigned watchdog_timeout = 60;
+	DBReader *dbreader;
+	TPWriter *tpwriter;
+	std::vector<unsigned> cpus;
 
-	try
+	// read Mysql settings
 	{
-		const libconfig::Setting& root = cfg.getRoot();
+		const libconfig::Setting &mysql = group["mysql"];
 
-		// read Mysql settings
-		{
-			const libconfig::Setting &mysql = root["mysql"];
+		unsigned port = 3306;
+		unsigned connect_retry = 15;
+		unsigned position_lag_bytes = 0;
+		unsigned position_lag_ms = 1000;
+		bool binlog_checksum_verify = true;
+		mysql.lookupValue("port", port);
+		mysql.lookupValue("connect_retry", connect_retry);
+		mysql.lookupValue("watchdog_timeout", watchdog_timeout);
+		mysql.lookupValue("position_lag_bytes", position_lag_bytes);
+		mysql.lookupValue("position_lag_ms", position_lag_ms);
+		mysql.lookupValue("binlog_checksum_verify", binlog_checksum_verify);
 
-			unsigned port = 3306;
-			unsigned connect_retry = 15;
-			mysql.lookupValue("port", port);
-			mysql.lookupValue("connect_retry", connect_retry);
-			mysql.lookupValue("watchdog_timeout", watchdog_timeout);
+		dbreader = new DBReader((const char *)mysql["host"], (const char *)mysql["user"], (const char *)mysql["password"], 
+			port, connect_retry, position_lag_bytes, position_lag_ms, binlog_checksum_verify);
+	}
 
-			dbreader = new DBReader((const char *)mysql["host"], (const char *)mysql["user"], (const char *)mysql["password"], 
-				port, connect_retry);
-		}
+	// read Tarantool config
+	{
+		const libconfig::Setting &tarantool = group["tarantool"];
 
-		// read Tarantool config
-		{
-			const libconfig::Setting &tarantool = root["tarantool"];
-
-			std::string user(""), password("");
-			unsigned port = 33013;
-			unsigned connect_retry = 15;
-			unsigned sync_retry = 1000;
-			bool disconnect_on_error = false;
-			tarantool.lookupValue("user", user);
-			tarantool.lookupValue("password", password);
-			tarantool.lookupValue("port", port);
-			tarantool.lookupValue("connect_retry", connect_retry);
-			tarantool.lookupValue("sync_retry", sync_retry);
-			tarantool.lookupValue("disconnect_on_error", disconnect_on_error);
-
-			tpwriter = new TPWriter((const char *)tarantool["host"], user, password, (unsigned)tarantool["binlog_pos_space"],
-				(unsigned)tarantool["binlog_pos_key"], port, connect_retry, sync_retry, disconnect_on_error);
-		}
+		std::string user(""), password("");
+		unsigned port = 33013;
+		unsigned connect_retry = 15;
+		unsigned sync_retry = 1000;
+		bool disconnect_on_error = false;
+		tarantool.lookupValue("user", user);
+		tarantool.lookupValue("password", password);
+		tarantool.lookupValue("port", port);
+		tarantool.lookupValue("connect_retry", connect_retry);
+		tarantool.lookupValue("sync_retry", sync_retry);
+		tarantool.lookupValue("disconnect_on_error", disconnect_on_error);
 
-		// read Mysql to Tarantool mappings (each table maps to a single Tarantool space)
-		{
-			const libconfig::Setting &mappings = root["mappings"];
-			int count = mappings.getLength();
-
-			for (int i = 0; i < count; i++) {
-				const libconfig::Setting &mapping = mappings[i];
-				const std::string database((const char *)mapping["database"]);
-				const std::string table((const char *)mapping["table"]);
-				std::string insert_call = TPWriter::empty_call;
-				std::string update_call = TPWriter::empty_call;
-				std::string delete_call = TPWriter::empty_call;
-				unsigned space((unsigned)mapping["space"]);
-				std::vector<std::string> columns;
-				TPWriter::Tuple tuple, keys;
-
-				// read columns tuple
-				{
-					const libconfig::Setting &columns_ = mapping["columns"];
-					int count = columns_.getLength();
-					for (int i = 0; i < count; i++) {
-						columns.push_back((const char *)columns_[i]);
-						tuple.push_back(i);
-					}
+		tpwriter = new TPWriter((const char *)tarantool["host"], user, password, (unsigned)tarantool["binlog_pos_space"],
+			(unsigned)tarantool["binlog_pos_key"], port, connect_retry, sync_retry, disconnect_on_error);
+	}
+
+	// read Mysql to Tarantool mappings (each table maps to a single Tarantool space)
+	{
+		const libconfig::Setting &mappings = group["mappings"];
+		int count = mappings.getLength();
+
+		for (int i = 0; i < count; i++) {
+			const libconfig::Setting &mapping = mappings[i];
+			const std::string database((const char *)mapping["database"]);
+			const std::string table((const char *)mapping["table"]);
+			std::string insert_call = TPWriter::empty_call;
+			std::string update_call = TPWriter::empty_call;
+			std::string delete_call = TPWriter::empty_call;
+			unsigned space((unsigned)mapping["space"]);
+			std::vector<std::string> columns;
+			TPWriter::Tuple tuple, keys;
+
+			// read columns tuple
+			{
+				const libconfig::Setting &columns_ = mapping["columns"];
+				int count = columns_.getLength();
+				for (int i = 0; i < count; i++) {
+					columns.push_back((const char *)columns_[i]);
+					tuple.push_back(i);
 				}
+			}
 
-				// read key Tarantool fields we'll use for DELETE requests
-				{
-					const libconfig::Setting &keys_ = mapping["key_fields"];
-					int count = keys_.getLength();
-					for (int i = 0; i < count; i++) {
-						unsigned k = keys_[i];
-						if (k >= columns.size()) {
-							std::cerr << "Bad key field id: " << k << " (should be less than " << columns.size() << ")" << std::endl;
-							exit(EXIT_FAILURE);
-						}
-						keys.push_back(k);
+			// read key Tarantool fields we'll use for DELETE requests
+			{
+				const libconfig::Setting &keys_ = mapping["key_fields"];
+				int count = keys_.getLength();
+				for (int i = 0; i < count; i++) {
+					unsigned k = keys_[i];
+					if (k >= columns.size()) {
+						std::cerr << "Bad key field id: " << k << " (should be less than " << columns.size() << ")" << std::endl;
+						exit(EXIT_FAILURE);
 					}
+					keys.push_back(k);
 				}
+			}
 
-				// lookup LUA procedures we can call instead of issuing DML requests
-				{
-					mapping.lookupValue("insert_call", insert_call);
-					mapping.lookupValue("update_call", update_call);
-					mapping.lookupValue("delete_call", delete_call);
+			// lookup LUA procedures we can call instead of issuing DML requests
+			{
+				mapping.lookupValue("insert_call", insert_call);
+				mapping.lookupValue("update_call", update_call);
+				mapping.lookupValue("delete_call", delete_call);
+			}
+
+			// row filter: "filter" expression and/or legacy "simple_filter", both must pass
+			{
+				const libconfig::Setting &columns_ = mapping["columns"];
+				FilterExpr expr;
+
+				if (mapping.exists("filter")) {
+					expr.args.push_back(FilterExpr());
+					parse_filter(mapping["filter"], columns_, expr.args.back());
 				}
 
-				if (mapping.exists("simple_filter"))
-				{
-					const libconfig::Setting &columns = mapping["columns"];
+				if (mapping.exists("simple_filter")) {
 					const libconfig::Setting &simple_filter = mapping["simple_filter"];
-					const std::string column((const char *)simple_filter["column"]);
 
-					bool negate;
-					simple_filter.lookupValue("negate", negate);
+					FilterExpr in(FilterExpr::In);
+					in.column = filter_column(columns_, simple_filter["column"]);
+					parse_filter_values(simple_filter["values"], in.values);
 
-					std::vector<int64_t> values;
+					bool negate = false;
+					simple_filter.lookupValue("negate", negate);
 
-					const libconfig::Setting &values_ = simple_filter["values"];
-					for (int i = 0; i < values_.getLength(); i++) {
-						values.push_back((long long)values_[i]);
+					if (negate) {
+						expr.args.push_back(FilterExpr(FilterExpr::Not));
+						expr.args.back().args.push_back(in);
+					} else {
+						expr.args.push_back(in);
 					}
+				}
 
-					unsigned column_num = columns.getLength();
-					for (int i = 0; i < columns.getLength(); i++) {
-						if (column == (const char *)columns[i]) {
-							column_num = i;
-							break;
-						}
-					}
+				if (!expr.args.empty()) {
+					dbreader->AddFilter(database, table, expr);
+				}
+			}
 
-					if (column_num == columns.getLength()) {
-						std::cerr << "Bad filter field: " << column << std::endl;
+			// DECIMAL columns go as doubles unless told otherwise
+			if (mapping.exists("decimal_format")) {
+				const libconfig::Setting &formats = mapping["decimal_format"];
+				for (int i = 0; i < formats.getLength(); i++) {
+					const std::string format((const char *)formats[i]);
+					slave::Field_decimal::Format f;
+					if (format == "double") {
+						f = slave::Field_decimal::Double;
+					} else if (format == "scaled") {
+						f = slave::Field_decimal::Scaled;
+					} else if (format == "string") {
+						f = slave::Field_decimal::String;
+					} else {
+						std::cerr << "Bad decimal_format of " << formats[i].getName() << ": 'double', 'scaled' or 'string' expected" << std::endl;
 						exit(EXIT_FAILURE);
 					}
-
-					SimplePredicate pred(column_num, negate, values);
-					dbreader->AddFilterPredicate(database, table, pred);
+					dbreader->AddDecimalFormat(database, table, formats[i].getName(), f);
 				}
-
-				dbreader->AddTable(database, table, columns);
-				tpwriter->AddTable(database, table, space, tuple, keys, insert_call, update_call, delete_call);
 			}
+
+			bool epoch_seconds = false;
+			mapping.lookupValue("epoch_seconds", epoch_seconds);
+
+			dbreader->AddTable(database, table, columns, epoch_seconds);
+			tpwriter->AddTable(database, table, space, tuple, keys, insert_call, update_call, delete_call);
 		}
+	}
+
+	// CPUs the threads of the channel run on, any if not given
+	if (group.exists("cpu")) {
+		const libconfig::Setting &cpu = group["cpu"];
+		for (int i = 0; i < cpu.getLength(); i++) {
+			cpus.push_back((unsigned)cpu[i]);
+		}
+	}
+
+	return new Channel(name, dbreader, tpwriter, watchdog_timeout, cpus, graphite);
+}
+
+static void init(libconfig::Config &cfg)
+{
+	try
+	{
+		const libconfig::Setting& root = cfg.getRoot();
 
 		// read graphite config
 		{
@@ -522,6 +342,23 @@ static void init(libconfig::Config &cfg)
 
 			graphite = new Graphite(host, port, prefix);
 		}
+
+		// one pipeline set up at the top level or a list of named channels
+		if (root.exists("channels")) {
+			const libconfig::Setting &channels_ = root["channels"];
+			std::set<std::string> names;
+
+			for (int i = 0; i < channels_.getLength(); i++) {
+				const std::string name((const char *)channels_[i]["name"]);
+				if (name.empty() || !names.insert(name).second) {
+					std::cerr << "Bad channel name '" << name << "': unique non-empty names expected" << std::endl;
+					exit(EXIT_FAILURE);
+				}
+				channels.push_back(init_channel(channels_[i], name));
+			}
+		} else {
+			channels.push_back(init_channel(root, ""));
+		}
 	}
 	catch(const libconfig::SettingNotFoundException &nfex)
 	{
@@ -529,59 +366,54 @@ static void init(libconfig::Config &cfg)
 		exit(EXIT_FAILURE);
 	}
 
-	start_zmq(watchdog_timeout);
-
-	ping_watchdog();
-}
-
-static void main_loop()
-{
-	std::string TpBinlogName;
-	unsigned long TpBinlogPos;
-	bool disconnected;
-
-	// read initial binlog pos from Tarantool
-	while (!is_term) {
-		tpread_get_binlogpos(100, TpBinlogName, TpBinlogPos, disconnected);
-		if (disconnected) {
-			ping_watchdog();
-			::sleep(1);
-			continue;
-		}
-
-		if (is_term) {
-			break;
-		}
-
-		try {
-			BinlogEventCallback cb = boost::bind(dbread_callback, _1,
-				boost::ref(TpBinlogName), boost::ref(TpBinlogPos), boost::ref(disconnected));
-
-			if (TpBinlogName == "") {
-				std::cout << "Tarantool reported null binlog position. Dumping tables..." << std::endl;
-				dbreader->DumpTables(TpBinlogName, TpBinlogPos, cb);
-			}
+	if (channels.empty()) {
+		std::cerr << "No channels configured" << std::endl;
+		exit(EXIT_FAILURE);
+	}
 
-			std::cout << "Reading binlogs (" << TpBinlogName << ", " << TpBinlogPos << ")..." << std::endl;
+	// mysql_init() on the channel threads is only thread-safe after this
+	if (mysql_library_init(0, NULL, NULL)) {
+		std::cerr << "Can't initialize MySQL client library" << std::endl;
+		exit(EXIT_FAILURE);
+	}
 
-			dbreader->ReadBinlog(TpBinlogName, TpBinlogPos, cb);
-		} catch (std::exception& ex) {
-			std::cerr << "Error in reading binlogs: " << ex.what() << std::endl;
+	// shared by the channels, their endpoints are named after them
+	ZMQContext = zmq_ctx_new();
+	if (ZMQContext == NULL) {
+		std::cerr << "Can't create ZMQ context" << std::endl;
+		exit(EXIT_FAILURE);
+	}
 
+	channels_ready = true;
+	for (size_t i = 0; i < channels.size() && !is_term; i++) {
+		if (!channels[i]->Start(ZMQContext)) {
+			std::cerr << "Can't start channel " << channels[i]->GetName() << std::endl;
 			halt();
 		}
 	}
 }
 
+static void main_loop()
+{
+	// the channels run on threads of their own
+	for (size_t i = 0; i < channels.size(); i++) {
+		channels[i]->Join();
+	}
+}
+
 static void shutdown()
 {
-	close_zmq();
+	// sighandler protection
+	channels_ready = false;
 
-	if (dbreader) {
-		// sighandler protection
-		DBReader *dbreader_ = dbreader;
-		dbreader = NULL;
-		delete dbreader_;
+	for (size_t i = 0; i < channels.size(); i++) {
+		delete channels[i];
+	}
+	channels.clear();
+
+	if (ZMQContext != NULL) {
+		zmq_ctx_term(ZMQContext);
+		ZMQContext = NULL;
 	}
 
 	if (graphite) {
@@ -590,13 +422,20 @@ static void shutdown()
 	}
 }
 
+static void stop_channels()
+{
+	if (channels_ready) {
+		for (size_t i = 0; i < channels.size(); i++) {
+			channels[i]->Stop();
+		}
+	}
+}
+
 static void sighandler(int sig)
 {
 	is_halted = false;
 	is_term = true;
-	if (dbreader) {
-		dbreader->Stop();
-	}
+	stop_channels();
 }
 
 static void halt(void)
@@ -605,16 +444,12 @@ static void halt(void)
 
 	is_halted = false;
 	is_term = true;
-	if (dbreader) {
-		dbreader->Stop();
-	}
+	stop_channels();
 }
 
 }
 
 static replicator::Logger *ol, *el;
-static std::streambuf *ol_sink, *el_sink;
-static std::ofstream *flog;
 
 static std::string log_filename(replicator::default_log_filename);
 static std::string pid_filename(replicator::default_pid_filename);
@@ -635,48 +470,36 @@ static void removepidfile()
 
 static void openlogfile()
 {
-	flog = new std::ofstream(log_filename, std::ofstream::app);
-
-	// redirect cout and cerr streams, appending timestamps and log levels
-	ol = new replicator::Logger(std::cout, 'I');
-	el = new replicator::Logger(std::cerr, 'E');
-
-	ol_sink = ol->rdsink();
-	el_sink = el->rdsink();
+	replicator::logfile = new replicator::AsyncLog(log_filename);
 
-	// redirect loggers to file
-	ol->rdsink(flog->rdbuf());
-	el->rdsink(flog->rdbuf());
+	// redirect cout and cerr streams to the file, appending timestamps and log levels
+	ol = new replicator::Logger(std::cout, 'I', *replicator::logfile);
+	el = new replicator::Logger(std::cerr, 'E', *replicator::logfile);
 }
 
 static void closelogfile()
 {
-	if (flog == NULL) {
+	if (replicator::logfile == NULL) {
 		return;
 	}
 
-	flog->flush();
-	flog->close();
-
-	delete flog;
-	flog = NULL;
-
 	// restore streams
-	ol->rdsink(ol_sink);
-	el->rdsink(el_sink);
-
 	delete ol;
 	delete el;
 
 	ol = NULL;
 	el = NULL;
+
+	// writes out what is left
+	delete replicator::logfile;
+	replicator::logfile = NULL;
 }
 
 static void sighup_handler(int sig)
 {
-	closelogfile();
-	openlogfile();
-	std::cout << "Caught SIGHUP, continuing..." << std::endl;
+	if (replicator::logfile) {
+		replicator::logfile->Reopen();
+	}
 }
 
 int main(int argc, char** argv)
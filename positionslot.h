@@ -0,0 +1,62 @@
+#ifndef REPLICATOR_POSITIONSLOT_H
+#define REPLICATOR_POSITIONSLOT_H
+
+#include <boost/thread/mutex.hpp>
+
+#include "serializable.h"
+
+namespace replicator {
+
+// Binlog position handed from the reader thread to the writer thread next to
+// the message queue. A new position replaces the one not taken yet, so
+// position-only updates cost no messages however many transactions there are.
+//
+// The reader tags each position with the number of batches it has sent so
+// far; the writer takes it only after it has processed as many batches, so
+// the position never gets ahead of the data.
+class PositionSlot
+{
+public:
+	PositionSlot() : pending(false), seq(0), published(0), taken(0) {}
+
+	void Publish(const SerializableBinlogEvent &ev, unsigned long batches_sent)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		position = ev;
+		seq = batches_sent;
+		pending = true;
+		published++;
+	}
+
+	bool Take(unsigned long batches_done, SerializableBinlogEvent &ev)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		if (!pending || batches_done < seq) {
+			return false;
+		}
+		ev = position;
+		pending = false;
+		taken++;
+		return true;
+	}
+
+	// Positions published and taken, the difference is what was merged away
+	void GetCounters(unsigned long &published_, unsigned long &taken_)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		published_ = published;
+		taken_ = taken;
+	}
+
+private:
+	boost::mutex mutex;
+	SerializableBinlogEvent position;
+	bool pending;
+	unsigned long seq;
+	unsigned long published;
+	unsigned long taken;
+};
+
+} // replicator
+
+#endif // REPLICATOR_POSITIONSLOT_H
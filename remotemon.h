@@ -8,8 +8,11 @@
 #include <string>
 #include <sstream>
 
+#include <boost/thread/mutex.hpp>
+
 namespace replicator {
 
+// Shared by all channels, stats are sent under a mutex
 class Graphite
 {
 public:
@@ -21,6 +24,7 @@ public:
 	template<typename T>
 	void SendStat(const std::string &graph, T value)
 	{
+		boost::mutex::scoped_lock lock(mutex);
 		Init();
 
 		if (sock < 0) {
@@ -35,7 +39,11 @@ public:
 		last_packet_time = ::time(NULL);
 	}
 
-	::time_t GetLastPacketTime() const { return last_packet_time; }
+	::time_t GetLastPacketTime()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		return last_packet_time;
+	}
 
 	unsigned GetInterval() const { return 60; }
 
@@ -47,6 +55,7 @@ private:
 	int sock;
 	struct sockaddr_in server;
 	::time_t last_packet_time;
+	boost::mutex mutex;
 
 	void Init()
 	{
@@ -4,9 +4,12 @@
 #include <string>
 #include <map>
 #include <sstream>
+#include <stdio.h>
 #include <boost/any.hpp>
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/vector.hpp>
+#include <boost/serialization/split_member.hpp>
+#include "fieldvalue.h"
 
 namespace replicator {
 
@@ -45,6 +48,10 @@ private:
 				type_id = "ull";
 				s << boost::any_cast<unsigned long long>(v);
 			}
+			else if (v.type() == typeid(long long)) {
+				type_id = "ll";
+				s << boost::any_cast<long long>(v);
+			}
 			else if (v.type() == typeid(float)) {
 				type_id = "float";
 				s << boost::any_cast<float>(v);
@@ -76,6 +83,28 @@ private:
 		}
 	}
 
+	// Same text as fromAny() gives, without a stream: 'second' keeps its buffer
+	void fromFieldValue (const slave::FieldValue &v)
+	{
+		char buf[32];
+		int n = 0;
+
+		switch (v.type) {
+			case slave::FieldValue::String:
+				type_id = "string";
+				second.assign(v.s);
+				return;
+			case slave::FieldValue::Int:       type_id = "int";    n = ::snprintf(buf, sizeof(buf), "%d", v.i); break;
+			case slave::FieldValue::UInt:      type_id = "uint";   n = ::snprintf(buf, sizeof(buf), "%u", v.u); break;
+			case slave::FieldValue::ULongLong: type_id = "ull";    n = ::snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v.ull); break;
+			case slave::FieldValue::LongLong:  type_id = "ll";     n = ::snprintf(buf, sizeof(buf), "%lld", (long long)v.ll); break;
+			case slave::FieldValue::Float:     type_id = "float";  n = ::snprintf(buf, sizeof(buf), "%g", v.f); break;
+			case slave::FieldValue::Double:    type_id = "double"; n = ::snprintf(buf, sizeof(buf), "%g", v.d); break;
+			default:                           type_id = "null";   break;
+		}
+		second.assign(buf, n);
+	}
+
 public:
 	std::string second;
 
@@ -88,12 +117,23 @@ public:
 		fromAny(v);
 	}
 
+	SerializableValue (const slave::FieldValue &v)
+	{
+		fromFieldValue(v);
+	}
+
 	SerializableValue & operator = (const boost::any &v)
 	{
 		fromAny(v);
 		return *this;
 	}
 
+	SerializableValue & operator = (const slave::FieldValue &v)
+	{
+		fromFieldValue(v);
+		return *this;
+	}
+
 	boost::any operator *() const {
 		if (type_id == "string") {
 			return boost::any(second);
@@ -126,6 +166,11 @@ public:
 			s >> val;
 			return boost::any(val);
 		}
+		if (type_id == "ll") {
+			long long val;
+			s >> val;
+			return boost::any(val);
+		}
 		if (type_id == "null") {
 			return boost::any();
 		}
@@ -150,6 +195,7 @@ private:
 	template<class Archive>
 	void serialize(Archive &ar, const unsigned int file_version){
 		ar & binlog_name & binlog_pos & seconds_behind_master & unix_timestamp & database & table & event & row;
+		ar & present & old_row & old_present;
 	}
 
 public:
@@ -161,6 +207,66 @@ public:
 	std::string table;
 	std::string event;
 	SerializableRow row;
+	// Columns carried by a partial row image (binlog_row_image=MINIMAL or
+	// NOBLOB), empty for a full one
+	std::vector<bool> present;
+	// Before image of a partial update, its key columns locate the tuple
+	SerializableRow old_row;
+	std::vector<bool> old_present;
+
+	bool Has(unsigned col) const { return present.empty() || (col < present.size() && present[col]); }
+	bool HasOld(unsigned col) const { return !old_row.empty() && (old_present.empty() || (col < old_present.size() && old_present[col])); }
+};
+
+// Events sent to the writer in one message, e.g. all rows of one rows event.
+// Events past size() are kept for reuse and are not serialized.
+class SerializableBinlogEventBatch
+{
+private:
+	friend class boost::serialization::access;
+
+	template<class Archive>
+	void save(Archive &ar, const unsigned int file_version) const {
+		ar & count;
+		for (unsigned i = 0; i < count; ++i) {
+			ar & events[i];
+		}
+	}
+
+	template<class Archive>
+	void load(Archive &ar, const unsigned int file_version) {
+		ar & count;
+		if (events.size() < count) {
+			events.resize(count);
+		}
+		for (unsigned i = 0; i < count; ++i) {
+			ar & events[i];
+		}
+	}
+
+	BOOST_SERIALIZATION_SPLIT_MEMBER()
+
+	std::vector<SerializableBinlogEvent> events;
+	unsigned count;
+
+public:
+	SerializableBinlogEventBatch() : count(0) {}
+
+	unsigned size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	const SerializableBinlogEvent & operator [] (unsigned i) const { return events[i]; }
+
+	void clear() { count = 0; }
+
+	SerializableBinlogEvent & add() {
+		if (count == events.size()) {
+			events.push_back(SerializableBinlogEvent());
+		}
+		return events[count++];
+	}
+
+	void drop() { --count; }
 };
 
 } // replicator
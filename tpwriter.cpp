@@ -28,7 +28,7 @@ binlog_name(""), binlog_pos(0), seconds_behind_master(0), last_unix_timestamp(0)
 port(port), connect_retry(connect_retry), sync_retry(sync_retry),
 next_connect_attempt(0), next_sync_attempt(0), next_ping_attempt(0),
 last_synced_binlog_name(""), last_synced_binlog_pos(0), disconnect_on_error(disconnect_on_error),
-reply_bytes(0), reply_server_code(0), reply_error_msg("")
+reply_bytes(0), reply_server_code(0), reply_error_msg(""), last_space(NULL)
 {
 
 }
@@ -167,6 +167,31 @@ void TPWriter::AddTable(const std::string &db, const std::string &table, unsigne
 	s.insert_call = insert_call;
 	s.update_call = update_call;
 	s.delete_call = delete_call;
+
+	last_db.clear();
+	last_table.clear();
+	last_space = NULL;
+}
+
+const TPWriter::TableSpace *TPWriter::FindTable(const std::string &db, const std::string &table)
+{
+	if (last_space != NULL && last_table == table && last_db == db) {
+		return last_space;
+	}
+
+	DBMap::const_iterator i = dbs.find(db);
+	if (i == dbs.end()) {
+		return NULL;
+	}
+	TableMap::const_iterator j = i->second.find(table);
+	if (j == i->second.end()) {
+		return NULL;
+	}
+
+	last_db = db;
+	last_table = table;
+	last_space = &j->second;
+	return last_space;
 }
 
 void TPWriter::SaveBinlogPos()
@@ -203,20 +228,109 @@ void TPWriter::SaveBinlogPos()
 	last_synced_binlog_pos = binlog_pos;
 }
 
+// Tarantool field of a column value, 'num' holds numbers
+static void EncodeField(const SerializableValue &v, char (&num)[8], const char *&data, size_t &size)
+{
+	const boost::any &a = *v;
+	const std::string &vs = v.value_string();
+
+	try {
+		if (a.type() == typeid(int)) {
+			int32_t ival = boost::any_cast<int>(a);
+			::memcpy(num, &ival, size = sizeof(ival));
+		} else if (a.type() == typeid(unsigned int)) {
+			uint32_t ival = boost::any_cast<unsigned int>(a);
+			::memcpy(num, &ival, size = sizeof(ival));
+		} else if (a.type() == typeid(long long)) {
+			int64_t ival = int64_t(boost::any_cast<long long>(a));
+			::memcpy(num, &ival, size = sizeof(ival));
+		} else if (a.type() == typeid(unsigned long long)) {
+			uint64_t ival = uint64_t(boost::any_cast<unsigned long long>(a));
+			::memcpy(num, &ival, size = sizeof(ival));
+		} else 	if (a.type() == typeid(long)) {
+			uint32_t ival = uint32_t(boost::any_cast<long>(a));
+			::memcpy(num, &ival, size = sizeof(ival));
+		} else if (a.type() == typeid(float) || a.type() == typeid(double)) {
+			union {
+				uint32_t i;
+				float f;
+			} uiv;
+			uiv.f = a.type() == typeid(float) ? boost::any_cast<float>(a) : float(boost::any_cast<double>(a));
+			::memcpy(num, &uiv.i, size = sizeof(uiv.i));
+		}
+		else if (a.type() == typeid(void)) {
+			data = "";
+			size = 0;
+			return;
+		}
+		else {
+			data = vs.c_str();
+			size = vs.length();
+			return;
+		}
+		data = num;
+	}
+	catch (boost::bad_any_cast &ex) {
+		throw std::range_error(std::string("Typecasting error for column: ") + ex.what());
+	}
+}
+
 bool TPWriter::BinlogEventCallback(const SerializableBinlogEvent &ev)
 {
 	char buf[TPWriter::SND_BUFSIZE];
 	::tp req;
+	char num[8];
+	const char *data;
+	size_t size;
 
 	// spacial case event "IGNORE", which only updates binlog position
 	// but doesn't modify any table data
 
-	DBMap::const_iterator i = dbs.find(ev.database);
-	if (ev.event != "IGNORE" && i != dbs.end()) {
-		const TableMap &d = i->second;
-		TableMap::const_iterator j = d.find(ev.table);
-		if (j != d.end()) {
-			const TableSpace &s = j->second;
+	if (ev.event != "IGNORE") {
+		const TableSpace *ts = FindTable(ev.database, ev.table);
+		if (ts != NULL && ev.event == "UPDATE" && !ev.present.empty()) {
+			// partial after image (binlog_row_image=MINIMAL): only the columns
+			// it carries are set, the tuple is found by the key of the before image
+			const TableSpace &s = *ts;
+			if (!s.update_call.empty()) {
+				throw std::range_error("Partial row image of " + ev.database + "." + ev.table + " can't be passed to " + s.update_call);
+			}
+
+			::tp_init(&req, buf, sizeof(buf), NULL, NULL);
+			::tp_update(&req, s.space, 0);
+			::tp_tuple(&req);
+
+			for (Tuple::const_iterator it = s.keys.begin(); it != s.keys.end(); ++it) {
+				unsigned col = *it;
+				if (ev.HasOld(col)) {
+					EncodeField(ev.old_row[col], num, data, size);
+				} else if (ev.Has(col)) {
+					EncodeField(ev.row[col], num, data, size);
+				} else {
+					throw std::range_error("Key column is missing from the row images of " + ev.database + "." + ev.table);
+				}
+				::tp_field(&req, data, size);
+			}
+
+			::tp_updatebegin(&req);
+
+			unsigned ops = 0;
+			for (unsigned i = 0; i < s.tuple.size(); ++i) {
+				unsigned col = s.tuple[i];
+				if (ev.Has(col)) {
+					EncodeField(ev.row[col], num, data, size);
+					::tp_op(&req, i, TP_OPSET, data, size);
+					++ops;
+				}
+			}
+
+			// none of the changed columns is replicated
+			if (ops) {
+				Send(buf, ::tp_used(&req));
+			}
+		}
+		else if (ts != NULL) {
+			const TableSpace &s = *ts;
 			const Tuple &t = ev.event == "DELETE" ? s.keys : s.tuple;
 
 			// add Tarantool request
@@ -249,47 +363,18 @@ bool TPWriter::BinlogEventCallback(const SerializableBinlogEvent &ev)
 
 			::tp_tuple(&req);
 
+			// a partial before image is enough to delete by the key, a tuple
+			// can't be written without all of its columns; libslave has filled
+			// in the defaults of the columns an insert left out, those without
+			// a known default are still missing
 			for (Tuple::const_iterator it = t.begin(); it != t.end(); ++it) {
 				unsigned col = *it;
-				const SerializableValue &v = ev.row[col];
-				const boost::any &a = *v;
-				const std::string &vs = v.value_string();
-
-				try {
-					if (a.type() == typeid(int)) {
-						int32_t ival = boost::any_cast<int>(a);
-						::tp_field(&req, (const char *)&ival, sizeof(ival));
-					} else if (a.type() == typeid(unsigned int)) {
-						uint32_t ival = boost::any_cast<unsigned int>(a);
-						::tp_field(&req, (const char *)&ival, sizeof(ival));
-					} else if (a.type() == typeid(long long)) {
-						int64_t ival = int64_t(boost::any_cast<long long>(a));
-						::tp_field(&req, (const char *)&ival, sizeof(ival));
-					} else if (a.type() == typeid(unsigned long long)) {
-						uint64_t ival = uint64_t(boost::any_cast<unsigned long long>(a));
-						::tp_field(&req, (const char *)&ival, sizeof(ival));
-					} else 	if (a.type() == typeid(long)) {
-						uint32_t ival = uint32_t(boost::any_cast<long>(a));
-						::tp_field(&req, (const char *)&ival, sizeof(ival));
-					} else if (a.type() == typeid(float) || a.type() == typeid(double)) {
-						union {
-							uint32_t i;
-							float f;
-						} uiv;
-						uiv.f = a.type() == typeid(float) ? boost::any_cast<float>(a) : float(boost::any_cast<double>(a));
-						::tp_field(&req, (const char *)&uiv.i, sizeof(uiv.i));
-					}
-					else if (a.type() == typeid(void)) {
-						::tp_field(&req, "", 0);
-					}
-					else {
-						::tp_field(&req, vs.c_str(), vs.length());
-					}
-				}
-				catch (boost::bad_any_cast &ex) {
-					throw std::range_error(std::string("Typecasting error for column: ") + ex.what());
-					return true;
+				if (!ev.Has(col)) {
+					throw std::range_error((ev.event == "DELETE" ? "Key column" : "Column") +
+						std::string(" is missing from the row image of ") + ev.database + "." + ev.table);
 				}
+				EncodeField(ev.row[col], num, data, size);
+				::tp_field(&req, data, size);
 			}
 
 			Send(buf, ::tp_used(&req));
@@ -313,6 +398,16 @@ bool TPWriter::BinlogEventCallback(const SerializableBinlogEvent &ev)
 	return false;
 }
 
+bool TPWriter::BinlogBatchCallback(const SerializableBinlogEventBatch &batch)
+{
+	for (unsigned i = 0; i < batch.size(); ++i) {
+		if (BinlogEventCallback(batch[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
 // blocking send
 ssize_t TPWriter::Send(void *buf, ssize_t bytes)
 {
@@ -20,6 +20,7 @@ public:
 	bool ReadBinlogPos(std::string &binlog_name, unsigned long &binlog_pos);
 	bool Sync(bool force = false);
 	bool BinlogEventCallback(const SerializableBinlogEvent &ev);
+	bool BinlogBatchCallback(const SerializableBinlogEventBatch &batch);
 	void Ping();
 
 	// return values:
@@ -98,6 +99,12 @@ private:
 	typedef std::map<std::string, TableMap> DBMap;
 	DBMap dbs;
 
+	// rows of a batch usually belong to one table, remember the last lookup
+	const TableSpace *FindTable(const std::string &db, const std::string &table);
+	std::string last_db;
+	std::string last_table;
+	const TableSpace *last_space;
+
 };
 
 }